@@ -6,12 +6,181 @@
 #include <stdbool.h>
 #include <string.h>
 #include "spi.h"
+#if ENC_PKTBUF
+#include "pktbuf.h"
 
-#define TX_START	(0x1FFF - 0x600)
-#define RX_END		(TX_START-1)
+#ifndef UIP_CONF_EXTERNAL_BUFFER
+#error "ENC_PKTBUF requires UIP_CONF_EXTERNAL_BUFFER"
+#endif
+#endif
+
+/* Buffer memory, from the top down:
+ *   TX slots		ENC_TX_SLOTS * TX_SLOT_SIZE
+ *   rexmit slots	UIP_CONNS * ENC_REXMIT_SLOT_SIZE
+ *   RX ring		the rest, at least ENC_RX_MIN
+ * With the defaults that is 3 KB, 2 KB and 3 KB. */
+#define ENC_MEM_SIZE	0x2000
+
+/* The TX area at the top of buffer memory is split into
+ * ENC_TX_SLOTS slots, each holding one frame */
+#define TX_SLOT_SIZE	0x600
+#define TX_START	(ENC_MEM_SIZE - ENC_TX_SLOTS * TX_SLOT_SIZE)
+
+/* The RX ring starts at the bottom of buffer memory */
+#define RX_START	0x0000
+
+#if UIP_REXMIT_CACHE
+/* Below the TX slots, one retransmission slot per connection */
+#define REXMIT_SIZE	(UIP_CONNS * ENC_REXMIT_SLOT_SIZE)
+#else
+#define REXMIT_SIZE	0
+#endif
+#define REXMIT_START	(TX_START - REXMIT_SIZE)
+#define RX_END		(REXMIT_START-1)
+
+#if RX_END + 1 - RX_START < ENC_RX_MIN
+#error "RX ring below ENC_RX_MIN: fewer TX slots, connections or a smaller UIP_TCP_MSS"
+#endif
+
+/* Control byte, frame and status vector must fit in a slot */
+#define TX_MAX_FRAME	(TX_SLOT_SIZE - 1 - 7)
+
+/* Bytes read before deciding whether a frame is wanted:
+ * Ethernet, IP and TCP headers without options */
+#define RX_HEADER_LEN	(UIP_LLH_LEN + UIP_IPTCPH_LEN)
+
+/* Result of classifying a received frame */
+#define RX_ACCEPT		0
+#define RX_DROP_ETHERTYPE	1
+#define RX_DROP_IP_DEST		2
+#define RX_DROP_TCP_PORT	3
+#define RX_DROP_UDP_PORT	4
+#define RX_DROP_CHECKSUM	5
+
+/* TCP header flag, as in uip.c */
+#define TCP_RST			0x04
+
+/* Address 'offset' bytes after 'addr' in the RX ring */
+#define RX_ADDR(addr, offset)	(((addr) + (offset)) % (RX_END + 1))
+
+#if ENC_SPILL_SLOTS
+/* Frames are spilled to SRAM once this many bytes of the RX ring
+ * are unread, until it is down to the low watermark */
+#define SPILL_HIGH		((RX_END + 1) * 3 / 4)
+#define SPILL_LOW		((RX_END + 1) / 4)
+#define SPILL_SLOT_SIZE		0x600
+#define SPILL_ADDR(slot)	(SPI_MEM_SPILL_BASE + (slot) * SPILL_SLOT_SIZE)
+
+#if ENC_SPILL_SLOTS * SPILL_SLOT_SIZE > SPI_MEM_SPILL_SIZE
+#error "ENC_SPILL_SLOTS does not fit the SRAM spill area"
+#endif
+#endif
 
 static uint8_t enc_current_bank;
+static struct enc_spi_stats enc_spi_stats;
+
+/* Every assertion of chip select is one SPI transaction */
+#define SELECT_ENC() do { \
+	enc_spi_stats.transactions++; \
+	spi_lock(SPI_DEV_ENC); \
+	MAP_GPIOPinWrite(ENC_CS_PORT, ENC_CS, 0); \
+} while (0)
+#define DESELECT_ENC() do { \
+	MAP_GPIOPinWrite(ENC_CS_PORT, ENC_CS, ENC_CS); \
+	spi_unlock(SPI_DEV_ENC); \
+} while (0)
+
+/* Shadow copies of the banked control registers that only the
+ * driver modifies, so unchanged values are not written again and
+ * reads don't need the bus. A bit in enc_shadow_valid marks the
+ * register as holding the last value written. */
+#define SHADOW_REGS	0x1A
+static uint8_t enc_shadow[4][SHADOW_REGS];
+static uint32_t enc_shadow_valid[4];
 static uint16_t enc_next_packet;
+/* Frames left to receive in the current burst */
+static uint8_t enc_rx_burst;
+
+struct enc_tx_slot {
+	uint16_t start;
+	uint16_t end;
+	uint8_t status[7];
+};
+
+/* Ring of TX slots. The slot at enc_tx_head is the one being
+ * transmitted, the following enc_tx_count-1 are queued behind it. */
+static struct enc_tx_slot enc_tx_slots[ENC_TX_SLOTS];
+static uint8_t enc_tx_head;
+static uint8_t enc_tx_count;
+static bool enc_tx_ok = true;
+static struct enc_tx_stats enc_tx_stats;
+#if ENC_PKTBUF
+/* Frames waiting for a TX slot */
+static struct pktbuf_queue enc_tx_pbs;
+#endif
+
+/* Link state */
+static uint8_t enc_duplex = ENC_DUPLEX;
+static bool enc_strap_full;
+static bool enc_link;
+static enc_link_callback_t enc_link_callback;
+static struct enc_rx_stats enc_rx_stats;
+
+#if ENC_SPILL_SLOTS
+/* FIFO of frames in SRAM, oldest at enc_spill_head */
+static uint16_t enc_spill_len[ENC_SPILL_SLOTS];
+static uint8_t enc_spill_head;
+static uint8_t enc_spill_count;
+static bool enc_spilling;
+static uint8_t enc_spill_hdr[RX_HEADER_LEN];
+static struct enc_spill_stats enc_spill_stats;
+#endif
+
+#if UIP_REXMIT_CACHE
+/* The last segment with data sent on each connection */
+struct enc_rexmit_entry {
+	bool valid;
+	uint8_t seqno[4];
+	uint16_t len;
+	uint16_t end;
+};
+
+static struct enc_rexmit_entry enc_rexmit[UIP_CONNS];
+static struct enc_rexmit_stats enc_rexmit_stats;
+#endif
+static enc_tx_callback_t enc_tx_callback;
+
+#if ENC_USE_DMA
+/* State of the DMA transfer in flight */
+static volatile bool enc_dma_active;
+static enc_dma_callback_t enc_dma_done;
+static struct spi_xfer enc_xfer;
+
+#if ENC_PKTBUF
+/* Frames are received into a free pktbuf and queued for uIP, which
+ * keeps using uip_buf while the transfer is in flight */
+static struct pktbuf *enc_rx_pb;
+static struct pktbuf_queue enc_rx_queue;
+#elif UIP_BUFALIGN
+/* Frames are received into a separate buffer, so uIP can keep
+ * using uip_buf while the transfer is in flight */
+/* At the same offset from a word boundary as uip_buf, so that the copy
+ * between them goes a word at a time */
+static uint8_t enc_rx_words[UIP_BUFALIGN_PAD + UIP_BUFSIZE]
+  __attribute__ ((aligned(4)));
+#define enc_rx_buf (enc_rx_words + UIP_BUFALIGN_PAD)
+#else
+static uint8_t enc_rx_buf[UIP_BUFSIZE];
+#endif
+static uint16_t enc_rx_len;
+static bool enc_rx_pending;
+static volatile bool enc_rx_done;
+
+static void enc_rbm_start(uint8_t *buf, uint16_t count,
+			  enc_dma_callback_t done);
+static void enc_wbm_start(const uint8_t *buf, uint16_t count,
+			  enc_dma_callback_t done);
+#endif
 
 /* Internal low-level register access functions*/
 static uint8_t enc_rcr(uint8_t reg);
@@ -29,6 +198,9 @@ static void enc_write_reg(uint8_t reg, uint8_t bank, uint8_t value);
 static uint8_t enc_read_mreg(uint8_t reg, uint8_t bank);
 static void enc_set_bits(uint8_t reg, uint8_t bank, uint8_t mask);
 static void enc_clear_bits(uint8_t reg, uint8_t bank, uint8_t mask);
+static void enc_write_sreg(uint8_t reg, uint8_t bank, uint8_t value);
+static void enc_write_sreg16(uint8_t reg_l, uint8_t bank, uint16_t value);
+static uint8_t enc_read_smreg(uint8_t reg, uint8_t bank);
 
 /* Macros for accessing registers.
  * These macros should be used instead of calling the functions directly.
@@ -41,30 +213,64 @@ static void enc_clear_bits(uint8_t reg, uint8_t bank, uint8_t mask);
 #define SET_REG_BITS(reg, mask) enc_set_bits(reg, reg ## _BANK, mask)
 #define CLEAR_REG_BITS(reg, mask) enc_clear_bits(reg, reg ## _BANK, mask)
 
+/* Shadowed registers. Only for registers the chip never changes
+ * by itself. 16-bit pairs are given without the L/H suffix. */
+#define WRITE_SREG(reg, value) enc_write_sreg(reg, reg ## _BANK, value)
+#define WRITE_SREG16(reg, value) \
+	enc_write_sreg16(reg ## L, reg ## L_BANK, value)
+#define READ_SMREG(reg) enc_read_smreg(reg, reg ## _BANK)
+
 
 static uint16_t enc_phy_read(uint8_t addr);
+static void enc_phy_write(uint8_t addr, uint16_t value);
 static void enc_set_rx_area(uint16_t start, uint16_t end);
 static void enc_set_mac_addr(const uint8_t *mac_addr);
-static void enc_receive_packet(void);
+static void enc_receive_packet(bool spill);
+#if ENC_SPILL_SLOTS
+static void enc_spill_frame(const uint8_t *hdr, uint16_t header_count,
+			    uint16_t data_count);
+static uint16_t enc_rx_unread(void);
+static void enc_spill_poll(void);
+static void enc_spill_replay(void);
+#endif
+static uint8_t enc_classify_packet(const uint8_t *buf, uint16_t len);
+#if UIP_CHECKSUM_OFFLOAD
+static uint16_t enc_dma_checksum(uint16_t start, uint16_t end);
+static bool enc_rx_checksum_ok(uint16_t frame, const uint8_t *buf,
+			       uint16_t data_count);
+static void enc_tx_checksum(uint16_t frame, const uint8_t *buf);
+#endif
+static void enc_handle_packet(void);
+#if ENC_USE_DMA && ENC_PKTBUF
+static void enc_rx_drain(void);
+#endif
+static void enc_free_packet(void);
+static void enc_rx_release(void);
+static struct enc_tx_slot *enc_tx_alloc(void);
+static void enc_tx_queue(struct enc_tx_slot *slot);
+static void enc_tx_start(struct enc_tx_slot *slot);
+static void enc_tx_complete(uint8_t eir);
+static void enc_tx_abort(void);
+static void enc_tx_next(void);
 
 
 void enc_reset(void) {
-	MAP_GPIOPinWrite(ENC_CS_PORT, ENC_CS, 0);
+	SELECT_ENC();
 
 	spi_send(0xFF);
 
-	MAP_GPIOPinWrite(ENC_CS_PORT, ENC_CS, ENC_CS);
+	DESELECT_ENC();
 }
 
 /**
  * Read Control Register (RCR)
  */
 uint8_t enc_rcr(uint8_t reg) {
-	MAP_GPIOPinWrite(ENC_CS_PORT, ENC_CS, 0);
+	SELECT_ENC();
 	spi_send(reg);
 	uint8_t b = spi_send(0xFF); // Dummy
 
-	MAP_GPIOPinWrite(ENC_CS_PORT, ENC_CS, ENC_CS);
+	DESELECT_ENC();
 	return b;
 }
 
@@ -72,10 +278,10 @@ uint8_t enc_rcr(uint8_t reg) {
  * Write Control Register (WCR)
  */
 void enc_wcr(uint8_t reg, uint8_t val) {
-	MAP_GPIOPinWrite(ENC_CS_PORT, ENC_CS, 0);
+	SELECT_ENC();
 	spi_send(0x40 | reg);
 	spi_send(val);
-	MAP_GPIOPinWrite(ENC_CS_PORT, ENC_CS, ENC_CS);
+	DESELECT_ENC();
 }
 
 /**
@@ -85,11 +291,11 @@ void enc_wcr(uint8_t reg, uint8_t val) {
  * of those registers.
  */
 uint8_t enc_rcr_m(uint8_t reg) {
-	MAP_GPIOPinWrite(ENC_CS_PORT, ENC_CS, 0);
+	SELECT_ENC();
 	spi_send(reg);
 	spi_send(0xFF);
 	uint8_t b = spi_send(0xFF); // Dummy
-	MAP_GPIOPinWrite(ENC_CS_PORT, ENC_CS, ENC_CS);
+	DESELECT_ENC();
 	return b;
 }
 
@@ -98,40 +304,132 @@ uint8_t enc_rcr_m(uint8_t reg) {
  * Read Buffer Memory.
  */
 void enc_rbm(uint8_t *buf, uint16_t count) {
-	MAP_GPIOPinWrite(ENC_CS_PORT, ENC_CS, 0);
-	spi_send(0x20 | 0x1A);
-	int i;
-	for (i = 0; i < count; i++) {
-		*buf = spi_send(0xFF);
-		buf++;
+#if ENC_USE_DMA
+	if (count >= ENC_DMA_MIN) {
+		enc_rbm_start(buf, count, NULL);
+		enc_dma_wait();
+		return;
 	}
-	MAP_GPIOPinWrite(ENC_CS_PORT, ENC_CS, ENC_CS);
+#endif
+	SELECT_ENC();
+	spi_send(0x20 | 0x1A);
+	spi_read_burst(buf, count);
+	DESELECT_ENC();
 }
 
 /**
  * Write Buffer Memory.
  */
 void enc_wbm(const uint8_t *buf, uint16_t count) {
-	MAP_GPIOPinWrite(ENC_CS_PORT, ENC_CS, 0);
+#if ENC_USE_DMA
+	if (count >= ENC_DMA_MIN) {
+		enc_wbm_start(buf, count, NULL);
+		enc_dma_wait();
+		return;
+	}
+#endif
+	SELECT_ENC();
 	spi_send(0x60 | 0x1A);
-	int i;
-	for (i = 0; i < count; i++) {
-		spi_send(*buf);
-		buf++;
+	spi_write_burst(buf, count);
+	DESELECT_ENC();
+}
+
+#if ENC_USE_DMA
+/**
+ * Completion of a DMA buffer memory transfer.
+ * Runs in interrupt context.
+ */
+static void enc_dma_complete(struct spi_xfer *xfer) {
+	enc_dma_active = false;
+
+	if (enc_dma_done) {
+		enc_dma_done();
 	}
-	MAP_GPIOPinWrite(ENC_CS_PORT, ENC_CS, ENC_CS);
 }
 
+/**
+ * Queue a buffer memory transfer with the bus manager.
+ * The chip stays selected until the transfer has completed.
+ */
+static void enc_bm_start(uint8_t opcode, const uint8_t *tx, uint8_t *rx,
+			 uint16_t count, enc_dma_callback_t done) {
+	enc_dma_wait();
+	enc_dma_active = true;
+	enc_dma_done = done;
+	enc_spi_stats.transactions++;
+
+	enc_xfer.dev = SPI_DEV_ENC;
+	enc_xfer.cmd[0] = opcode;
+	enc_xfer.cmd_len = 1;
+	enc_xfer.tx = tx;
+	enc_xfer.rx = rx;
+	enc_xfer.count = count;
+	enc_xfer.done = enc_dma_complete;
+	spi_submit(&enc_xfer);
+}
+
+/**
+ * Read Buffer Memory using DMA.
+ */
+void enc_rbm_start(uint8_t *buf, uint16_t count, enc_dma_callback_t done) {
+	enc_bm_start(0x20 | 0x1A, NULL, buf, count, done);
+}
+
+/**
+ * Write Buffer Memory using DMA.
+ */
+void enc_wbm_start(const uint8_t *buf, uint16_t count,
+		   enc_dma_callback_t done) {
+	enc_bm_start(0x60 | 0x1A, buf, NULL, count, done);
+}
+
+bool enc_dma_busy(void) {
+	return enc_dma_active;
+}
+
+void enc_dma_wait(void) {
+	while (enc_dma_active) {
+	}
+}
+
+void enc_read_buffer_start(uint16_t addr, uint8_t *buf, uint16_t count,
+			   enc_dma_callback_t done) {
+	enc_dma_wait();
+	WRITE_REG(ENC_ERDPTL, addr & 0xFF);
+	WRITE_REG(ENC_ERDPTH, addr >> 8);
+	enc_rbm_start(buf, count, done);
+}
+
+void enc_write_buffer_start(uint16_t addr, const uint8_t *buf, uint16_t count,
+			    enc_dma_callback_t done) {
+	enc_dma_wait();
+	WRITE_REG(ENC_EWRPTL, addr & 0xFF);
+	WRITE_REG(ENC_EWRPTH, addr >> 8);
+	enc_wbm_start(buf, count, done);
+}
+
+/**
+ * Completion of a frame receive. Runs in interrupt context.
+ */
+static void enc_rx_complete(void) {
+	enc_rx_done = true;
+}
+
+bool enc_rx_ready(void) {
+	return enc_rx_pending && enc_rx_done;
+}
+#endif
+
 /**
  * Bit Field Set.
  * Set the bits of argument 'mask' in the register 'reg'.
  * Not valid for MAC and MII registers.
  */
 void enc_bfs(uint8_t reg, uint8_t mask) {
-	MAP_GPIOPinWrite(ENC_CS_PORT, ENC_CS, 0);
+	SELECT_ENC();
 	spi_send(0x80 | reg);
 	spi_send(mask);
-	MAP_GPIOPinWrite(ENC_CS_PORT, ENC_CS, ENC_CS);
+	DESELECT_ENC();
 }
 
 /**
@@ -140,25 +438,32 @@ void enc_bfs(uint8_t reg, uint8_t mask) {
  * Not valid for MAC and MII registers.
  */
 void enc_bfc(uint8_t reg, uint8_t mask) {
-	MAP_GPIOPinWrite(ENC_CS_PORT, ENC_CS, 0);
+	SELECT_ENC();
 	spi_send(0xA0 | reg);
 	spi_send(mask);
-	MAP_GPIOPinWrite(ENC_CS_PORT, ENC_CS, ENC_CS);
+	DESELECT_ENC();
 }
 
 /**
  * Switch memory bank to 'new_bank'
+ * Only the BSEL bits that differ are touched, with bit field
+ * operations, so ECON1 doesn't have to be read first.
  */
 void enc_switch_bank(uint8_t new_bank) {
 	if (new_bank == enc_current_bank || new_bank == ANY_BANK) {
 		return;
 	}
-	uint8_t econ1 = enc_rcr(ENC_ECON1);
+	uint8_t clear = enc_current_bank & ~new_bank & ENC_ECON1_BSEL_MASK;
+	uint8_t set = new_bank & ~enc_current_bank & ENC_ECON1_BSEL_MASK;
 
-	econ1 &= ~ENC_ECON1_BSEL_MASK;
-	econ1 |= (new_bank & ENC_ECON1_BSEL_MASK) << ENC_ECON1_BSEL_SHIFT;
-	enc_wcr(ENC_ECON1, econ1);
+	if (clear) {
+		enc_bfc(ENC_ECON1, clear << ENC_ECON1_BSEL_SHIFT);
+	}
+	if (set) {
+		enc_bfs(ENC_ECON1, set << ENC_ECON1_BSEL_SHIFT);
+	}
 	enc_current_bank = new_bank;
+	enc_spi_stats.bank_switches++;
 }
 
 
@@ -217,6 +522,68 @@ void enc_write_reg(uint8_t reg, uint8_t bank, uint8_t value) {
 	enc_wcr(reg, value);
 }
 
+/**
+ * Shadowed register write. Skipped if the register already
+ * holds 'value'.
+ */
+void enc_write_sreg(uint8_t reg, uint8_t bank, uint8_t value) {
+	uint32_t bit = 1UL << reg;
+
+	if ((enc_shadow_valid[bank] & bit) && enc_shadow[bank][reg] == value) {
+		enc_spi_stats.shadow_hits++;
+		return;
+	}
+
+	enc_write_reg(reg, bank, value);
+	enc_shadow[bank][reg] = value;
+	enc_shadow_valid[bank] |= bit;
+}
+
+/**
+ * Shadowed write of a 16-bit register pair, low byte first.
+ * Some pairs only take the new value when the high byte is
+ * written, so both bytes are written unless neither changed.
+ */
+void enc_write_sreg16(uint8_t reg_l, uint8_t bank, uint16_t value) {
+	uint32_t bits = 3UL << reg_l;
+	uint8_t lo = value & 0xFF;
+	uint8_t hi = value >> 8;
+
+	if ((enc_shadow_valid[bank] & bits) == bits &&
+	    enc_shadow[bank][reg_l] == lo && enc_shadow[bank][reg_l + 1] == hi) {
+		enc_spi_stats.shadow_hits++;
+		return;
+	}
+
+	enc_write_reg(reg_l, bank, lo);
+	enc_write_reg(reg_l + 1, bank, hi);
+	enc_shadow[bank][reg_l] = lo;
+	enc_shadow[bank][reg_l + 1] = hi;
+	enc_shadow_valid[bank] |= bits;
+}
+
+/**
+ * Shadowed MAC/MII register read. Only goes to the chip
+ * if the register hasn't been written yet.
+ */
+uint8_t enc_read_smreg(uint8_t reg, uint8_t bank) {
+	uint32_t bit = 1UL << reg;
+
+	if (enc_shadow_valid[bank] & bit) {
+		enc_spi_stats.shadow_hits++;
+		return enc_shadow[bank][reg];
+	}
+
+	uint8_t value = enc_read_mreg(reg, bank);
+	enc_shadow[bank][reg] = value;
+	enc_shadow_valid[bank] |= bit;
+	return value;
+}
+
+void enc_get_spi_stats(struct enc_spi_stats *stats) {
+	*stats = enc_spi_stats;
+}
+
 /**
  * Read value from PHY address.
  * Reading procedure is described in ENC28J60 datasheet
@@ -285,14 +652,9 @@ void enc_phy_write(uint8_t addr, uint16_t value) {
  * Set the memory area to use for receiving packets.
  */
 void enc_set_rx_area(uint16_t start, uint16_t end) {
-	WRITE_REG(ENC_ERXSTL, start & 0xFF);
-	WRITE_REG(ENC_ERXSTH, (start >> 8) & 0xFFF);
-
-	WRITE_REG(ENC_ERXNDL, end & 0xFF);
-	WRITE_REG(ENC_ERXNDH, (end >> 8) & 0xFFF);
-
-	WRITE_REG(ENC_ERXRDPTL, start & 0xFF);
-	WRITE_REG(ENC_ERXRDPTH, (start >> 8) & 0xFFF);
+	WRITE_SREG16(ENC_ERXST, start);
+	WRITE_SREG16(ENC_ERXND, end);
+	WRITE_SREG16(ENC_ERXRDPT, start);
 }
 
 /**
@@ -319,16 +681,235 @@ void enc_get_mac_addr(uint8_t *mac_addr) {
   mac_addr[5] = READ_REG(ENC_MAADR6);
 }
 
+/**
+ * Accept or reject broadcast frames.
+ */
+void enc_set_broadcast(bool enable) {
+	if (enable) {
+		SET_REG_BITS(ENC_ERXFCON, ENC_ERXFCON_BCEN);
+	} else {
+		CLEAR_REG_BITS(ENC_ERXFCON, ENC_ERXFCON_BCEN);
+	}
+}
+
+/**
+ * Accept or reject all multicast frames.
+ * Individual groups can still be accepted through the hash table.
+ */
+void enc_set_multicast(bool enable) {
+	if (enable) {
+		SET_REG_BITS(ENC_ERXFCON, ENC_ERXFCON_MCEN);
+	} else {
+		CLEAR_REG_BITS(ENC_ERXFCON, ENC_ERXFCON_MCEN);
+	}
+}
+
+/**
+ * Clear the multicast hash table and disable the hash filter.
+ */
+void enc_hash_clear(void) {
+	CLEAR_REG_BITS(ENC_ERXFCON, ENC_ERXFCON_HTEN);
+
+	int i;
+	for (i = 0; i < 8; i++) {
+		enc_write_reg(ENC_EHT0 + i, ENC_EHT0_BANK, 0x00);
+	}
+}
+
+/**
+ * Accept frames to 'mac' through the hash table filter.
+ * The table has 64 entries indexed by bits 28:23 of the
+ * CRC-32 of the destination address, so other addresses
+ * may be accepted as well.
+ */
+void enc_hash_add(const uint8_t *mac) {
+	uint32_t crc = 0xFFFFFFFF;
+	int i, j;
+
+	for (i = 0; i < 6; i++) {
+		uint8_t b = mac[i];
+		for (j = 0; j < 8; j++) {
+			bool next = ((crc >> 31) ^ b) & 1;
+			crc <<= 1;
+			if (next) {
+				crc ^= 0x04C11DB7;
+			}
+			b >>= 1;
+		}
+	}
+
+	enc_set_bits(ENC_EHT0 + ((crc >> 26) & 0x7), ENC_EHT0_BANK,
+		     1 << ((crc >> 23) & 0x7));
+	SET_REG_BITS(ENC_ERXFCON, ENC_ERXFCON_HTEN);
+}
+
+/**
+ * Program the pattern match filter.
+ * 'mask' is 8 bytes, selecting which of the 64 bytes starting at
+ * 'offset' in the frame are compared. 'pattern' holds the expected
+ * value of those bytes at the same positions.
+ * The hardware compares a checksum of the selected bytes, so this
+ * is not an exact match.
+ */
+void enc_set_pattern(uint16_t offset, const uint8_t *mask,
+		     const uint8_t *pattern) {
+	uint32_t sum = 0;
+	bool high = true;
+	int i;
+
+	CLEAR_REG_BITS(ENC_ERXFCON, ENC_ERXFCON_PMEN);
+
+	/* IP checksum of the selected bytes, taken in order */
+	for (i = 0; i < 64; i++) {
+		if (mask[i / 8] & (1 << (i % 8))) {
+			sum += high ? (pattern[i] << 8) : pattern[i];
+			high = !high;
+		}
+	}
+	while (sum >> 16) {
+		sum = (sum & 0xFFFF) + (sum >> 16);
+	}
+	sum = ~sum & 0xFFFF;
+
+	for (i = 0; i < 8; i++) {
+		enc_write_reg(ENC_EPMM0 + i, ENC_EPMM0_BANK, mask[i]);
+	}
+	WRITE_REG(ENC_EPMCSL, sum & 0xFF);
+	WRITE_REG(ENC_EPMCSH, sum >> 8);
+	WRITE_REG(ENC_EPMOL, offset & 0xFF);
+	WRITE_REG(ENC_EPMOH, offset >> 8);
+
+	SET_REG_BITS(ENC_ERXFCON, ENC_ERXFCON_PMEN);
+}
+
+/**
+ * Only accept broadcasts that are ARP packets for 'ipaddr'.
+ * Unicast frames to our MAC address are still accepted.
+ */
+void enc_filter_arp(const uint8_t *ipaddr) {
+	uint8_t mask[8] = {0};
+	uint8_t pattern[64] = {0};
+	int i;
+
+	/* Broadcast destination */
+	for (i = 0; i < 6; i++) {
+		pattern[i] = 0xFF;
+		mask[i / 8] |= 1 << (i % 8);
+	}
+	/* ARP ethertype */
+	pattern[12] = UIP_ETHTYPE_ARP >> 8;
+	pattern[13] = UIP_ETHTYPE_ARP & 0xFF;
+	mask[1] |= (1 << 4) | (1 << 5);
+	/* Target protocol address */
+	for (i = 38; i < 42; i++) {
+		pattern[i] = ipaddr[i - 38];
+		mask[i / 8] |= 1 << (i % 8);
+	}
+
+	enc_set_pattern(0, mask, pattern);
+	CLEAR_REG_BITS(ENC_ERXFCON, ENC_ERXFCON_BCEN | ENC_ERXFCON_ANDOR);
+}
+
+/**
+ * Configure PHY and MAC for the current duplex mode.
+ * They must agree, and the inter-packet gaps differ between
+ * the modes (datasheet section 6.5).
+ */
+static void enc_apply_duplex(void) {
+	bool full = enc_duplex == ENC_DUPLEX_FULL ||
+		(enc_duplex == ENC_DUPLEX_AUTO && enc_strap_full);
+
+	uint16_t phcon1 = enc_phy_read(ENC_PHCON1);
+	uint16_t phcon2 = enc_phy_read(ENC_PHCON2);
+	uint8_t macon3 = READ_SMREG(ENC_MACON3);
+
+	if (full) {
+		phcon1 |= ENC_PHCON_PDPXMD;
+		macon3 |= ENC_MACON3_FULDPX;
+	} else {
+		phcon1 &= ~ENC_PHCON_PDPXMD;
+		/* Don't loop back our own transmissions */
+		phcon2 |= ENC_PHCON2_HDLDIS;
+		macon3 &= ~ENC_MACON3_FULDPX;
+	}
+
+	enc_phy_write(ENC_PHCON1, phcon1);
+	enc_phy_write(ENC_PHCON2, phcon2);
+	WRITE_SREG(ENC_MACON3, macon3);
+
+	if (full) {
+		WRITE_SREG(ENC_MACON4, 0x00);
+		WRITE_SREG(ENC_MABBIPG, 0x15);
+		WRITE_SREG(ENC_MAIPGL, 0x12);
+		WRITE_SREG(ENC_MAIPGH, 0x00);
+	} else {
+		WRITE_SREG(ENC_MACON4, ENC_MACON4_DEFER);
+		WRITE_SREG(ENC_MABBIPG, 0x12);
+		WRITE_SREG(ENC_MAIPGL, 0x12);
+		WRITE_SREG(ENC_MAIPGH, 0x0C);
+	}
+}
+
+/**
+ * Reconfigure duplex mode with the receiver and transmitter idle.
+ */
+static void enc_reconfigure_duplex(void) {
+	enc_tx_wait();
+	CLEAR_REG_BITS(ENC_ECON1, ENC_ECON1_RXEN);
+	while (READ_REG(ENC_ESTAT) & ENC_ESTAT_RXBUSY) {
+	}
+
+	enc_apply_duplex();
+
+	SET_REG_BITS(ENC_ECON1, ENC_ECON1_RXEN);
+}
+
+void enc_set_duplex(uint8_t mode) {
+	enc_duplex = mode;
+	enc_reconfigure_duplex();
+}
+
+bool enc_link_up(void) {
+	return enc_link;
+}
+
+/**
+ * Handle a PHY link change interrupt.
+ * The configuration is applied again when the link comes up.
+ */
+static void enc_link_change(void) {
+	/* Reading PHIR clears the interrupt */
+	enc_phy_read(ENC_PHIR);
+
+	enc_link = (enc_phy_read(ENC_PHSTAT2) & ENC_PHSTAT2_LSTAT) != 0;
+
+	if (enc_link) {
+		enc_reconfigure_duplex();
+	}
+	if (enc_link_callback) {
+		enc_link_callback(enc_link);
+	}
+}
+
+void enc_set_link_callback(enc_link_callback_t callback) {
+	enc_link_callback = callback;
+}
+
 /**
  * Initialize the ENC28J60 with the given MAC-address
  */
 void enc_init(const uint8_t *mac) {
-	enc_next_packet = 0x000;
+	enc_next_packet = RX_START;
+	enc_rx_burst = 0;
 
 	//MAP_GPIOPinWrite(ENC_RESET_PORT, ENC_RESET, ENC_RESET);
 
 	enc_reset();
 
+	/* The reset selects bank 0 and restores register defaults */
+	enc_current_bank = 0;
+	memset(enc_shadow_valid, 0, sizeof(enc_shadow_valid));
+
 	uint8_t reg;
 	do {
 		reg = READ_REG(ENC_ESTAT);
@@ -351,15 +932,13 @@ void enc_init(const uint8_t *mac) {
 
 	SET_REG_BITS(ENC_ECON2, ENC_ECON2_AUTOINC);
 
-	enc_set_rx_area(0x000, RX_END);
+	enc_set_rx_area(RX_START, RX_END);
 
-	uint16_t phyreg = enc_phy_read(ENC_PHSTAT2);
-	phyreg &= ~ENC_PHSTAT2_DPXSTAT;
-	enc_phy_write(ENC_PHSTAT2, phyreg);
+	enc_tx_head = 0;
+	enc_tx_count = 0;
 
-	phyreg = enc_phy_read(ENC_PHCON1);
-	phyreg &= ~ENC_PHCON_PDPXMD;
-	enc_phy_write(ENC_PHCON1, phyreg);
+	/* PDPXMD reflects the LEDB strap until it is written */
+	enc_strap_full = (enc_phy_read(ENC_PHCON1) & ENC_PHCON_PDPXMD) != 0;
 
 	/* Setup receive filter to receive
 	 * broadcast, multicast and unicast to the given MAC */
@@ -377,19 +956,24 @@ void enc_init(const uint8_t *mac) {
 	WRITE_REG(ENC_MACON1,
 		  ENC_MACON1_TXPAUS | ENC_MACON1_RXPAUS | ENC_MACON1_MARXEN);
 
-	WRITE_REG(
+	WRITE_SREG(
 		  ENC_MACON3,
 		  (0x1 << ENC_MACON3_PADCFG_SHIFT) | ENC_MACON3_TXRCEN |
-		  /*ENC_MACON3_FULDPX |*/ENC_MACON3_FRMLNEN);
+		  ENC_MACON3_FRMLNEN);
 
 	WRITE_REG(ENC_MAMXFLL, 1518 & 0xFF);
 	WRITE_REG(ENC_MAMXFLH, (1518 >> 8) & 0xFF);
 
-	WRITE_REG(ENC_MABBIPG, 0x12);
-	WRITE_REG(ENC_MAIPGL, 0x12);
-	WRITE_REG(ENC_MAIPGH, 0x0C);
+	/* Sets FULDPX and the inter-packet gaps */
+	enc_apply_duplex();
+
+	/* Interrupt on link changes */
+	enc_phy_write(ENC_PHIE, ENC_PHIE_PGEIE | ENC_PHIE_PLNKIE);
+	enc_phy_read(ENC_PHIR);
+	enc_link = (enc_phy_read(ENC_PHSTAT2) & ENC_PHSTAT2_LSTAT) != 0;
 
-	SET_REG_BITS(ENC_EIE, ENC_EIE_INTIE | ENC_EIE_PKTIE);
+	SET_REG_BITS(ENC_EIE, ENC_EIE_INTIE | ENC_EIE_PKTIE | ENC_EIE_TXIE |
+		     ENC_EIE_TXERIE | ENC_EIE_LINKIE);
 
 	CLEAR_REG_BITS(ENC_ECON1, ENC_ECON1_TXRST | ENC_ECON1_RXRST);
 	SET_REG_BITS(ENC_ECON1, ENC_ECON1_RXEN);
@@ -405,9 +989,10 @@ void enc_init(const uint8_t *mac) {
 /**
  * Receive a single packet.
  * The contents will be placed in uip_buf, and uIP is called
- * as appropriate.
+ * as appropriate. With 'spill' set, a wanted frame is moved
+ * to SRAM instead.
  */
-void enc_receive_packet(void) {
+void enc_receive_packet(bool spill) {
 	/* Receive a single packet */
 	uint8_t header[6];
 	uint8_t *status = header + 2;
@@ -416,71 +1001,1024 @@ void enc_receive_packet(void) {
 	WRITE_REG(ENC_ERDPTH, (enc_next_packet >> 8) & 0xFF);
 	enc_rbm(header, 6);
 
+#if UIP_CHECKSUM_OFFLOAD
+	/* Start of the frame itself in buffer memory */
+	uint16_t frame = RX_ADDR(enc_next_packet, 6);
+#endif
+
 	/* Update next packet pointer */
 	enc_next_packet = header[0] | (header[1] << 8);
 
 	uint16_t data_count = status[0] | (status[1] << 8);
-	if (status[2] & (1 << 7)) {
-	  uip_len = data_count;
-	  enc_rbm(uip_buf, data_count);
-
-	  if( BUF->type == htons(UIP_ETHTYPE_IP) ) {
-	    uip_arp_ipin();
-	    uip_input();
-
-	    if( uip_len > 0 ) {
-	      uip_arp_out();
-	      enc_send_packet(uip_buf, uip_len);
-	      uip_len = 0;
-	    }
-	  } else if( BUF->type == htons(UIP_ETHTYPE_ARP) ) {
-	    uip_arp_arpin();
-	    if( uip_len > 0 ) {
-	      //uip_arp_out();
-	      enc_send_packet(uip_buf, uip_len);
-	      uip_len = 0;
+	if ((status[2] & (1 << 7)) == 0) {
+	  enc_rx_stats.errors++;
+	  enc_free_packet();
+	  return;
+	}
+
+#if ENC_USE_DMA && ENC_PKTBUF
+	/* enc_action() has made sure a buffer is free */
+	uint8_t *buf = NULL;
+	if (!spill) {
+	  enc_rx_pb = pktbuf_alloc();
+	  buf = PKTBUF_DATA(enc_rx_pb);
+	}
+#elif ENC_USE_DMA
+	uint8_t *buf = enc_rx_buf;
+#else
+	uint8_t *buf = uip_buf;
+#endif
+#if ENC_SPILL_SLOTS
+	/* uip_buf may hold a frame being sent */
+	if (spill) {
+	  buf = enc_spill_hdr;
+	}
+#endif
+
+	/* Fetch the headers only, and skip the rest of the frame
+	 * if uIP would drop it anyway */
+	uint16_t header_count = data_count;
+	if (header_count > RX_HEADER_LEN) {
+	  header_count = RX_HEADER_LEN;
+	}
+	enc_rbm(buf, header_count);
+
+	uint8_t result = enc_classify_packet(buf, header_count);
+#if UIP_CHECKSUM_OFFLOAD
+	if (result == RX_ACCEPT &&
+	    !enc_rx_checksum_ok(frame, buf, data_count)) {
+	  result = RX_DROP_CHECKSUM;
+	}
+#endif
+	if (result != RX_ACCEPT) {
+	  switch (result) {
+	  case RX_DROP_ETHERTYPE:
+	    enc_rx_stats.drop_ethertype++;
+	    break;
+	  case RX_DROP_IP_DEST:
+	    enc_rx_stats.drop_ip_dest++;
+	    break;
+	  case RX_DROP_TCP_PORT:
+	    enc_rx_stats.drop_tcp_port++;
+	    break;
+	  case RX_DROP_UDP_PORT:
+	    enc_rx_stats.drop_udp_port++;
+	    break;
+	  case RX_DROP_CHECKSUM:
+	    enc_rx_stats.drop_checksum++;
+	    break;
+	  }
+	  enc_rx_stats.bytes_skipped += data_count - header_count;
+#if ENC_USE_DMA && ENC_PKTBUF
+	  if (!spill) {
+	    pktbuf_free(enc_rx_pb);
+	    enc_rx_pb = NULL;
+	  }
+#endif
+	  enc_free_packet();
+	  return;
+	}
+#if ENC_SPILL_SLOTS
+	if (spill) {
+	  enc_spill_frame(buf, header_count, data_count);
+	  enc_free_packet();
+	  return;
+	}
+#endif
+	enc_rx_stats.frames++;
+
+	/* The read pointer continues where the headers ended */
+#if ENC_USE_DMA
+	/* The frame is handed to uIP by enc_action() once the
+	 * transfer has completed */
+	enc_rx_len = data_count;
+	enc_rx_pending = true;
+	if (data_count > header_count) {
+	  enc_rx_done = false;
+	  enc_rbm_start(buf + header_count, data_count - header_count,
+			enc_rx_complete);
+	} else {
+	  enc_rx_done = true;
+	}
+#else
+	if (data_count > header_count) {
+	  enc_rbm(buf + header_count, data_count - header_count);
+	}
+	uip_len = data_count;
+	enc_handle_packet();
+	enc_free_packet();
+#endif
+}
+
+#if ENC_SPILL_SLOTS
+/**
+ * Number of bytes in the RX ring not read yet.
+ */
+uint16_t enc_rx_unread(void) {
+	uint16_t wrpt = READ_REG(ENC_ERXWRPTL) | (READ_REG(ENC_ERXWRPTH) << 8);
+
+	if (wrpt >= enc_next_packet) {
+		return wrpt - enc_next_packet;
+	}
+	return wrpt + (RX_END + 1) - enc_next_packet;
+}
+
+/**
+ * Move the frame being received to the next free SRAM slot.
+ * The 'header_count' bytes in 'hdr' have been read already, the
+ * rest is copied from the read pointer on, in chunks.
+ */
+void enc_spill_frame(const uint8_t *hdr, uint16_t header_count,
+		     uint16_t data_count) {
+	uint8_t slot = (enc_spill_head + enc_spill_count) % ENC_SPILL_SLOTS;
+	uint16_t addr = SPILL_ADDR(slot);
+	uint16_t remaining = data_count - header_count;
+	uint8_t chunk[SPI_MEM_CHUNK];
+
+	spi_mem_write(addr, hdr, header_count);
+	addr += header_count;
+	while (remaining > 0) {
+		uint16_t count = remaining;
+		if (count > sizeof(chunk)) {
+			count = sizeof(chunk);
+		}
+		enc_rbm(chunk, count);
+		spi_mem_write(addr, chunk, count);
+		addr += count;
+		remaining -= count;
+	}
+
+	enc_spill_len[slot] = data_count;
+	enc_spill_count++;
+	enc_spill_stats.spilled++;
+}
+
+/**
+ * Spill frames to SRAM while the RX ring is above the watermarks.
+ * Called from enc_action() and while waiting for the transmitter,
+ * so the ring is drained even when uIP is busy.
+ */
+void enc_spill_poll(void) {
+	bool spilled = false;
+
+#if ENC_USE_DMA
+	if (enc_rx_pending) {
+		return;
+	}
+#endif
+	if (enc_spill_count == ENC_SPILL_SLOTS ||
+	    READ_REG(ENC_EPKTCNT) == 0) {
+		return;
+	}
+	if (!enc_spilling && enc_rx_unread() < SPILL_HIGH) {
+		return;
+	}
+
+	enc_spilling = true;
+	while (enc_spill_count < ENC_SPILL_SLOTS &&
+	       READ_REG(ENC_EPKTCNT) > 0) {
+		enc_receive_packet(true);
+		spilled = true;
+		if (enc_rx_unread() < SPILL_LOW) {
+			enc_spilling = false;
+			break;
+		}
+	}
+
+	if (spilled) {
+		/* Frames left in the ring are newer than the spilled
+		 * ones, so the current burst ends here */
+		enc_rx_burst = 0;
+		enc_rx_release();
+	}
+}
+
+/**
+ * Pass all spilled frames on to uIP, oldest first.
+ */
+void enc_spill_replay(void) {
+	while (enc_spill_count > 0) {
+		uint8_t slot = enc_spill_head;
+
+		uip_len = enc_spill_len[slot];
+		spi_mem_read(SPILL_ADDR(slot), uip_buf, uip_len);
+		enc_spill_head = (slot + 1) % ENC_SPILL_SLOTS;
+		enc_spill_count--;
+
+		enc_spill_stats.replayed++;
+		enc_rx_stats.frames++;
+		enc_handle_packet();
+	}
+}
+
+void enc_get_spill_stats(struct enc_spill_stats *stats) {
+	*stats = enc_spill_stats;
+}
+#endif
+
+/**
+ * Decide from the headers of a received frame whether uIP
+ * has any use for it. Mirrors the checks done by uip_input(),
+ * but errs on the side of accepting.
+ */
+uint8_t enc_classify_packet(const uint8_t *buf, uint16_t len) {
+	const struct uip_eth_hdr *eth = (const struct uip_eth_hdr *)buf;
+
+	if (len < UIP_LLH_LEN) {
+	  return RX_DROP_ETHERTYPE;
+	}
+	if (eth->type == htons(UIP_ETHTYPE_ARP)) {
+	  return RX_ACCEPT;
+	}
+	if (eth->type != htons(UIP_ETHTYPE_IP)) {
+	  return RX_DROP_ETHERTYPE;
+	}
+
+	if (len < UIP_LLH_LEN + UIP_IPH_LEN) {
+	  return RX_ACCEPT;
+	}
+
+	const struct uip_tcpip_hdr *ip =
+	  (const struct uip_tcpip_hdr *)(buf + UIP_LLH_LEN);
+	static const uip_ipaddr_t broadcast = {0xffff, 0xffff};
+	static const uip_ipaddr_t unset = {0x0000, 0x0000};
+
+	/* Until an address is assigned (DHCP), uIP accepts everything */
+	if (!uip_ipaddr_cmp(uip_hostaddr, unset) &&
+	    !uip_ipaddr_cmp(ip->destipaddr, uip_hostaddr) &&
+	    !(ip->proto == UIP_PROTO_UDP &&
+	      uip_ipaddr_cmp(ip->destipaddr, broadcast))) {
+	  return RX_DROP_IP_DEST;
+	}
+
+	/* The transport header is only looked at when there are no IP
+	 * options and the frame is not a fragment */
+	if (ip->vhl != 0x45 || (ip->ipoffset[0] & 0x3f) != 0 ||
+	    ip->ipoffset[1] != 0) {
+	  return RX_ACCEPT;
+	}
+
+	if (ip->proto == UIP_PROTO_TCP) {
+	  if (len < UIP_LLH_LEN + UIP_IPTCPH_LEN) {
+	    return RX_ACCEPT;
+	  }
+	  if (uip_listening(ip->destport) ||
+	      uip_conn_lookup((u16_t *)ip->srcipaddr, ip->srcport,
+			      ip->destport) != 0) {
+	    return RX_ACCEPT;
+	  }
+#if UIP_TIME_WAIT_CONNS
+	  /* Retransmitted FINs are ACKed again, and a RST ends
+	   * TIME_WAIT early */
+	  if (uip_time_waiting((u16_t *)ip->srcipaddr, ip->srcport,
+			       ip->destport)) {
+	    return RX_ACCEPT;
+	  }
+#endif
+	  /* uIP answers anything else with a RST, so that connection
+	   * attempts to closed ports are refused */
+	  if (!(ip->flags & TCP_RST)) {
+	    return RX_ACCEPT;
+	  }
+	  return RX_DROP_TCP_PORT;
+	}
+
+#if UIP_UDP
+	if (ip->proto == UIP_PROTO_UDP) {
+	  if (len < UIP_LLH_LEN + UIP_IPUDPH_LEN) {
+	    return RX_ACCEPT;
+	  }
+	  const struct uip_udpip_hdr *udp = (const struct uip_udpip_hdr *)ip;
+	  int c;
+	  for (c = 0; c < UIP_UDP_CONNS; c++) {
+	    if (uip_udp_conns[c].lport != 0 &&
+		uip_udp_conns[c].lport == udp->destport) {
+	      return RX_ACCEPT;
 	    }
 	  }
+	  return RX_DROP_UDP_PORT;
 	}
+#endif
 
-	uint16_t erxst = READ_REG(ENC_ERXSTL) | (READ_REG(ENC_ERXSTH) << 8);
+	return RX_ACCEPT;
+}
 
-	/* Mark packet as read */
-	if (enc_next_packet == erxst) {
-		WRITE_REG(ENC_ERXRDPTL, READ_REG(ENC_ERXNDL));
-		WRITE_REG(ENC_ERXRDPTH, READ_REG(ENC_ERXNDH));
-	} else {
-		WRITE_REG(ENC_ERXRDPTL, (enc_next_packet-1) & 0xFF);
-		WRITE_REG(ENC_ERXRDPTH, ((enc_next_packet-1) >> 8) & 0xFF);
+#if UIP_CHECKSUM_OFFLOAD
+/**
+ * One's complement sum of 'len' bytes taken as big endian words,
+ * added to 'sum'. The result is not folded.
+ */
+static uint32_t enc_sum(uint32_t sum, const uint8_t *data, uint16_t len) {
+	while (len > 1) {
+	  sum += (data[0] << 8) | data[1];
+	  data += 2;
+	  len -= 2;
+	}
+	if (len > 0) {
+	  sum += data[0] << 8;
+	}
+	return sum;
+}
+
+static uint16_t enc_fold(uint32_t sum) {
+	while (sum >> 16) {
+	  sum = (sum & 0xFFFF) + (sum >> 16);
+	}
+	return sum;
+}
+
+/**
+ * Compute the IP checksum of buffer memory from 'start' to 'end',
+ * inclusive, with the DMA checksum engine. Ranges inside the RX
+ * ring wrap like received packets do.
+ */
+uint16_t enc_dma_checksum(uint16_t start, uint16_t end) {
+	WRITE_SREG16(ENC_EDMAST, start);
+	WRITE_SREG16(ENC_EDMAND, end);
+
+	SET_REG_BITS(ENC_ECON1, ENC_ECON1_CSUMEN);
+	SET_REG_BITS(ENC_ECON1, ENC_ECON1_DMAST);
+	while (READ_REG(ENC_ECON1) & ENC_ECON1_DMAST) {
+	}
+	CLEAR_REG_BITS(ENC_ECON1, ENC_ECON1_CSUMEN);
+
+	return (READ_REG(ENC_EDMACSH) << 8) | READ_REG(ENC_EDMACSL);
+}
+
+/**
+ * Sum of the TCP pseudo header for the IP header in 'ip'.
+ */
+static uint32_t enc_pseudo_sum(const struct uip_tcpip_hdr *ip,
+			       uint16_t tcp_len) {
+	uint32_t sum = enc_sum(0, (const uint8_t *)ip->srcipaddr,
+			       2 * sizeof(uip_ipaddr_t));
+	return sum + UIP_PROTO_TCP + tcp_len;
+}
+
+/**
+ * Verify the IP header checksum, and the TCP checksum in buffer
+ * memory, of the frame starting at 'frame'. 'buf' holds the headers.
+ * Only called for frames that passed enc_classify_packet().
+ */
+bool enc_rx_checksum_ok(uint16_t frame, const uint8_t *buf,
+			uint16_t data_count) {
+	const struct uip_eth_hdr *eth = (const struct uip_eth_hdr *)buf;
+	const struct uip_tcpip_hdr *ip =
+	  (const struct uip_tcpip_hdr *)(buf + UIP_LLH_LEN);
+
+	/* uIP drops anything but plain IPv4 headers by itself */
+	if (eth->type != htons(UIP_ETHTYPE_IP) || data_count < RX_HEADER_LEN ||
+	    ip->vhl != 0x45) {
+	  return true;
+	}
+
+	if (enc_fold(enc_sum(0, (const uint8_t *)ip, UIP_IPH_LEN)) != 0xFFFF) {
+	  return false;
+	}
+
+	if (ip->proto != UIP_PROTO_TCP) {
+	  return true;
+	}
+
+	/* The frame includes padding and the CRC, so the segment
+	 * length comes from the IP header */
+	uint16_t ip_len = (ip->len[0] << 8) | ip->len[1];
+	if (ip_len < UIP_IPTCPH_LEN || UIP_LLH_LEN + ip_len > data_count - 4) {
+	  return false;
+	}
+	uint16_t tcp_len = ip_len - UIP_IPH_LEN;
+	uint16_t tcp_start = RX_ADDR(frame, UIP_LLH_LEN + UIP_IPH_LEN);
+	uint16_t tcp_end = RX_ADDR(tcp_start, tcp_len - 1);
+
+	uint16_t segment = ~enc_dma_checksum(tcp_start, tcp_end);
+	return enc_fold(enc_pseudo_sum(ip, tcp_len) + segment) == 0xFFFF;
+}
+
+/**
+ * Fill in the IP header and TCP checksums uIP left zero in the
+ * frame written at 'frame'. 'buf' is the frame as passed to
+ * enc_send_packet().
+ */
+void enc_tx_checksum(uint16_t frame, const uint8_t *buf) {
+	const struct uip_eth_hdr *eth = (const struct uip_eth_hdr *)buf;
+	const struct uip_tcpip_hdr *ip =
+	  (const struct uip_tcpip_hdr *)(buf + UIP_LLH_LEN);
+	uint8_t sum[2];
+
+	if (eth->type != htons(UIP_ETHTYPE_IP) || ip->vhl != 0x45) {
+	  return;
+	}
+
+	if (ip->ipchksum == 0) {
+	  uint16_t c = ~enc_fold(enc_sum(0, (const uint8_t *)ip, UIP_IPH_LEN));
+	  uint16_t addr = frame + UIP_LLH_LEN + 10;
+	  sum[0] = c >> 8;
+	  sum[1] = c & 0xFF;
+	  WRITE_REG(ENC_EWRPTL, addr & 0xFF);
+	  WRITE_REG(ENC_EWRPTH, addr >> 8);
+	  enc_wbm(sum, 2);
+	}
+
+	if (ip->proto == UIP_PROTO_TCP && ip->tcpchksum == 0) {
+	  uint16_t ip_len = (ip->len[0] << 8) | ip->len[1];
+	  uint16_t tcp_len = ip_len - UIP_IPH_LEN;
+	  uint16_t tcp_start = frame + UIP_LLH_LEN + UIP_IPH_LEN;
+
+	  uint16_t segment = ~enc_dma_checksum(tcp_start, tcp_start + tcp_len - 1);
+	  uint16_t c = ~enc_fold(enc_pseudo_sum(ip, tcp_len) + segment);
+	  uint16_t addr = tcp_start + 16;
+	  sum[0] = c >> 8;
+	  sum[1] = c & 0xFF;
+	  WRITE_REG(ENC_EWRPTL, addr & 0xFF);
+	  WRITE_REG(ENC_EWRPTH, addr >> 8);
+	  enc_wbm(sum, 2);
+	}
+}
+#endif
+
+#if UIP_REXMIT_CACHE
+/**
+ * Copy buffer memory from 'start' to 'end', inclusive,
+ * to 'dest' with the DMA controller.
+ */
+static void enc_dma_copy(uint16_t start, uint16_t end, uint16_t dest) {
+	WRITE_SREG16(ENC_EDMAST, start);
+	WRITE_SREG16(ENC_EDMAND, end);
+	WRITE_SREG16(ENC_EDMADST, dest);
+
+	CLEAR_REG_BITS(ENC_ECON1, ENC_ECON1_CSUMEN);
+	SET_REG_BITS(ENC_ECON1, ENC_ECON1_DMAST);
+	while (READ_REG(ENC_ECON1) & ENC_ECON1_DMAST) {
+	}
+}
+
+/**
+ * Keep a copy of the frame just written to 'slot' if it is a TCP
+ * segment carrying data. The copy is made inside the ENC28J60, so
+ * no data is transferred over SPI.
+ */
+static void enc_rexmit_store(const struct enc_tx_slot *slot,
+			     const uint8_t *buf, uint16_t count) {
+	const struct uip_eth_hdr *eth = (const struct uip_eth_hdr *)buf;
+	const struct uip_tcpip_hdr *ip =
+	  (const struct uip_tcpip_hdr *)(buf + UIP_LLH_LEN);
+
+	if (eth->type != htons(UIP_ETHTYPE_IP) || ip->vhl != 0x45 ||
+	    ip->proto != UIP_PROTO_TCP || count < UIP_LLH_LEN + UIP_IPTCPH_LEN) {
+	  return;
+	}
+
+	uint16_t ip_len = (ip->len[0] << 8) | ip->len[1];
+	uint16_t header_len = UIP_IPH_LEN + (ip->tcpoffset >> 4) * 4;
+	if (ip_len <= header_len) {
+	  /* No data, nothing uIP would retransmit */
+	  return;
+	}
+
+	struct uip_conn *conn = uip_conn_lookup((u16_t *)ip->destipaddr,
+						ip->destport, ip->srcport);
+	if (conn == 0) {
+	  return;
+	}
+	int c = conn - uip_conns;
+
+	struct enc_rexmit_entry *e = &enc_rexmit[c];
+	uint16_t dest = REXMIT_START + c * ENC_REXMIT_SLOT_SIZE;
+
+	/* Control byte, frame and status vector must fit */
+	if (1 + count + 7 > ENC_REXMIT_SLOT_SIZE) {
+	  e->valid = false;
+	  return;
+	}
+
+	enc_dma_copy(slot->start, slot->start + count, dest);
+	memcpy(e->seqno, ip->seqno, 4);
+	e->len = ip_len - header_len;
+	e->end = dest + count;
+	e->valid = true;
+	enc_rexmit_stats.stored++;
+}
+
+/**
+ * Called by uIP when a segment needs to be retransmitted.
+ */
+int uip_rexmit_cache_resend(struct uip_conn *conn) {
+	struct enc_rexmit_entry *e = &enc_rexmit[conn - uip_conns];
+
+	if (!e->valid || e->len != conn->len ||
+	    memcmp(e->seqno, conn->snd_nxt, 4) != 0) {
+	  enc_rexmit_stats.misses++;
+	  return 0;
+	}
+
+	struct enc_tx_slot *slot = enc_tx_alloc();
+	slot->start = REXMIT_START + (conn - uip_conns) * ENC_REXMIT_SLOT_SIZE;
+	slot->end = e->end;
+	enc_tx_queue(slot);
+
+	enc_rexmit_stats.hits++;
+	return 1;
+}
+
+void enc_get_rexmit_stats(struct enc_rexmit_stats *stats) {
+	*stats = enc_rexmit_stats;
+}
+#endif
+
+void enc_get_rx_stats(struct enc_rx_stats *stats) {
+	*stats = enc_rx_stats;
+}
+
+/**
+ * Pass the frame in uip_buf on to uIP and send any reply.
+ */
+void enc_handle_packet(void) {
+	if( BUF->type == htons(UIP_ETHTYPE_IP) ) {
+#if UIP_SEND_WINDOW
+	  /* Only set again if the frame is a TCP segment for a
+	   * connection, rather than left at whatever ran last */
+	  uip_conn = NULL;
+#endif
+	  uip_arp_ipin();
+	  uip_input();
+
+	  if( uip_len > 0 ) {
+	    uip_arp_out();
+	    enc_send_packet(uip_buf, uip_len);
+	    uip_len = 0;
+	  }
+
+#if UIP_SEND_WINDOW
+	  /* Let the application fill the rest of the send window,
+	   * instead of waiting for an ACK per segment */
+	  struct uip_conn *conn = uip_conn;
+	  while( conn != NULL && uip_window_open(conn) ) {
+	    uip_poll_conn(conn);
+	    if( uip_len == 0 ) {
+	      break;
+	    }
+	    uip_arp_out();
+	    enc_send_packet(uip_buf, uip_len);
+	    uip_len = 0;
+	  }
+#endif
+	} else if( BUF->type == htons(UIP_ETHTYPE_ARP) ) {
+	  uip_arp_arpin();
+	  if( uip_len > 0 ) {
+	    //uip_arp_out();
+	    enc_send_packet(uip_buf, uip_len);
+	    uip_len = 0;
+	  }
+
+#if UIP_ARP_QUEUE
+	  /* Send the packets that were waiting for this host */
+	  for( uip_arp_dequeue(); uip_len > 0; uip_arp_dequeue() ) {
+	    enc_send_packet(uip_buf, uip_len);
+	  }
+	  uip_len = 0;
+#endif
 	}
+}
+
+/**
+ * Mark the packet just read as handled.
+ * Its ring space is released by enc_rx_release().
+ */
+void enc_free_packet(void) {
 	SET_REG_BITS(ENC_ECON2, ENC_ECON2_PKTDEC);
 }
 
+/**
+ * Release the ring space of all packets read so far.
+ * The RX area never changes after enc_init(), so its bounds
+ * are not read back from the chip.
+ */
+void enc_rx_release(void) {
+	/* ERXRDPT must be odd (errata 14) */
+	uint16_t rdpt = enc_next_packet == RX_START ? RX_END :
+		enc_next_packet - 1;
+
+	WRITE_SREG16(ENC_ERXRDPT, rdpt);
+}
+
+#if ENC_USE_DMA && ENC_PKTBUF
+/**
+ * Pass the received frames on to uIP, oldest first. Each frame
+ * becomes uip_buf in turn, so it is not copied, and the buffer uIP
+ * was using goes back to the pool.
+ */
+void enc_rx_drain(void) {
+	struct pktbuf *b;
+
+	while ((b = pktbuf_dequeue(&enc_rx_queue)) != NULL) {
+		pktbuf_free(pktbuf_swap(b));
+		uip_len = b->len;
+		enc_handle_packet();
+	}
+}
+#endif
+
 /**
  * Handle events from the ENC28J60.
  */
 void enc_action(void) {
+#if ENC_USE_DMA
+	if (enc_rx_pending) {
+		if (!enc_rx_done) {
+			/* Called again once the transfer completes */
+			return;
+		}
+		enc_rx_pending = false;
+#if ENC_PKTBUF
+		enc_rx_pb->len = enc_rx_len;
+		pktbuf_enqueue(&enc_rx_queue, enc_rx_pb);
+		enc_rx_pb = NULL;
+#else
+		memcpy(uip_buf, enc_rx_buf, enc_rx_len);
+		uip_len = enc_rx_len;
+		enc_handle_packet();
+#endif
+		enc_free_packet();
+		if (enc_rx_burst == 0) {
+			/* That was the last frame of the burst */
+			enc_rx_release();
+		}
+	}
+#endif
+
+	/* Keep the interrupt pin deasserted while handling events.
+	 * Re-enabling it below produces a new falling edge if
+	 * anything is still pending. */
+	CLEAR_REG_BITS(ENC_EIE, ENC_EIE_INTIE);
+
 	uint8_t reg = READ_REG(ENC_EIR);
 
-	if (reg & ENC_EIR_PKTIF) {
-		while (READ_REG(ENC_EPKTCNT) > 0) {
-		  enc_receive_packet();
+	if (reg & ENC_EIR_LINKIF) {
+		enc_link_change();
+	}
+
+	if (enc_tx_count > 0 && (reg & (ENC_EIR_TXIF | ENC_EIR_TXERIF))) {
+		enc_tx_complete(reg);
+	}
+
+#if ENC_SPILL_SLOTS
+	if (reg & ENC_EIR_RXERIF) {
+		CLEAR_REG_BITS(ENC_EIR, ENC_EIR_RXERIF);
+		enc_spill_stats.dropped++;
+	}
+
+	/* Spilled frames are older than any in the ring */
+	enc_spill_poll();
+#if ENC_USE_DMA && ENC_PKTBUF
+	/* but newer than those received already */
+	if (enc_spill_count > 0) {
+		enc_rx_drain();
+	}
+#endif
+	enc_spill_replay();
+#endif
+
+	/* A burst interrupted by a DMA transfer is continued even
+	 * if PKTIF has been cleared by the last PKTDEC */
+	if (enc_rx_burst == 0 && (reg & ENC_EIR_PKTIF)) {
+		enc_rx_burst = READ_REG(ENC_EPKTCNT);
+		if (enc_rx_burst > ENC_RX_BURST) {
+			enc_rx_burst = ENC_RX_BURST;
+		}
+	}
+
+	if (enc_rx_burst > 0) {
+		while (enc_rx_burst > 0) {
+#if ENC_USE_DMA && ENC_PKTBUF
+		  if (!pktbuf_available()) {
+			  /* The rest of the burst stays in the ring
+			   * until uIP has handled some frames */
+			  break;
+		  }
+#endif
+		  enc_rx_burst--;
+		  enc_receive_packet(false);
+#if ENC_USE_DMA
+		  if (enc_rx_pending) {
+#if ENC_PKTBUF
+			  /* Handle the frames received so far while
+			   * this one is being transferred */
+			  enc_rx_drain();
+#endif
+			  /* INTIE is restored once the frame is handled */
+			  return;
+		  }
+#endif
 		}
+		/* PKTIF stays set if more frames are waiting,
+		 * so re-enabling INTIE below starts another burst */
+		enc_rx_release();
 	}
 
+#if ENC_USE_DMA && ENC_PKTBUF
+	enc_rx_drain();
+#endif
+
+#if ENC_SPILL_SLOTS
+	/* Frames spilled while uIP was sending */
+	enc_spill_replay();
+#endif
+
+	SET_REG_BITS(ENC_EIE, ENC_EIE_INTIE);
+}
+
+/**
+ * Start transmitting the frame in 'slot'.
+ */
+void enc_tx_start(struct enc_tx_slot *slot) {
+  WRITE_SREG16(ENC_ETXST, slot->start);
+  WRITE_SREG16(ENC_ETXND, slot->end);
+
+  /* Eratta 12 */
+  SET_REG_BITS(ENC_ECON1, ENC_ECON1_TXRST);
+  CLEAR_REG_BITS(ENC_ECON1, ENC_ECON1_TXRST);
+
+  CLEAR_REG_BITS(ENC_EIR, ENC_EIR_TXIF | ENC_EIR_TXERIF);
+  SET_REG_BITS(ENC_ECON1, ENC_ECON1_TXRTS);
+}
+
+/**
+ * Finish the frame being transmitted: collect its transmit
+ * status vector, update the counters and report the result.
+ * The next queued frame, if any, is started.
+ */
+void enc_tx_complete(uint8_t eir) {
+  struct enc_tx_slot *slot = &enc_tx_slots[enc_tx_head];
+  uint16_t addr = slot->end + 1;
+  WRITE_REG(ENC_ERDPTL, addr & 0xFF);
+  WRITE_REG(ENC_ERDPTH, addr >> 8);
+  enc_rbm(slot->status, 7);
+
+  if (eir & ENC_EIR_TXERIF) {
+    /* Reset the transmit logic after an abort */
+    SET_REG_BITS(ENC_ECON1, ENC_ECON1_TXRST);
+    CLEAR_REG_BITS(ENC_ECON1, ENC_ECON1_TXRST);
+  }
+  CLEAR_REG_BITS(ENC_EIR, ENC_EIR_TXIF | ENC_EIR_TXERIF);
+
+  enc_tx_ok = (slot->status[2] & 0x80) && !(eir & ENC_EIR_TXERIF);
+
+  enc_tx_stats.collisions += slot->status[2] & 0x0F;
+  if (slot->status[3] & (1 << 5)) {
+    enc_tx_stats.late_collisions++;
+  }
+  if (enc_tx_ok) {
+    enc_tx_stats.frames++;
+    enc_tx_stats.bytes += slot->status[0] | (slot->status[1] << 8);
+  } else {
+    enc_tx_stats.errors++;
+  }
+
+  enc_tx_next();
+}
+
+/**
+ * Drop the frame being transmitted, which has not completed in
+ * time, by resetting the transmit logic. No status vector is
+ * written for it.
+ */
+static void enc_tx_abort(void) {
+  SET_REG_BITS(ENC_ECON1, ENC_ECON1_TXRST);
+  CLEAR_REG_BITS(ENC_ECON1, ENC_ECON1_TXRST | ENC_ECON1_TXRTS);
+  CLEAR_REG_BITS(ENC_EIR, ENC_EIR_TXIF | ENC_EIR_TXERIF);
+
+  enc_tx_ok = false;
+  enc_tx_stats.errors++;
+  enc_tx_stats.timeouts++;
+
+  enc_tx_next();
+}
+
+/**
+ * Release the slot of the frame just finished, start the next one
+ * and report the result.
+ */
+static void enc_tx_next(void) {
+  enc_tx_head = (enc_tx_head + 1) % ENC_TX_SLOTS;
+  enc_tx_count--;
+
+  /* Chain the next frame straight away */
+  if (enc_tx_count > 0) {
+    enc_tx_start(&enc_tx_slots[enc_tx_head]);
+  }
+
+#if ENC_PKTBUF
+  /* The slot is taken by the oldest frame waiting for one */
+  struct pktbuf *b = pktbuf_dequeue(&enc_tx_pbs);
+  if (b != NULL) {
+    enc_send_packet(PKTBUF_DATA(b), b->len);
+    pktbuf_free(b);
+  }
+#endif
+
+  if (enc_tx_callback) {
+    enc_tx_callback(enc_tx_ok);
+  }
+}
+
+/**
+ * Poll for completion of the frame being transmitted.
+ */
+static void enc_tx_poll(void) {
+  uint8_t eir = READ_REG(ENC_EIR);
+  if (eir & (ENC_EIR_TXIF | ENC_EIR_TXERIF)) {
+    enc_tx_complete(eir);
+  }
+}
+
+/**
+ * Wait for all queued frames to be transmitted, giving each
+ * ENC_TX_WAIT_POLLS polls.
+ */
+bool enc_tx_wait(void) {
+  uint8_t head = enc_tx_head;
+  uint32_t polls = 0;
+
+#if ENC_USE_DMA
+  enc_dma_wait();
+#endif
+  while (enc_tx_count > 0) {
+    enc_tx_poll();
+#if ENC_SPILL_SLOTS
+    enc_spill_poll();
+#endif
+    if (enc_tx_head != head) {
+      head = enc_tx_head;
+      polls = 0;
+    } else if (++polls == ENC_TX_WAIT_POLLS) {
+      enc_tx_abort();
+      head = enc_tx_head;
+      polls = 0;
+    }
+  }
+  return enc_tx_ok;
+}
+
+void enc_set_tx_callback(enc_tx_callback_t callback) {
+  enc_tx_callback = callback;
+}
+
+void enc_get_tx_stats(struct enc_tx_stats *stats) {
+  *stats = enc_tx_stats;
 }
 
 /**
- * Send an ethernet packet. Function will block until
- * transmission has completed.
- * TODO: Return if the transmission was successful or not
+ * Write patterns to the buffer pointers and buffer memory, and
+ * read them back. Returns the number of mismatches.
+ * Used to verify the SPI clock rate, so it must not be called
+ * with frames queued for transmission.
  */
-void enc_send_packet(const uint8_t *buf, uint16_t count) {
-  WRITE_REG(ENC_ETXSTL, TX_START & 0xFF);
-  WRITE_REG(ENC_ETXSTH, TX_START >> 8);
+uint16_t enc_spi_test(void) {
+  static const uint16_t ptrs[] = { 0x0AAA, 0x1555, 0x1FFF, 0x0000 };
+  uint8_t out[64], in[64];
+  uint16_t errors = 0;
+  uint16_t i, p;
+
+  for (i = 0; i < sizeof(ptrs) / sizeof(ptrs[0]); i++) {
+    WRITE_REG(ENC_EWRPTL, ptrs[i] & 0xFF);
+    WRITE_REG(ENC_EWRPTH, ptrs[i] >> 8);
+    WRITE_REG(ENC_ERDPTL, ~ptrs[i] & 0xFF);
+    WRITE_REG(ENC_ERDPTH, (~ptrs[i] >> 8) & 0x1F);
+
+    p = READ_REG(ENC_EWRPTL) | (READ_REG(ENC_EWRPTH) << 8);
+    if (p != ptrs[i]) {
+      errors++;
+    }
+    p = READ_REG(ENC_ERDPTL) | (READ_REG(ENC_ERDPTH) << 8);
+    if (p != (~ptrs[i] & 0x1FFF)) {
+      errors++;
+    }
+  }
+
+  /* MAC registers are read with an extra dummy byte */
+  if (READ_MREG(ENC_MAMXFLL) != (1518 & 0xFF)) {
+    errors++;
+  }
 
+  for (i = 0; i < sizeof(out); i++) {
+    out[i] = (i & 1) ? 0x55 ^ i : 0xAA ^ (i * 7);
+  }
   WRITE_REG(ENC_EWRPTL, TX_START & 0xFF);
   WRITE_REG(ENC_EWRPTH, TX_START >> 8);
+  enc_wbm(out, sizeof(out));
+  WRITE_REG(ENC_ERDPTL, TX_START & 0xFF);
+  WRITE_REG(ENC_ERDPTH, TX_START >> 8);
+  enc_rbm(in, sizeof(in));
+  for (i = 0; i < sizeof(out); i++) {
+    if (in[i] != out[i]) {
+      errors++;
+    }
+  }
+
+  return errors;
+}
+
+/**
+ * Print all counters on the console, with the SPI cost per frame
+ * moved in either direction.
+ */
+void enc_print_stats(void) {
+  uint32_t frames = enc_rx_stats.frames + enc_rx_stats.errors +
+    enc_rx_stats.drop_ethertype + enc_rx_stats.drop_ip_dest +
+    enc_rx_stats.drop_tcp_port + enc_rx_stats.drop_udp_port +
+    enc_rx_stats.drop_checksum + enc_tx_stats.frames + enc_tx_stats.errors;
+
+  printf("RX: %d frames, %d errors, %d dropped, %d bytes skipped\n",
+	 enc_rx_stats.frames, enc_rx_stats.errors,
+	 enc_rx_stats.drop_ethertype + enc_rx_stats.drop_ip_dest +
+	 enc_rx_stats.drop_tcp_port + enc_rx_stats.drop_udp_port +
+	 enc_rx_stats.drop_checksum, enc_rx_stats.bytes_skipped);
+  printf("TX: %d frames, %d bytes, %d errors, %d collisions, "
+	 "%d timeouts\n",
+	 enc_tx_stats.frames, enc_tx_stats.bytes, enc_tx_stats.errors,
+	 enc_tx_stats.collisions, enc_tx_stats.timeouts);
+#if ENC_PKTBUF
+  printf("TX queue: %d frames\n", enc_tx_stats.queued);
+#endif
+#if ENC_SPILL_SLOTS
+  printf("Spill: %d spilled, %d replayed, %d overflows\n",
+	 enc_spill_stats.spilled, enc_spill_stats.replayed,
+	 enc_spill_stats.dropped);
+#endif
+#if UIP_REXMIT_CACHE
+  printf("Rexmit: %d stored, %d hits, %d misses\n",
+	 enc_rexmit_stats.stored, enc_rexmit_stats.hits,
+	 enc_rexmit_stats.misses);
+#endif
+  printf("SPI: %d transactions, %d bank switches, %d shadow hits",
+	 enc_spi_stats.transactions, enc_spi_stats.bank_switches,
+	 enc_spi_stats.shadow_hits);
+  if (frames > 0) {
+    printf(", %d per frame", enc_spi_stats.transactions / frames);
+  }
+  printf("\n");
+}
+
+/**
+ * Wait until a TX slot is free and return it.
+ */
+struct enc_tx_slot *enc_tx_alloc(void) {
+#if ENC_USE_DMA
+  /* A receive may still be in flight */
+  enc_dma_wait();
+#endif
+  while (enc_tx_count == ENC_TX_SLOTS) {
+    enc_tx_poll();
+#if ENC_SPILL_SLOTS
+    enc_spill_poll();
+#endif
+  }
+
+  return &enc_tx_slots[(enc_tx_head + enc_tx_count) % ENC_TX_SLOTS];
+}
+
+/**
+ * Queue the frame described by 'slot'. It is only started if
+ * nothing is being transmitted, otherwise enc_tx_complete()
+ * chains it.
+ */
+void enc_tx_queue(struct enc_tx_slot *slot) {
+  enc_tx_count++;
+  if (enc_tx_count == 1) {
+    enc_tx_start(slot);
+  }
+}
+
+/**
+ * Queue an ethernet packet for transmission.
+ * The frame is written to the next free slot while earlier
+ * frames are still being transmitted. Only if all slots are
+ * in use does this wait for the oldest one to complete.
+ */
+bool enc_send_packet(const uint8_t *buf, uint16_t count) {
+  if (count > TX_MAX_FRAME) {
+    return false;
+  }
+
+#if ENC_PKTBUF
+  /* Rather than wait for a slot, keep the frame in its buffer and
+   * give uIP another one. Without a spare buffer, frames queued
+   * earlier go first while waiting below. */
+  if (enc_tx_count == ENC_TX_SLOTS && buf == uip_buf &&
+      pktbuf_available()) {
+    struct pktbuf *b = pktbuf_swap(pktbuf_alloc());
+    b->len = count;
+    pktbuf_enqueue(&enc_tx_pbs, b);
+    enc_tx_stats.queued++;
+    return true;
+  }
+#endif
+
+  struct enc_tx_slot *slot = enc_tx_alloc();
+  slot->start = TX_START + (slot - enc_tx_slots) * TX_SLOT_SIZE;
+
+  WRITE_REG(ENC_EWRPTL, slot->start & 0xFF);
+  WRITE_REG(ENC_EWRPTH, slot->start >> 8);
 
 #if 0
   printf("dest: %X:%X:%X:%X:%X:%X\n", BUF->dest.addr[0], BUF->dest.addr[1],
@@ -498,35 +2036,15 @@ void enc_send_packet(const uint8_t *buf, uint16_t count) {
 
   enc_wbm(buf, count);
 
-  uint16_t tx_end = TX_START + count;
-  WRITE_REG(ENC_ETXNDL, tx_end & 0xFF);
-  WRITE_REG(ENC_ETXNDH, tx_end >> 8);
-
-  /* Eratta 12 */
-  SET_REG_BITS(ENC_ECON1, ENC_ECON1_TXRST);
-  CLEAR_REG_BITS(ENC_ECON1, ENC_ECON1_TXRST);
-
-  CLEAR_REG_BITS(ENC_EIR, ENC_EIR_TXIF);
-  SET_REG_BITS(ENC_ECON1, ENC_ECON1_TXRTS);
-
-  /* Busy wait for the transmission to complete */
-  while (true) {
-    uint8_t r = READ_REG(ENC_ECON1);
-    if ((r & ENC_ECON1_TXRTS) == 0)
-      break;
-  }
-
-  /* Read status bits */
-  uint8_t status[7];
-  tx_end++;
-  WRITE_REG(ENC_ERDPTL, tx_end & 0xFF);
-  WRITE_REG(ENC_ERDPTH, tx_end >> 8);
-  enc_rbm(status, 7);
+#if UIP_CHECKSUM_OFFLOAD
+  enc_tx_checksum(slot->start + 1, buf);
+#endif
+#if UIP_REXMIT_CACHE
+  enc_rexmit_store(slot, buf, count);
+#endif
 
-  uint16_t transmit_count = status[0] | (status[1] << 8);
+  slot->end = slot->start + count;
+  enc_tx_queue(slot);
 
-  if (status[2] & 0x80) {
-    /* Transmit OK*/
-    //    printf("Transmit OK\n");
-  }
+  return true;
 }
@@ -18,10 +18,134 @@
 #define ENC_INT			GPIO_PIN_4
 //#define ENC_RESET		GPIO_PIN_2
 
+/* Move buffer memory payloads with the uDMA controller.
+ * Set to 0 to use the polled SPI path instead. */
+#ifndef ENC_USE_DMA
+#define ENC_USE_DMA		1
+#endif
+
+/* Transfers shorter than this are always done polled */
+#define ENC_DMA_MIN		32
+
+/* Number of frames that can be queued for transmission.
+ * Each slot takes 1.5 KB of buffer memory from the RX ring. */
+#ifndef ENC_TX_SLOTS
+#define ENC_TX_SLOTS		2
+#endif
+
+/* Maximum number of frames received per call to enc_action().
+ * Their ring space is released together at the end of the burst. */
+#ifndef ENC_RX_BURST
+#define ENC_RX_BURST		8
+#endif
+
+/* Number of frames that can be moved to the SPI SRAM when the
+ * RX ring is filling up faster than frames are handled.
+ * Each slot takes 1.5 KB of SRAM. 0 disables spilling. */
+#ifndef ENC_SPILL_SLOTS
+#define ENC_SPILL_SLOTS		8
+#endif
+
+/* Receive frames straight into the buffers of pktbuf.c and queue
+ * them for uIP, which can then handle one frame while the next is
+ * being transferred. Frames sent while all TX slots are in use are
+ * queued in those buffers too. Requires UIP_CONF_EXTERNAL_BUFFER. */
+#ifndef ENC_PKTBUF
+#ifdef UIP_CONF_EXTERNAL_BUFFER
+#define ENC_PKTBUF		1
+#else
+#define ENC_PKTBUF		0
+#endif
+#endif
+
+/* Duplex modes. The ENC28J60 cannot negotiate, so AUTO uses the
+ * mode strapped by the polarity of LEDB at reset. The link partner
+ * must be configured to match. A partner that autonegotiates falls
+ * back to half duplex by parallel detection, which is why that is
+ * the default. */
+#define ENC_DUPLEX_HALF		0
+#define ENC_DUPLEX_FULL		1
+#define ENC_DUPLEX_AUTO		2
+
+#ifndef ENC_DUPLEX
+#define ENC_DUPLEX		ENC_DUPLEX_HALF
+#endif
+
+/* Polls of the transmit status enc_tx_wait() makes for one frame
+ * before it resets the transmitter and drops the frame. Each poll
+ * takes at least two SPI bytes, so at 8 MHz this is over 0.5 s, more
+ * than 16 attempts with the longest half duplex backoffs. */
+#ifndef ENC_TX_WAIT_POLLS
+#define ENC_TX_WAIT_POLLS	0x40000
+#endif
+
+/* Size of the per-connection retransmission slots used with
+ * UIP_REXMIT_CACHE: control byte, a frame carrying UIP_TCP_MSS bytes
+ * and the status vector. Longer segments are regenerated by the
+ * application instead. */
+#ifndef ENC_REXMIT_SLOT_SIZE
+#define ENC_REXMIT_SLOT_SIZE	(1 + UIP_LLH_LEN + UIP_TCPIP_HLEN + \
+				 UIP_TCP_MSS + 7)
+#endif
+
+/* The least the TX and retransmission slots may leave of buffer
+ * memory for the RX ring: two frames of the maximum length, each
+ * with its receive header. */
+#ifndef ENC_RX_MIN
+#define ENC_RX_MIN		(2 * (6 + 1518))
+#endif
+
 
 /**** API ****/
 void enc_init(const uint8_t *mac);
 
+/**
+ * Change the duplex mode. PHY, MAC and inter-packet gaps are
+ * reconfigured together, and again whenever the link comes up.
+ */
+void enc_set_duplex(uint8_t mode);
+
+/**
+ * Returns true if the link is up.
+ */
+bool enc_link_up(void);
+
+/**
+ * Called from enc_action() when the link goes up or down, after
+ * the duplex mode has been applied again.
+ */
+typedef void (*enc_link_callback_t)(bool up);
+void enc_set_link_callback(enc_link_callback_t callback);
+
+/**** Receive filters ****/
+
+/**
+ * Accept or reject broadcast and multicast frames.
+ * Both are accepted after enc_init().
+ */
+void enc_set_broadcast(bool enable);
+void enc_set_multicast(bool enable);
+
+/**
+ * Multicast hash table. Frames whose destination hashes to
+ * an entry set with enc_hash_add() are accepted.
+ */
+void enc_hash_clear(void);
+void enc_hash_add(const uint8_t *mac);
+
+/**
+ * Accept frames where the bytes selected by the 64-bit 'mask',
+ * starting at 'offset' in the frame, match 'pattern'.
+ */
+void enc_set_pattern(uint16_t offset, const uint8_t *mask,
+		     const uint8_t *pattern);
+
+/**
+ * Replace broadcast acceptance by a pattern match on ARP
+ * packets for 'ipaddr' (network byte order).
+ */
+void enc_filter_arp(const uint8_t *ipaddr);
+
 /**
  * Function which does all the heavy work
  * It should be called when the ENC28J60 has signaled an interrupt
@@ -29,10 +153,145 @@ void enc_init(const uint8_t *mac);
 void enc_action(void);
 
 /**
- * Send an ethernet packet. Function will block until
- * transmission has completed.
- * TODO: Return if the transmission was successful or not
+ * Queue an ethernet packet for transmission. The frame is copied
+ * to the ENC28J60 and the function returns without waiting for it
+ * to go out on the wire.
+ * Returns false if the frame could not be queued.
+ */
+bool enc_send_packet(const uint8_t *buf, uint16_t count);
+
+/**
+ * Called with the result of each transmission, once the
+ * ENC28J60 has signaled TXIF or TXERIF.
+ */
+typedef void (*enc_tx_callback_t)(bool ok);
+void enc_set_tx_callback(enc_tx_callback_t callback);
+
+/**
+ * Wait for all queued frames to be transmitted. A frame still going
+ * out after ENC_TX_WAIT_POLLS polls is dropped by resetting the
+ * transmitter, and reported as failed.
+ * Returns true if the last transmission was successful.
+ */
+bool enc_tx_wait(void);
+
+/**
+ * Transmit counters, collected from the status vector of each frame.
+ */
+struct enc_tx_stats {
+  uint32_t frames;
+  uint32_t bytes;
+  uint32_t errors;
+  uint32_t collisions;
+  uint32_t late_collisions;
+  uint32_t timeouts;		/* Frames dropped by enc_tx_wait() */
+  uint32_t queued;		/* Frames that waited for a TX slot in a
+				 * pktbuf instead of in enc_send_packet() */
+};
+
+void enc_get_tx_stats(struct enc_tx_stats *stats);
+
+/**
+ * Receive counters. Frames uIP has no use for are dropped once
+ * their headers have been read, without transferring the payload.
+ */
+struct enc_rx_stats {
+  uint32_t frames;		/* Frames passed on to uIP */
+  uint32_t errors;		/* Frames received with bad status */
+  uint32_t drop_ethertype;	/* Neither IP nor ARP */
+  uint32_t drop_ip_dest;	/* IP to another host */
+  uint32_t drop_tcp_port;	/* TCP RST to a port without listener/connection */
+  uint32_t drop_udp_port;	/* UDP to a port without connection */
+  uint32_t drop_checksum;	/* Bad IP or TCP checksum */
+  uint32_t bytes_skipped;	/* Payload bytes not transferred */
+};
+
+void enc_get_rx_stats(struct enc_rx_stats *stats);
+
+#if ENC_SPILL_SLOTS
+/**
+ * RX spill counters.
+ */
+struct enc_spill_stats {
+  uint32_t spilled;		/* Frames moved to SRAM */
+  uint32_t replayed;		/* Frames passed on to uIP from SRAM */
+  uint32_t dropped;		/* RX ring overflows, each losing frames */
+};
+
+void enc_get_spill_stats(struct enc_spill_stats *stats);
+#endif
+
+/**
+ * SPI counters. Take a copy before and after an operation
+ * to see what it cost.
+ */
+struct enc_spi_stats {
+  uint32_t transactions;	/* Chip select assertions */
+  uint32_t bank_switches;	/* Changes of ECON1.BSEL */
+  uint32_t shadow_hits;		/* Register accesses served by the shadow */
+};
+
+void enc_get_spi_stats(struct enc_spi_stats *stats);
+
+/**
+ * Check SPI communication with read-back patterns.
+ * Returns the number of mismatches.
+ */
+uint16_t enc_spi_test(void);
+
+/**
+ * Print all of the above counters on the console.
+ */
+void enc_print_stats(void);
+
+#if UIP_REXMIT_CACHE
+/**
+ * Retransmission cache counters.
+ */
+struct enc_rexmit_stats {
+  uint32_t stored;		/* Segments copied to the cache */
+  uint32_t hits;		/* Retransmitted from the cache */
+  uint32_t misses;		/* Left to the application */
+};
+
+void enc_get_rexmit_stats(struct enc_rexmit_stats *stats);
+#endif
+
+#if ENC_USE_DMA
+/**
+ * Called from interrupt context when a DMA transfer has completed.
+ */
+typedef void (*enc_dma_callback_t)(void);
+
+/**
+ * Start reading 'count' bytes of buffer memory at 'addr' into 'buf'.
+ * Returns as soon as the transfer has been started.
+ */
+void enc_read_buffer_start(uint16_t addr, uint8_t *buf, uint16_t count,
+			   enc_dma_callback_t done);
+
+/**
+ * Start writing 'count' bytes from 'buf' to buffer memory at 'addr'.
+ * Returns as soon as the transfer has been started.
+ */
+void enc_write_buffer_start(uint16_t addr, const uint8_t *buf, uint16_t count,
+			    enc_dma_callback_t done);
+
+/**
+ * Returns true while a DMA transfer to or from the ENC28J60 is in flight.
+ */
+bool enc_dma_busy(void);
+
+/**
+ * Wait for the current DMA transfer, if any, to complete.
+ */
+void enc_dma_wait(void);
+
+/**
+ * Returns true when a received frame has been transferred and
+ * enc_action() should be called to pass it on to uIP.
  */
-void enc_send_packet(const uint8_t *buf, uint16_t count);
+bool enc_rx_ready(void);
+#endif
 
 #endif /* ENC28J60_H_ */
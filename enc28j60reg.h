@@ -36,6 +36,35 @@
 #define ENC_ERXWRPTL_BANK	0
 #define ENC_ERXWRPTH		0x0F
 #define ENC_ERXWRPTH_BANK	0
+#define ENC_EDMASTL			0x10
+#define ENC_EDMASTL_BANK	0
+#define ENC_EDMASTH			0x11
+#define ENC_EDMASTH_BANK	0
+#define ENC_EDMANDL			0x12
+#define ENC_EDMANDL_BANK	0
+#define ENC_EDMANDH			0x13
+#define ENC_EDMANDH_BANK	0
+#define ENC_EDMADSTL		0x14
+#define ENC_EDMADSTL_BANK	0
+#define ENC_EDMADSTH		0x15
+#define ENC_EDMADSTH_BANK	0
+#define ENC_EDMACSL			0x16
+#define ENC_EDMACSL_BANK	0
+#define ENC_EDMACSH			0x17
+#define ENC_EDMACSH_BANK	0
+
+#define ENC_EHT0			0x00
+#define ENC_EHT0_BANK		1
+#define ENC_EPMM0			0x08
+#define ENC_EPMM0_BANK		1
+#define ENC_EPMCSL			0x10
+#define ENC_EPMCSL_BANK		1
+#define ENC_EPMCSH			0x11
+#define ENC_EPMCSH_BANK		1
+#define ENC_EPMOL			0x14
+#define ENC_EPMOL_BANK		1
+#define ENC_EPMOH			0x15
+#define ENC_EPMOH_BANK		1
 
 #define ENC_ERXFCON			0x18
 #define ENC_ERXFCON_BANK	1
@@ -162,7 +191,14 @@
 #define ENC_PHSTAT1	0x01
 #define ENC_PHSTAT2 0x11
 #define		ENC_PHSTAT2_DPXSTAT (1<<9)
+#define		ENC_PHSTAT2_LSTAT	(1<<10)
 #define ENC_PHCON1	0x00
 #define		ENC_PHCON_PDPXMD	(1<<8)
+#define ENC_PHCON2	0x10
+#define		ENC_PHCON2_HDLDIS	(1<<8)
+#define ENC_PHIE	0x12
+#define		ENC_PHIE_PGEIE		(1<<1)
+#define		ENC_PHIE_PLNKIE		(1<<4)
+#define ENC_PHIR	0x13
 
 #endif
@@ -0,0 +1,62 @@
+#include "event.h"
+
+static struct event event_queue[EVENT_QUEUE_SIZE];
+static volatile uint8_t event_head, event_tail;
+static volatile bool event_overflow;
+
+/* The volatile indices alone do not keep the compiler from moving the
+ * accesses to a slot past them. No barrier instruction is needed, as
+ * both sides run on the same core. */
+#if defined(__GNUC__)
+#define EVENT_BARRIER()		__asm__ volatile("" ::: "memory")
+#else
+#define EVENT_BARRIER()
+#endif
+
+void
+event_push(uint8_t type, uint8_t pins, unsigned long arg) {
+  uint8_t head = event_head;
+  uint8_t next = (head + 1) & (EVENT_QUEUE_SIZE - 1);
+
+  if( next == event_tail ) {
+    event_overflow = true;
+    return;
+  }
+
+  event_queue[head].type = type;
+  event_queue[head].pins = pins;
+  event_queue[head].arg = arg;
+  /* Publish the slot only after it has been filled */
+  EVENT_BARRIER();
+  event_head = next;
+}
+
+bool
+event_pop(struct event *ev) {
+  uint8_t tail = event_tail;
+
+  if( tail == event_head ) {
+    return false;
+  }
+
+  EVENT_BARRIER();
+  *ev = event_queue[tail];
+  /* Hand the slot back only after it has been read */
+  EVENT_BARRIER();
+  event_tail = (tail + 1) & (EVENT_QUEUE_SIZE - 1);
+  return true;
+}
+
+bool
+event_pending(void) {
+  return event_head != event_tail || event_overflow;
+}
+
+bool
+event_overflowed(void) {
+  if( !event_overflow ) {
+    return false;
+  }
+  event_overflow = false;
+  return true;
+}
@@ -0,0 +1,41 @@
+#ifndef _EVENT_H
+#define _EVENT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * Events are passed from the interrupt handlers to the main loop
+ * through a ring. All interrupts run at the same priority and so never
+ * preempt each other, which makes interrupt context the single
+ * producer and the main loop the single consumer: the producer only
+ * writes event_head and the consumer only writes event_tail.
+ */
+#define EVENT_TICK		0	/* SysTick, arg is the tick count */
+#define EVENT_ENC		1	/* ENC28J60 INT edge, arg is the time */
+
+#define EVENT_QUEUE_SIZE	16	/* Must be a power of two */
+
+struct event {
+  uint8_t	type;
+  uint8_t	pins;
+  unsigned long	arg;
+};
+
+/**
+ * Queue an event for the main loop. Only called from interrupt
+ * context. If the ring is full the event is lost, and
+ * event_overflowed() reports it.
+ */
+void event_push(uint8_t type, uint8_t pins, unsigned long arg);
+
+/* Take the oldest event off the queue. Returns false if it is empty. */
+bool event_pop(struct event *ev);
+
+/* Whether there is anything for event_pop() or event_overflowed() */
+bool event_pending(void);
+
+/* Whether events have been lost since the last call */
+bool event_overflowed(void);
+
+#endif
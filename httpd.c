@@ -223,21 +223,39 @@ void httpd_appcall(void) {
   config_done:
     send_new_data = true;
   } else if( uip_acked() ) {
+#if UIP_SEND_WINDOW
+    /* Polls for window space don't count as activity */
+    hs->idle_count = 0;
+#else
     hs->data_count++;
+#endif
     if( hs->done ) {
+      /* With a send window uIP holds the FIN until all data is acked */
       uip_close();
     } else {
       send_new_data = true;
     }
   } else if( uip_poll() ) {
     printf("Poll\n");
+#if UIP_SEND_WINDOW
+    /* uIP also polls when the send window has room */
+    if( !hs->done ) {
+      send_new_data = true;
+    }
+#endif
     hs->idle_count++;
     if( hs->idle_count > 10 ) {
       uip_close();
     }
   }
 
+#if UIP_SEND_WINDOW
+  /* data_count counts segments queued rather than segments acked;
+   * retransmissions are served by uIP from the SRAM copies */
+  if( send_new_data && uip_cansend() ) {
+#else
   if( uip_rexmit() || send_new_data ) {
+#endif
     printf("%p: Request type: %d\n", hs, hs->request_type);
     printf("%p: Sending data (%d)\n", hs, hs->data_count);
     switch(hs->request_type) {
@@ -369,6 +387,9 @@ void httpd_appcall(void) {
     if (hs->xmit_buf != NULL ) {
       uip_send(hs->xmit_buf, hs->xmit_buf_size);
     }
+#if UIP_SEND_WINDOW
+    hs->data_count++;
+#endif
   }
 }
 
@@ -1,28 +1,66 @@
 #include <inc/hw_ints.h>
+#include <inc/hw_nvic.h>
 #include <stdint.h>
+#include <stddef.h>
 #include "common.h"
 #include "enc28j60.h"
+#include "event.h"
+#include "pktbuf.h"
 #include "spi.h"
 #include <driverlib/systick.h>
 #include <driverlib/interrupt.h>
 #include <uip/uip.h>
 #include <uip/uip_arp.h>
 
-static volatile unsigned long g_ulFlags;
-
 volatile unsigned long g_ulTickCounter = 0;
 
 #define UIP_PERIODIC_TIMER_MS   500
 #define UIP_ARP_TIMER_MS	10000
 
-#define FLAG_SYSTICK		0
-#define FLAG_RXPKT		1
-#define FLAG_TXPKT		2
-#define FLAG_RXPKTPEND		3
-#define FLAG_ENC_INT		4
+/* Print the driver counters this often. 0 disables. */
+#ifndef ENC_STATS_TIMER_MS
+#define ENC_STATS_TIMER_MS	0
+#endif
 
 #define SYSTICKHZ		CLOCK_CONF_SECOND
 #define SYSTICKMS		(1000 / SYSTICKHZ)
+#define MS_TO_TICKS(ms)		((ms) / SYSTICKMS)
+
+#if !UIP_TCP_CLOCK
+#error "The main loop schedules uip_periodic() by uip_tcp_deadline()"
+#endif
+
+/* Wrap-safe comparison of clock_time() values */
+#define TIMER_DUE(t, now)	((long)((now) - (t)) >= 0)
+
+/* A received frame has been transferred and is waiting for
+ * enc_action(). Its DMA completion pushes no event. */
+#if ENC_USE_DMA
+#define ENC_RX_READY()		enc_rx_ready()
+#else
+#define ENC_RX_READY()		false
+#endif
+
+/*
+ * SysTick does not interrupt on every tick, only when the next timer
+ * is due. A SysTick period can be at most 2^24 clocks, so without
+ * anything due it still interrupts that often. g_ulTickCounter is
+ * kept exact by carrying the clocks of each period in ulTickFrac.
+ */
+static unsigned long ulTickClocks;	/* Processor clocks per tick */
+static unsigned long ulTickMax;		/* Longest period in ticks */
+static unsigned long ulTickFrac;	/* Clocks into the current tick */
+static unsigned long ulPeriodLoaded;	/* Clocks in the running period */
+static unsigned long ulPeriodNext;	/* Clocks in the period after */
+
+/* Set while a UDP connection needs periodic processing */
+static bool udp_poll = true;
+
+static void systick_init(void);
+static void systick_wake_in(unsigned long ulTicks);
+static void timer_next(clock_time_t *next, clock_time_t t, clock_time_t now);
+static void timer_rearm(clock_time_t *timer, clock_time_t period,
+			clock_time_t now);
 
 void uip_log(char *msg) {
   printf("UIP: %s\n", msg);
@@ -34,7 +72,7 @@ cpu_init(void) {
   int i;
   for(i=0; i<1000000; i++);
 
-  // Setup for 16MHZ external crystal, use 200MHz PLL and divide by 4 = 50MHz
+  // Setup for 16MHZ external crystal, use 200MHz PLL and divide by 16 = 12.5MHz
   MAP_SysCtlClockSet(SYSCTL_SYSDIV_16 | SYSCTL_USE_PLL | SYSCTL_OSC_MAIN |
       SYSCTL_XTAL_16MHZ);
 }
@@ -52,23 +90,9 @@ uart_init(void) {
   UARTStdioInitExpClk(0, 115200);
 }
 
-static void
-spi_init(void) {
-  MAP_SysCtlPeripheralEnable(SYSCTL_PERIPH_GPIOB);
-
-  // Configure SSI1 for SPI RAM usage
-  MAP_SysCtlPeripheralEnable(SYSCTL_PERIPH_SSI2);
-  MAP_GPIOPinConfigure(GPIO_PB4_SSI2CLK);
-  MAP_GPIOPinConfigure(GPIO_PB6_SSI2RX);
-  MAP_GPIOPinConfigure(GPIO_PB7_SSI2TX);
-  MAP_GPIOPinTypeSSI(GPIO_PORTB_BASE, GPIO_PIN_4 | GPIO_PIN_6 | GPIO_PIN_7);
-  MAP_SSIConfigSetExpClk(SSI2_BASE, MAP_SysCtlClockGet(), SSI_FRF_MOTO_MODE_0,
-			 SSI_MODE_MASTER, 1000000, 8);
-  MAP_SSIEnable(SSI2_BASE);
-
-  unsigned long b;
-  while(MAP_SSIDataGetNonBlocking(SSI2_BASE, &b)) {}
-}
+/* Bring-up test of the SPI SRAM */
+#define SPI_TEST_LEN		64
+#define SPI_TEST_MEM_ADDR	0x0000
 
 static void
 enc28j60_comm_init(void) {
@@ -85,18 +109,21 @@ enc28j60_comm_init(void) {
   MAP_GPIOPinWrite(GPIO_PORTA_BASE, SRAM_CS, SRAM_CS);
 }
 
-#define SELECT_MEM() MAP_GPIOPinWrite(GPIO_PORTA_BASE, SRAM_CS, 0)
-#define DESELECT_MEM() MAP_GPIOPinWrite(GPIO_PORTA_BASE, SRAM_CS, SRAM_CS)
+#define SELECT_MEM() do { \
+  spi_lock(SPI_DEV_MEM); \
+  MAP_GPIOPinWrite(GPIO_PORTA_BASE, SRAM_CS, 0); \
+} while(0)
+#define DESELECT_MEM() do { \
+  MAP_GPIOPinWrite(GPIO_PORTA_BASE, SRAM_CS, SRAM_CS); \
+  spi_unlock(SPI_DEV_MEM); \
+} while(0)
 
 void spi_mem_write(uint16_t addr, const uint8_t *buf, uint16_t count) {
   SELECT_MEM();
   spi_send(0x02);
   spi_send(addr >> 8);
   spi_send(addr & 0xFF);
-  for(;count>0;count--) {
-    spi_send(*buf);
-    buf++;
-  }
+  spi_write_burst(buf, count);
   DESELECT_MEM();
 }
 
@@ -105,15 +132,153 @@ void spi_mem_read(uint16_t addr, uint8_t *buf, uint16_t count) {
   spi_send(0x03);
   spi_send(addr >> 8);
   spi_send(addr & 0xFF);
-  for(;count>0;count--) {
-    *buf = spi_send(0xFF);
-    buf++;
-  }
+  spi_read_burst(buf, count);
   DESELECT_MEM();
 }
 
 
 
+/**
+ * Queue the next chunk of an SRAM operation.
+ */
+static void
+spi_mem_chunk(struct spi_mem_op *op) {
+  uint16_t count = op->remaining;
+  if(count > SPI_MEM_CHUNK) {
+    count = SPI_MEM_CHUNK;
+  }
+
+  op->xfer.cmd[1] = op->addr >> 8;
+  op->xfer.cmd[2] = op->addr & 0xFF;
+  op->xfer.count = count;
+  op->addr += count;
+  op->remaining -= count;
+  spi_submit(&op->xfer);
+}
+
+/**
+ * Completion of a chunk of an SRAM operation.
+ */
+static void
+spi_mem_chunk_done(struct spi_xfer *xfer) {
+  struct spi_mem_op *op = (struct spi_mem_op *)xfer;
+
+  if(xfer->tx) {
+    xfer->tx += xfer->count;
+  }
+  if(xfer->rx) {
+    xfer->rx += xfer->count;
+  }
+
+  if(op->remaining > 0) {
+    spi_mem_chunk(op);
+  } else if(op->done) {
+    op->done(op);
+  }
+}
+
+static void
+spi_mem_start(struct spi_mem_op *op, uint8_t opcode, uint16_t addr,
+	      const uint8_t *tx, uint8_t *rx, uint16_t count,
+	      spi_mem_callback_t done) {
+  op->xfer.dev = SPI_DEV_MEM;
+  op->xfer.cmd[0] = opcode;
+  op->xfer.cmd_len = 3;
+  op->xfer.tx = tx;
+  op->xfer.rx = rx;
+  op->xfer.done = spi_mem_chunk_done;
+  op->addr = addr;
+  op->remaining = count;
+  op->done = done;
+  spi_mem_chunk(op);
+}
+
+void spi_mem_write_start(struct spi_mem_op *op, uint16_t addr,
+			 const uint8_t *buf, uint16_t count,
+			 spi_mem_callback_t done) {
+  spi_mem_start(op, 0x02, addr, buf, NULL, count, done);
+}
+
+void spi_mem_read_start(struct spi_mem_op *op, uint16_t addr,
+			uint8_t *buf, uint16_t count,
+			spi_mem_callback_t done) {
+  spi_mem_start(op, 0x03, addr, NULL, buf, count, done);
+}
+
+#if UIP_SEND_WINDOW
+/* Each connection has UIP_SEND_WINDOW slots of UIP_TCP_MSS bytes */
+#define WINDOW_ADDR(conn, slot) (SPI_MEM_WINDOW_BASE + \
+  (((conn) - uip_conns) * UIP_SEND_WINDOW + (slot)) * UIP_TCP_MSS)
+
+#if SPI_MEM_WINDOW_BASE + UIP_CONNS * UIP_SEND_WINDOW * UIP_TCP_MSS > SPI_MEM_ARP_BASE
+#error "UIP_CONF_SEND_WINDOW does not fit the SPI SRAM"
+#endif
+
+void uip_window_write(struct uip_conn *conn, u8_t slot,
+		      const void *data, u16_t len) {
+  spi_mem_write(WINDOW_ADDR(conn, slot), data, len);
+}
+
+void uip_window_read(struct uip_conn *conn, u8_t slot, u16_t offset,
+		     void *data, u16_t len) {
+  spi_mem_read(WINDOW_ADDR(conn, slot) + offset, data, len);
+}
+#endif
+
+#if UIP_ARP_QUEUE
+/* Each packet waiting for ARP has a slot of a full frame less the
+ * Ethernet header */
+#define ARP_QUEUE_ADDR(slot) (SPI_MEM_ARP_BASE + \
+  (slot) * (UIP_BUFSIZE - UIP_LLH_LEN))
+
+#if SPI_MEM_ARP_BASE + UIP_ARP_QUEUE * (UIP_BUFSIZE - UIP_LLH_LEN) > SPI_MEM_SIZE
+#error "UIP_CONF_ARP_QUEUE does not fit the SPI SRAM"
+#endif
+
+void uip_arp_queue_write(u8_t slot, const void *data, u16_t len) {
+  spi_mem_write(ARP_QUEUE_ADDR(slot), data, len);
+}
+
+void uip_arp_queue_read(u8_t slot, void *data, u16_t len) {
+  spi_mem_read(ARP_QUEUE_ADDR(slot), data, len);
+}
+#endif
+
+/**
+ * Write a pattern to the SPI SRAM and read it back.
+ * Returns the number of mismatched bytes.
+ */
+static uint16_t
+spi_mem_test(void) {
+  uint8_t out[SPI_TEST_LEN], in[SPI_TEST_LEN];
+  uint16_t errors = 0;
+  int i;
+
+  for(i = 0; i < SPI_TEST_LEN; i++) {
+    out[i] = (i & 1) ? 0x55 ^ i : 0xAA ^ (i * 7);
+  }
+  spi_mem_write(SPI_TEST_MEM_ADDR, out, SPI_TEST_LEN);
+  spi_mem_read(SPI_TEST_MEM_ADDR, in, SPI_TEST_LEN);
+  for(i = 0; i < SPI_TEST_LEN; i++) {
+    if(in[i] != out[i]) {
+      errors++;
+    }
+  }
+  return errors;
+}
+
+static void
+tx_done(bool ok) {
+  if(!ok) {
+    printf("Transmit failed\n");
+  }
+}
+
+static void
+link_changed(bool up) {
+  printf("Link %s\n", up ? "up" : "down");
+}
+
 const uint8_t mac_addr[] = { 0x00, 0xC0, 0x033, 0x50, 0x48, 0x12 };
 
 int main(void) {
@@ -125,18 +290,30 @@ int main(void) {
   uart_init();
   printf("Welcome\n");
   spi_init();
+  spi_dma_init();
   enc28j60_comm_init();
 
   printf("Welcome\n");
 
+#ifdef UIP_CONF_EXTERNAL_BUFFER
+  pktbuf_init();
+#endif
   enc_init(mac_addr);
+  enc_set_tx_callback(tx_done);
+  enc_set_link_callback(link_changed);
+
+  uint16_t errors;
+  uint32_t rate = spi_bringup(SPI_DEV_ENC, enc_spi_test, &errors);
+  printf("SPI: ENC28J60 at %d Hz, %d errors\n", rate, errors);
+  if(errors > 0) {
+    /* Writes at the failed rate may have hit the wrong registers and
+     * left the driver's bank and shadow registers out of step */
+    enc_init(mac_addr);
+  }
+  rate = spi_bringup(SPI_DEV_MEM, spi_mem_test, &errors);
+  printf("SPI: SRAM at %d Hz, %d errors\n", rate, errors);
 
-  //
-  // Configure SysTick for a periodic interrupt.
-  //
-  MAP_SysTickPeriodSet(MAP_SysCtlClockGet() / SYSTICKHZ);
-  MAP_SysTickEnable();
-  MAP_SysTickIntEnable();
+  systick_init();
 
   //MAP_IntEnable(INT_GPIOA);
   MAP_IntEnable(INT_GPIOE);
@@ -182,6 +359,7 @@ int main(void) {
   uip_ipaddr(ipaddr, DEFAULT_NETMASK0, DEFAULT_NETMASK1, DEFAULT_NETMASK2,
 	     DEFAULT_NETMASK3);
   uip_setnetmask(ipaddr);
+  udp_poll = false;
 #else
   uip_ipaddr(ipaddr, 0, 0, 0, 0);
   uip_sethostaddr(ipaddr);
@@ -197,36 +375,21 @@ int main(void) {
   dhcpc_request();
 #endif
 
-  long lPeriodicTimer, lARPTimer;
-  lPeriodicTimer = lARPTimer = 0;
+  clock_time_t ulUdpTimer, ulARPTimer, ulStatsTimer;
+  ulUdpTimer = ulARPTimer = ulStatsTimer = clock_time();
 
-  int i; // = MAP_GPIOPinRead(GPIO_PORTA_BASE, ENC_INT) & ENC_INT;
   while(true) {
-    //MAP_IntDisable(INT_UART0);
-    MAP_SysCtlSleep();
-    //MAP_IntEnable(INT_UART0);
-
-    //i = MAP_GPIOPinRead(GPIO_PORTA_BASE, ENC_INT) & ENC_INT;
-    /*while(i != 0 && g_ulFlags == 0) {
-      i = MAP_GPIOPinRead(GPIO_PORTA_BASE, ENC_INT) & ENC_INT;
-      }*/
-
-    if( HWREGBITW(&g_ulFlags, FLAG_ENC_INT) == 1 ) {
-      HWREGBITW(&g_ulFlags, FLAG_ENC_INT) = 0;
-      enc_action();
-    }
-
-    if(HWREGBITW(&g_ulFlags, FLAG_SYSTICK) == 1) {
-      HWREGBITW(&g_ulFlags, FLAG_SYSTICK) = 0;
-      lPeriodicTimer += SYSTICKMS;
-      lARPTimer += SYSTICKMS;
-      //printf("%d %d\n", lPeriodicTimer, lARPTimer);
-    }
-
-    if( lPeriodicTimer > UIP_PERIODIC_TIMER_MS ) {
-      lPeriodicTimer = 0;
-      int l;
-      for(l = 0; l < UIP_CONNS; l++) {
+    clock_time_t now = clock_time();
+    clock_time_t next = now + ulTickMax;
+    clock_time_t t;
+
+    /* Only connections whose timers have expired are processed */
+    int l;
+    for(l = 0; l < UIP_CONNS; l++) {
+      if( !uip_tcp_deadline(&uip_conns[l], &t) ) {
+	continue;
+      }
+      if( TIMER_DUE(t, now) ) {
 	uip_periodic(l);
 
 	//
@@ -239,65 +402,213 @@ int main(void) {
 	  enc_send_packet(uip_buf, uip_len);
 	  uip_len = 0;
 	}
+	if( !uip_tcp_deadline(&uip_conns[l], &t) ) {
+	  continue;
+	}
       }
+      timer_next(&next, t, now);
+    }
 
-      for(l = 0; l < UIP_UDP_CONNS; l++) {
-	uip_udp_periodic(l);
-	if( uip_len > 0) {
-	  uip_arp_out();
-	  enc_send_packet(uip_buf, uip_len);
-	  uip_len = 0;
+    /* Only DHCP uses UDP, and it needs no polling once it is done */
+    if( udp_poll ) {
+      if( TIMER_DUE(ulUdpTimer, now) ) {
+	timer_rearm(&ulUdpTimer, MS_TO_TICKS(UIP_PERIODIC_TIMER_MS), now);
+	for(l = 0; l < UIP_UDP_CONNS; l++) {
+	  uip_udp_periodic(l);
+	  if( uip_len > 0) {
+	    uip_arp_out();
+	    enc_send_packet(uip_buf, uip_len);
+	    uip_len = 0;
+	  }
 	}
       }
+      timer_next(&next, ulUdpTimer, now);
     }
 
-    if( lARPTimer > UIP_ARP_TIMER_MS) {
-      lARPTimer = 0;
+    if( TIMER_DUE(ulARPTimer, now) ) {
+      timer_rearm(&ulARPTimer, MS_TO_TICKS(UIP_ARP_TIMER_MS), now);
       uip_arp_timer();
     }
+    timer_next(&next, ulARPTimer, now);
+
+#if ENC_STATS_TIMER_MS
+    if( TIMER_DUE(ulStatsTimer, now) ) {
+      timer_rearm(&ulStatsTimer, MS_TO_TICKS(ENC_STATS_TIMER_MS), now);
+      enc_print_stats();
+    }
+    timer_next(&next, ulStatsTimer, now);
+#endif
+
+    /* Interrupts are masked so that an event pushed, or a transfer
+     * completed, between the check and the sleep still wakes us up */
+    MAP_IntMasterDisable();
+    if( !event_pending() && !ENC_RX_READY() ) {
+      systick_wake_in(next - now);
+      MAP_SysCtlSleep();
+    }
+    MAP_IntMasterEnable();
+
+    /* Drain everything queued since the last pass, then act once.
+     * Ticks only wake us up; the timers above go by clock_time() */
+    struct event ev;
+    bool enc_pending = false;
+    while( event_pop(&ev) ) {
+      if( ev.type == EVENT_ENC ) {
+	enc_pending = true;
+      }
+    }
+
+    /* A full ring may have swallowed an ENC28J60 edge; the INT line
+     * stays low until serviced, so no further edge would follow */
+    if( event_overflowed() ) {
+      enc_pending = true;
+    }
 
+    if( enc_pending || ENC_RX_READY() ) {
+      enc_action();
+    }
   }
 
   return 0;
 }
 
-uint8_t spi_send(uint8_t c) {
-  unsigned long val;
-  MAP_SSIDataPut(SSI2_BASE, c);
-  MAP_SSIDataGet(SSI2_BASE, &val);
-  return (uint8_t)val;
-}
-
-
 void
 dhcpc_configured(const struct dhcpc_state *s)
 {
     uip_sethostaddr(&s->ipaddr);
     uip_setnetmask(&s->netmask);
     uip_setdraddr(&s->default_router);
+
+    /* DHCP is done, so the only broadcasts of interest are ARP
+     * requests for our address */
+    enc_filter_arp((const uint8_t *)s->ipaddr);
+    udp_poll = false;
+    enc_set_multicast(false);
     printf("IP: %d.%d.%d.%d\n", s->ipaddr[0] & 0xff, s->ipaddr[0] >> 8,
 	   s->ipaddr[1] & 0xff, s->ipaddr[1] >> 8);
 }
 
+/**
+ * Account for clocks that have passed since g_ulTickCounter was last
+ * brought up to date. Interrupts must be masked.
+ */
+static void
+systick_advance(unsigned long ulClocks) {
+  ulTickFrac += ulClocks;
+  g_ulTickCounter += ulTickFrac / ulTickClocks;
+  ulTickFrac %= ulTickClocks;
+}
+
+/**
+ * Clocks that have passed in the running SysTick period. Interrupts
+ * must be masked.
+ */
+static unsigned long
+systick_elapsed(void) {
+  unsigned long ulCurrent = HWREG(NVIC_ST_CURRENT);
+
+  if( HWREG(NVIC_INT_CTRL) & NVIC_INT_CTRL_PENDSTSET ) {
+    /* The counter wrapped, but the interrupt has not run yet */
+    ulCurrent = HWREG(NVIC_ST_CURRENT);
+    return ulPeriodLoaded + ulPeriodNext - ulCurrent;
+  }
+  return ulPeriodLoaded - ulCurrent;
+}
+
+void
+systick_init(void) {
+  ulTickClocks = MAP_SysCtlClockGet() / SYSTICKHZ;
+  ulTickMax = 0x1000000 / ulTickClocks;
+  ulPeriodLoaded = ulPeriodNext = ulTickMax * ulTickClocks;
+
+  MAP_SysTickPeriodSet(ulPeriodNext);
+  HWREG(NVIC_ST_CURRENT) = 0;
+  MAP_SysTickEnable();
+  MAP_SysTickIntEnable();
+}
+
+/**
+ * Have SysTick interrupt in ulTicks ticks. Called with interrupts
+ * masked, just before going to sleep.
+ */
+void
+systick_wake_in(unsigned long ulTicks) {
+  if( HWREG(NVIC_INT_CTRL) & NVIC_INT_CTRL_PENDSTSET ) {
+    /* We'll be woken up right away anyway */
+    return;
+  }
+
+  if( ulTicks == 0 ) {
+    ulTicks = 1;
+  } else if( ulTicks > ulTickMax ) {
+    ulTicks = ulTickMax;
+  }
+
+  /* Restart the counter, ending the new period on a tick boundary */
+  systick_advance(systick_elapsed());
+  ulPeriodLoaded = ulPeriodNext = ulTicks * ulTickClocks - ulTickFrac;
+  if( ulPeriodNext < 2 ) {
+    /* A reload value of 0 would never interrupt */
+    ulPeriodLoaded = ulPeriodNext += ulTickClocks;
+  }
+  MAP_SysTickPeriodSet(ulPeriodNext);
+  HWREG(NVIC_ST_CURRENT) = 0;
+}
+
+/**
+ * Pull *next in to t if that is sooner, but not before the next tick.
+ */
+void
+timer_next(clock_time_t *next, clock_time_t t, clock_time_t now) {
+  if( TIMER_DUE(t, now) ) {
+    t = now + 1;
+  }
+  if( TIMER_DUE(t, *next) == 0 ) {
+    *next = t;
+  }
+}
+
+/**
+ * Move a periodic timer on by one period. If it has fallen more than
+ * a period behind, it restarts from now.
+ */
+void
+timer_rearm(clock_time_t *timer, clock_time_t period, clock_time_t now) {
+  *timer += period;
+  if( TIMER_DUE(*timer, now) ) {
+    *timer = now + period;
+  }
+}
+
 void
 SysTickIntHandler(void)
 {
     //
-    // Increment the system tick count.
+    // Account for the period that has just ended. The counter has
+    // already reloaded for the next one, so any change only applies
+    // to the period after that.
     //
-    g_ulTickCounter++;
+    systick_advance(ulPeriodLoaded);
+    ulPeriodLoaded = ulPeriodNext;
+    ulPeriodNext = ulTickMax * ulTickClocks;
+    MAP_SysTickPeriodSet(ulPeriodNext);
 
     //
     // Indicate that a SysTick interrupt has occurred.
     //
-    HWREGBITW(&g_ulFlags, FLAG_SYSTICK) = 1;
-    //g_ulFlags |= FLAG_SYSTICK;
+    event_push(EVENT_TICK, 0, g_ulTickCounter);
 }
 
 clock_time_t
 clock_time(void)
 {
-    return((clock_time_t)g_ulTickCounter);
+    bool masked = MAP_IntMasterDisable();
+    unsigned long ulTicks = g_ulTickCounter +
+      (ulTickFrac + systick_elapsed()) / ulTickClocks;
+    if( !masked ) {
+      MAP_IntMasterEnable();
+    }
+    return((clock_time_t)ulTicks);
 }
 
 void GPIOPortEIntHandler(void) {
@@ -305,5 +616,7 @@ void GPIOPortEIntHandler(void) {
 
   MAP_GPIOPinIntClear(GPIO_PORTE_BASE, p);
 
-  HWREGBITW(&g_ulFlags, FLAG_ENC_INT) = 1;
+  if( p & ENC_INT ) {
+    event_push(EVENT_ENC, p, g_ulTickCounter);
+  }
 }
@@ -0,0 +1,83 @@
+#include "pktbuf.h"
+
+#include <stddef.h>
+
+#ifdef UIP_CONF_EXTERNAL_BUFFER
+
+static struct pktbuf pktbuf_pool[PKTBUF_COUNT];
+static struct pktbuf *pktbuf_free_list;
+
+/* The buffer uip_buf points into */
+static struct pktbuf *pktbuf_current;
+
+u8_t *uip_buf;
+
+void
+pktbuf_init(void) {
+  uint8_t i;
+
+  pktbuf_free_list = NULL;
+  for(i = 1; i < PKTBUF_COUNT; i++) {
+    pktbuf_free(&pktbuf_pool[i]);
+  }
+  pktbuf_current = &pktbuf_pool[0];
+  uip_buf = PKTBUF_DATA(pktbuf_current);
+}
+
+struct pktbuf *
+pktbuf_alloc(void) {
+  struct pktbuf *b = pktbuf_free_list;
+
+  if(b != NULL) {
+    pktbuf_free_list = b->next;
+    b->next = NULL;
+  }
+  return b;
+}
+
+void
+pktbuf_free(struct pktbuf *b) {
+  b->next = pktbuf_free_list;
+  pktbuf_free_list = b;
+}
+
+bool
+pktbuf_available(void) {
+  return pktbuf_free_list != NULL;
+}
+
+void
+pktbuf_enqueue(struct pktbuf_queue *q, struct pktbuf *b) {
+  b->next = NULL;
+  if(q->tail != NULL) {
+    q->tail->next = b;
+  } else {
+    q->head = b;
+  }
+  q->tail = b;
+}
+
+struct pktbuf *
+pktbuf_dequeue(struct pktbuf_queue *q) {
+  struct pktbuf *b = q->head;
+
+  if(b != NULL) {
+    q->head = b->next;
+    if(q->head == NULL) {
+      q->tail = NULL;
+    }
+    b->next = NULL;
+  }
+  return b;
+}
+
+struct pktbuf *
+pktbuf_swap(struct pktbuf *b) {
+  struct pktbuf *old = pktbuf_current;
+
+  pktbuf_current = b;
+  uip_buf = PKTBUF_DATA(b);
+  return old;
+}
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef _PKTBUF_H
+#define _PKTBUF_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <uip/uip.h>
+
+/**
+ * Fixed size frame buffers shared by uIP and the ENC28J60 driver,
+ * used with UIP_CONF_EXTERNAL_BUFFER. uip_buf points into one of
+ * them at a time. The others are free, or hold received frames
+ * waiting for uIP and frames waiting for a TX slot.
+ * All operations take constant time. Not to be used from interrupt
+ * context.
+ */
+#ifndef PKTBUF_COUNT
+#define PKTBUF_COUNT	4
+#endif
+
+#if UIP_BUFALIGN
+#define PKTBUF_PAD	UIP_BUFALIGN_PAD
+#else
+#define PKTBUF_PAD	0
+#endif
+
+struct pktbuf {
+  struct pktbuf *next;
+  uint16_t len;
+  /* Word aligned, with the frame PKTBUF_PAD bytes in */
+  uint32_t words[(PKTBUF_PAD + UIP_BUFSIZE + 2 + 3) / 4];
+};
+
+#define PKTBUF_DATA(b)	((uint8_t *)(b)->words + PKTBUF_PAD)
+
+/* First in, first out */
+struct pktbuf_queue {
+  struct pktbuf *head;
+  struct pktbuf *tail;
+};
+
+/**
+ * Put all buffers on the free list but one, which becomes uip_buf.
+ * Must be called before uIP is used.
+ */
+void pktbuf_init(void);
+
+/* NULL if all buffers are in use */
+struct pktbuf *pktbuf_alloc(void);
+void pktbuf_free(struct pktbuf *b);
+bool pktbuf_available(void);
+
+void pktbuf_enqueue(struct pktbuf_queue *q, struct pktbuf *b);
+/* NULL if the queue is empty */
+struct pktbuf *pktbuf_dequeue(struct pktbuf_queue *q);
+
+/**
+ * Make 'b' the buffer uIP works in, and return the one it was
+ * working in. uip_len is left alone.
+ */
+struct pktbuf *pktbuf_swap(struct pktbuf *b);
+
+#endif
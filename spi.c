@@ -0,0 +1,433 @@
+#include <inc/hw_ints.h>
+#include <inc/hw_ssi.h>
+#include "common.h"
+#include "enc28j60.h"
+#include "spi.h"
+#include <driverlib/interrupt.h>
+#include <driverlib/udma.h>
+
+/*
+ * SSI2 and the devices on it: set-up, bus arbitration, polled
+ * transfers and the queued ones, which use uDMA if ENC_USE_DMA is
+ * set.
+ */
+
+/* Devices on SSI2 and their queues of pending transfers */
+struct spi_device {
+  unsigned long cs_port;
+  uint8_t cs_pin;
+  uint32_t rate;
+  struct spi_xfer *head;
+  struct spi_xfer *tail;
+};
+
+static struct spi_device spi_devices[SPI_DEVICES] = {
+  { ENC_CS_PORT, ENC_CS, SPI_MIN_RATE },
+  { GPIO_PORTA_BASE, SRAM_CS, SPI_MIN_RATE },
+};
+
+/* Set while the bus is locked or a queued transfer is in flight */
+static volatile bool spi_busy;
+static struct spi_xfer *spi_active;
+
+/* Rate SSI2 is set up for */
+static uint32_t spi_current_rate;
+static uint32_t spi_sysclk;
+
+/* Bring-up tests are repeated this many times per rate */
+#define SPI_TEST_PASSES		4
+
+/* SSIConfigSetExpClk() divides the system clock by 2 * n, rounding n
+ * down, so SSI2 runs at the first of these rates not slower than the
+ * one asked for */
+#define SPI_DIVIDER(rate)	(spi_sysclk / (rate) / 2)
+#define SPI_RATE(n)		(spi_sysclk / (2 * (n)))
+
+static void
+spi_configure(uint32_t rate) {
+  while(MAP_SSIBusy(SSI2_BASE)) {}
+  MAP_SSIDisable(SSI2_BASE);
+  MAP_SSIConfigSetExpClk(SSI2_BASE, spi_sysclk, SSI_FRF_MOTO_MODE_0,
+			 SSI_MODE_MASTER, rate, 8);
+  MAP_SSIEnable(SSI2_BASE);
+  spi_current_rate = rate;
+}
+
+/**
+ * Switch SSI2 to the clock rate of 'dev'. Must be called with
+ * no chip selected and no DMA transfer in flight.
+ */
+static void
+spi_select(uint8_t dev) {
+  if(spi_devices[dev].rate != spi_current_rate) {
+    spi_configure(spi_devices[dev].rate);
+  }
+}
+
+void spi_init(void) {
+  MAP_SysCtlPeripheralEnable(SYSCTL_PERIPH_GPIOB);
+
+  // Configure SSI1 for SPI RAM usage
+  MAP_SysCtlPeripheralEnable(SYSCTL_PERIPH_SSI2);
+  MAP_GPIOPinConfigure(GPIO_PB4_SSI2CLK);
+  MAP_GPIOPinConfigure(GPIO_PB6_SSI2RX);
+  MAP_GPIOPinConfigure(GPIO_PB7_SSI2TX);
+  MAP_GPIOPinTypeSSI(GPIO_PORTB_BASE, GPIO_PIN_4 | GPIO_PIN_6 | GPIO_PIN_7);
+  spi_sysclk = MAP_SysCtlClockGet();
+  spi_configure(SPI_MIN_RATE);
+
+  unsigned long b;
+  while(MAP_SSIDataGetNonBlocking(SSI2_BASE, &b)) {}
+}
+
+/**
+ * Find the fastest clock rate 'dev' passes 'test' at. The divider of
+ * the system clock is halved, rounding up, from that of SPI_MIN_RATE
+ * down to the smallest one within SPI_MAX_RATE, so every rate tried is
+ * one SSI2 actually runs at. Each rate has to pass the test
+ * SPI_TEST_PASSES times. The device is left at the rate found, which
+ * is returned.
+ * 'errors' is set to the mismatches seen at the first rate that
+ * failed, if any.
+ */
+uint32_t
+spi_bringup(uint8_t dev, uint16_t (*test)(void), uint16_t *errors) {
+  uint32_t n = SPI_DIVIDER(spi_devices[dev].rate);
+  uint32_t n_min = (spi_sysclk + 2 * SPI_MAX_RATE - 1) / (2 * SPI_MAX_RATE);
+
+  *errors = 0;
+  while(n > n_min) {
+    uint32_t next = (n + 1) / 2;
+    if(next < n_min) {
+      next = n_min;
+    }
+
+    spi_devices[dev].rate = SPI_RATE(next);
+    int pass;
+    for(pass = 0; pass < SPI_TEST_PASSES; pass++) {
+      *errors += test();
+    }
+    if(*errors > 0) {
+      break;
+    }
+    n = next;
+  }
+  spi_devices[dev].rate = SPI_RATE(n);
+  return SPI_RATE(n);
+}
+
+uint8_t spi_send(uint8_t c) {
+  unsigned long val;
+  MAP_SSIDataPut(SSI2_BASE, c);
+  MAP_SSIDataGet(SSI2_BASE, &val);
+  return (uint8_t)val;
+}
+
+/**
+ * Write 'count' bytes, discarding whatever is clocked in.
+ * At most SPI_FIFO_DEPTH bytes are in flight, so the RX FIFO
+ * can never overflow.
+ */
+void spi_write_burst(const uint8_t *buf, uint16_t count) {
+  unsigned long val;
+  uint16_t in_flight = 0;
+
+  while(count > 0) {
+    if(in_flight < SPI_FIFO_DEPTH &&
+       MAP_SSIDataPutNonBlocking(SSI2_BASE, *buf)) {
+      buf++;
+      count--;
+      in_flight++;
+    }
+    while(MAP_SSIDataGetNonBlocking(SSI2_BASE, &val)) {
+      in_flight--;
+    }
+  }
+
+  while(in_flight > 0) {
+    MAP_SSIDataGet(SSI2_BASE, &val);
+    in_flight--;
+  }
+}
+
+/**
+ * Read 'count' bytes, clocking out 0xFF.
+ */
+void spi_read_burst(uint8_t *buf, uint16_t count) {
+  unsigned long val;
+  uint16_t to_send = count;
+
+  while(count > 0) {
+    /* Bytes in flight is the difference between what is still
+     * to be received and what is still to be sent */
+    if(to_send > 0 && (count - to_send) < SPI_FIFO_DEPTH &&
+       MAP_SSIDataPutNonBlocking(SSI2_BASE, 0xFF)) {
+      to_send--;
+    }
+    if(MAP_SSIDataGetNonBlocking(SSI2_BASE, &val)) {
+      *buf = (uint8_t)val;
+      buf++;
+      count--;
+    }
+  }
+}
+
+/* Interrupts are masked only while the bus state is updated */
+#define SPI_ENTER() bool spi_masked = MAP_IntMasterDisable()
+#define SPI_EXIT() do { \
+  if(!spi_masked) { \
+    MAP_IntMasterEnable(); \
+  } \
+} while(0)
+
+static void spi_dispatch(void);
+
+void spi_lock(uint8_t dev) {
+  for(;;) {
+    SPI_ENTER();
+    if(!spi_busy) {
+      spi_busy = true;
+      SPI_EXIT();
+      break;
+    }
+    SPI_EXIT();
+  }
+  spi_select(dev);
+}
+
+void spi_unlock(uint8_t dev) {
+  spi_busy = false;
+  spi_dispatch();
+}
+
+void spi_submit(struct spi_xfer *xfer) {
+  struct spi_device *d = &spi_devices[xfer->dev];
+
+  xfer->next = NULL;
+  SPI_ENTER();
+  if(d->tail) {
+    d->tail->next = xfer;
+  } else {
+    d->head = xfer;
+  }
+  d->tail = xfer;
+  SPI_EXIT();
+
+  spi_dispatch();
+}
+
+/**
+ * Finish the transfer in flight and free the bus.
+ */
+static void
+spi_complete(void) {
+  struct spi_xfer *xfer = spi_active;
+  struct spi_device *d = &spi_devices[xfer->dev];
+
+  MAP_GPIOPinWrite(d->cs_port, d->cs_pin, d->cs_pin);
+  spi_active = NULL;
+  spi_busy = false;
+
+  if(xfer->done) {
+    xfer->done(xfer);
+  }
+}
+
+#if ENC_USE_DMA
+static void
+spi_dma_complete(void) {
+  spi_complete();
+  spi_dispatch();
+}
+#endif
+
+/**
+ * Start 'xfer'. Without DMA it has completed on return.
+ */
+static void
+spi_start(struct spi_xfer *xfer) {
+  struct spi_device *d = &spi_devices[xfer->dev];
+  uint8_t i;
+
+  spi_select(xfer->dev);
+  MAP_GPIOPinWrite(d->cs_port, d->cs_pin, 0);
+  for(i = 0; i < xfer->cmd_len; i++) {
+    spi_send(xfer->cmd[i]);
+  }
+
+#if ENC_USE_DMA
+  if(xfer->count > 0) {
+    spi_dma_start(xfer->tx, xfer->rx, xfer->count, spi_dma_complete);
+    return;
+  }
+#else
+  if(xfer->tx) {
+    spi_write_burst(xfer->tx, xfer->count);
+  } else if(xfer->rx) {
+    spi_read_burst(xfer->rx, xfer->count);
+  }
+#endif
+  spi_complete();
+}
+
+/**
+ * Start queued transfers while the bus is free.
+ */
+static void
+spi_dispatch(void) {
+  for(;;) {
+    struct spi_xfer *xfer = NULL;
+    uint8_t dev;
+
+    SPI_ENTER();
+    if(!spi_busy) {
+      for(dev = 0; dev < SPI_DEVICES; dev++) {
+	struct spi_device *d = &spi_devices[dev];
+	if(d->head) {
+	  xfer = d->head;
+	  d->head = xfer->next;
+	  if(!d->head) {
+	    d->tail = NULL;
+	  }
+	  spi_busy = true;
+	  spi_active = xfer;
+	  break;
+	}
+      }
+    }
+    SPI_EXIT();
+
+    if(!xfer) {
+      return;
+    }
+
+    spi_start(xfer);
+    if(spi_busy) {
+      /* Completes from the SSI2 interrupt */
+      return;
+    }
+  }
+}
+
+#if ENC_USE_DMA
+/* SSI2 RX and TX are on uDMA channels 12 and 13, encoding 2 */
+#define SPI_DMA_RX_CH		12
+#define SPI_DMA_TX_CH		13
+
+/* The control table must be 1024 byte aligned */
+static uint8_t dma_control_table[1024] __attribute__ ((aligned(1024)));
+
+static const uint8_t *spi_dma_tx;
+static uint8_t *spi_dma_rx;
+static uint16_t spi_dma_remaining;
+static volatile bool spi_dma_active;
+static spi_dma_callback_t spi_dma_done;
+
+/* Source of dummy bytes when reading, sink when writing */
+static const uint8_t spi_dma_dummy_tx = 0xFF;
+static uint8_t spi_dma_dummy_rx;
+
+void spi_dma_init(void) {
+  MAP_SysCtlPeripheralEnable(SYSCTL_PERIPH_UDMA);
+  MAP_uDMAEnable();
+  MAP_uDMAControlBaseSet(dma_control_table);
+
+  MAP_uDMAChannelAssign(UDMA_CH12_SSI2RX);
+  MAP_uDMAChannelAssign(UDMA_CH13_SSI2TX);
+  MAP_uDMAChannelAttributeDisable(SPI_DMA_RX_CH, UDMA_ATTR_ALL);
+  MAP_uDMAChannelAttributeDisable(SPI_DMA_TX_CH, UDMA_ATTR_ALL);
+
+  MAP_IntEnable(INT_SSI2);
+}
+
+/**
+ * Program and start the next chunk of the current transfer.
+ * The RX channel is enabled first, so no received byte is missed.
+ */
+static void spi_dma_next(void) {
+  uint16_t count = spi_dma_remaining;
+  if(count > SPI_DMA_MAX_XFER) {
+    count = SPI_DMA_MAX_XFER;
+  }
+
+  MAP_uDMAChannelTransferSet(SPI_DMA_RX_CH | UDMA_PRI_SELECT, UDMA_MODE_BASIC,
+			     (void *)(SSI2_BASE + SSI_O_DR),
+			     spi_dma_rx ? spi_dma_rx : &spi_dma_dummy_rx,
+			     count);
+  MAP_uDMAChannelTransferSet(SPI_DMA_TX_CH | UDMA_PRI_SELECT, UDMA_MODE_BASIC,
+			     (void *)(spi_dma_tx ? spi_dma_tx : &spi_dma_dummy_tx),
+			     (void *)(SSI2_BASE + SSI_O_DR),
+			     count);
+
+  if(spi_dma_rx) {
+    spi_dma_rx += count;
+  }
+  if(spi_dma_tx) {
+    spi_dma_tx += count;
+  }
+  spi_dma_remaining -= count;
+
+  MAP_uDMAChannelEnable(SPI_DMA_RX_CH);
+  MAP_uDMAChannelEnable(SPI_DMA_TX_CH);
+}
+
+void spi_dma_start(const uint8_t *tx, uint8_t *rx, uint16_t count,
+		   spi_dma_callback_t done) {
+  while(spi_dma_active) {}
+
+  spi_dma_tx = tx;
+  spi_dma_rx = rx;
+  spi_dma_remaining = count;
+  spi_dma_done = done;
+  spi_dma_active = true;
+
+  MAP_uDMAChannelControlSet(SPI_DMA_RX_CH | UDMA_PRI_SELECT,
+			    UDMA_SIZE_8 | UDMA_SRC_INC_NONE |
+			    (rx ? UDMA_DST_INC_8 : UDMA_DST_INC_NONE) |
+			    UDMA_ARB_4);
+  MAP_uDMAChannelControlSet(SPI_DMA_TX_CH | UDMA_PRI_SELECT,
+			    UDMA_SIZE_8 |
+			    (tx ? UDMA_SRC_INC_8 : UDMA_SRC_INC_NONE) |
+			    UDMA_DST_INC_NONE | UDMA_ARB_4);
+
+  spi_dma_next();
+  MAP_SSIDMAEnable(SSI2_BASE, SSI_DMA_RX | SSI_DMA_TX);
+}
+
+bool spi_dma_busy(void) {
+  return spi_dma_active;
+}
+
+/**
+ * The uDMA controller signals completion of SSI2 transfers
+ * on the SSI2 interrupt.
+ */
+void SSI2IntHandler(void) {
+  if(!spi_dma_active ||
+     MAP_uDMAChannelModeGet(SPI_DMA_RX_CH | UDMA_PRI_SELECT) != UDMA_MODE_STOP) {
+    return;
+  }
+
+  if(spi_dma_remaining > 0) {
+    spi_dma_next();
+    return;
+  }
+
+  MAP_SSIDMADisable(SSI2_BASE, SSI_DMA_RX | SSI_DMA_TX);
+  spi_dma_active = false;
+
+  if(spi_dma_done) {
+    spi_dma_done();
+  }
+}
+#else
+void spi_dma_init(void) {
+}
+
+bool spi_dma_busy(void) {
+  return false;
+}
+
+void SSI2IntHandler(void) {
+}
+#endif
@@ -2,6 +2,123 @@
 #define _SPI_H
 
 #include <stdint.h>
+#include <stdbool.h>
 uint8_t spi_send(uint8_t c);
 
+/**
+ * Devices sharing SSI2, highest priority first. Each device has
+ * its own chip select and clock rate.
+ */
+#define SPI_DEV_ENC	0
+#define SPI_DEV_MEM	1
+#define SPI_DEVICES	2
+
+/* Clock rate at reset and the fastest rate either device is rated for */
+#define SPI_MIN_RATE	1000000
+#define SPI_MAX_RATE	20000000
+
+/**
+ * Set up SSI2 and its pins, with every device at SPI_MIN_RATE.
+ * spi_bringup() then finds the rate each device works at.
+ */
+void spi_init(void);
+uint32_t spi_bringup(uint8_t dev, uint16_t (*test)(void), uint16_t *errors);
+
+/**
+ * Bus arbitration.
+ * Polled transactions are bracketed by spi_lock() and spi_unlock().
+ * spi_lock() waits for the transfer in flight, if any, and applies
+ * the clock rate of the device. The chip select is left to the
+ * caller. Not to be used from interrupt context.
+ */
+void spi_lock(uint8_t dev);
+void spi_unlock(uint8_t dev);
+
+/**
+ * Queued transfers.
+ * The bus manager selects the device, sends the 'cmd_len' command
+ * bytes and then transfers 'count' bytes of data, with DMA if
+ * available. When the bus is free, the next transfer is taken from
+ * the highest priority device that has one queued.
+ * 'done' is called once the device has been deselected, usually
+ * from interrupt context. spi_submit() may be called from interrupt
+ * context, including from 'done'.
+ */
+struct spi_xfer;
+typedef void (*spi_xfer_callback_t)(struct spi_xfer *xfer);
+
+struct spi_xfer {
+  uint8_t dev;
+  uint8_t cmd[3];
+  uint8_t cmd_len;
+  const uint8_t *tx;		/* NULL to clock out 0xFF */
+  uint8_t *rx;			/* NULL to discard */
+  uint16_t count;
+  spi_xfer_callback_t done;
+  struct spi_xfer *next;
+};
+
+void spi_submit(struct spi_xfer *xfer);
+
+/* Layout of the SPI SRAM */
+#define SPI_MEM_SIZE		0x8000
+#define SPI_MEM_SPILL_BASE	0x0000	/* ENC28J60 RX spill pool */
+#define SPI_MEM_SPILL_SIZE	0x3000
+#define SPI_MEM_WINDOW_BASE	0x3000	/* uIP TCP send windows */
+#define SPI_MEM_ARP_BASE	0x6080	/* uIP packets waiting for ARP */
+
+/**
+ * SPI SRAM access. The polled functions hold the bus for the
+ * whole transfer. The queued ones split it into SPI_MEM_CHUNK
+ * byte transfers, so ENC28J60 transfers can get in between.
+ */
+#define SPI_MEM_CHUNK	128
+
+struct spi_mem_op;
+typedef void (*spi_mem_callback_t)(struct spi_mem_op *op);
+
+struct spi_mem_op {
+  struct spi_xfer xfer;		/* Must be first */
+  uint16_t addr;
+  uint16_t remaining;
+  spi_mem_callback_t done;
+};
+
+void spi_mem_write(uint16_t addr, const uint8_t *buf, uint16_t count);
+void spi_mem_read(uint16_t addr, uint8_t *buf, uint16_t count);
+void spi_mem_write_start(struct spi_mem_op *op, uint16_t addr,
+			 const uint8_t *buf, uint16_t count,
+			 spi_mem_callback_t done);
+void spi_mem_read_start(struct spi_mem_op *op, uint16_t addr,
+			uint8_t *buf, uint16_t count,
+			spi_mem_callback_t done);
+
+/* Depth of the SSI transmit and receive FIFOs */
+#define SPI_FIFO_DEPTH	8
+
+/**
+ * Burst transfers. These keep the SSI TX FIFO filled while draining
+ * the RX FIFO, so consecutive bytes are clocked out back-to-back.
+ * Chip select must be handled by the caller.
+ */
+void spi_write_burst(const uint8_t *buf, uint16_t count);
+void spi_read_burst(uint8_t *buf, uint16_t count);
+
+/**
+ * uDMA transfers. Either 'tx' or 'rx' may be NULL, in which case
+ * 0xFF is clocked out or the received bytes are discarded.
+ * The transfer is split into chunks of at most SPI_DMA_MAX_XFER bytes.
+ * 'done' is called from the SSI2 interrupt handler once the last
+ * byte has been received.
+ */
+#define SPI_DMA_MAX_XFER	1024
+
+typedef void (*spi_dma_callback_t)(void);
+
+void spi_dma_init(void);
+void spi_dma_start(const uint8_t *tx, uint8_t *rx, uint16_t count,
+		   spi_dma_callback_t done);
+bool spi_dma_busy(void);
+void SSI2IntHandler(void);
+
 #endif
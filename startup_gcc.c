@@ -43,6 +43,7 @@ static void IntDefaultHandler(void);
 extern void SysTickIntHandler(void);
 extern void UARTStdioIntHandler(void);
 extern void GPIOPortEIntHandler(void);
+extern void SSI2IntHandler(void);
 
 //*****************************************************************************
 //
@@ -141,7 +142,7 @@ void (* const g_pfnVectors[])(void) =
     IntDefaultHandler,                      // GPIO Port J
     IntDefaultHandler,                      // GPIO Port K
     IntDefaultHandler,                      // GPIO Port L
-    IntDefaultHandler,                      // SSI2 Rx and Tx
+    SSI2IntHandler,                         // SSI2 Rx and Tx
     IntDefaultHandler,                      // SSI3 Rx and Tx
     IntDefaultHandler,                      // UART3 Rx and Tx
     IntDefaultHandler,                      // UART4 Rx and Tx
@@ -0,0 +1,271 @@
+/*
+ * uip_arp.c, built into this program so that the table, its hash
+ * chains and the queue of packets waiting for a reply can be checked
+ * directly: packets queued on a miss and sent once the reply comes
+ * in, the queue filling up and timing out, and the least recently
+ * used entry making room for a new one.
+ */
+#include "uip_arp.c"
+
+#include "host.h"
+
+#include <string.h>
+
+void
+test_appcall(void) {
+}
+
+/* Hosts on the local network are 10.0.0.'last' */
+static void
+host_addr(uip_ipaddr_t addr, uint8_t last) {
+  uip_ipaddr(addr, host_ip[0], host_ip[1], host_ip[2], last);
+}
+
+static void
+host_ethaddr(struct uip_eth_addr *eth, uint8_t last) {
+  memcpy(eth->addr, peer_mac, 6);
+  eth->addr[4] = 0x10;
+  eth->addr[5] = last;
+}
+
+/* An IP packet to 'last' in uip_buf, marked with 'id', and handed to
+ * uip_arp_out(). Returns true if it went out, false if an ARP request
+ * for 'last' was sent in its place. */
+static bool
+send_to(uint8_t last, uint8_t id) {
+  uip_ipaddr_t dest;
+
+  host_addr(dest, last);
+  memset(uip_buf, 0, UIP_LLH_LEN + 40);
+  IPBUF->vhl = 0x45;
+  host_addr(IPBUF->srcipaddr, host_ip[3]);
+  host_addr(IPBUF->destipaddr, last);
+  uip_buf[UIP_LLH_LEN + 20] = id;
+  uip_len = 40;
+  uip_arp_out();
+  if(IPBUF->ethhdr.type == HTONS(UIP_ETHTYPE_ARP)) {
+    CHECK(uip_len == sizeof(struct arp_hdr) &&
+	  BUF->opcode == HTONS(ARP_REQUEST) &&
+	  uip_ipaddr_cmp(BUF->dipaddr, dest));
+    return false;
+  }
+  CHECK(uip_len == UIP_LLH_LEN + 40);
+  return true;
+}
+
+/* The ARP reply of 'last' to our request */
+static void
+reply_from(uint8_t last) {
+  memset(uip_buf, 0, sizeof(struct arp_hdr));
+  memcpy(BUF->ethhdr.dest.addr, host_mac, 6);
+  host_ethaddr(&BUF->ethhdr.src, last);
+  BUF->ethhdr.type = HTONS(UIP_ETHTYPE_ARP);
+  BUF->hwtype = HTONS(ARP_HWTYPE_ETH);
+  BUF->protocol = HTONS(UIP_ETHTYPE_IP);
+  BUF->hwlen = 6;
+  BUF->protolen = 4;
+  BUF->opcode = HTONS(ARP_REPLY);
+  host_ethaddr(&BUF->shwaddr, last);
+  host_addr(BUF->sipaddr, last);
+  memcpy(BUF->dhwaddr.addr, host_mac, 6);
+  host_addr(BUF->dipaddr, host_ip[3]);
+  uip_len = sizeof(struct arp_hdr);
+  uip_arp_arpin();
+  CHECK(uip_len == 0);
+}
+
+/* Take the next packet released by a reply. Returns its id, or -1
+ * if there is none. */
+static int
+dequeue(void) {
+  struct uip_eth_addr eth;
+
+  uip_arp_dequeue();
+  if(uip_len == 0) {
+    return -1;
+  }
+  CHECK(uip_len == UIP_LLH_LEN + 40);
+  host_ethaddr(&eth, ((uint8_t *)IPBUF->destipaddr)[3]);
+  CHECK(memcmp(IPBUF->ethhdr.dest.addr, eth.addr, 6) == 0);
+  CHECK(IPBUF->ethhdr.type == HTONS(UIP_ETHTYPE_IP));
+  return uip_buf[UIP_LLH_LEN + 20];
+}
+
+static arp_index_t
+find(uint8_t last) {
+  uip_ipaddr_t addr;
+
+  host_addr(addr, last);
+  return arp_lookup(addr);
+}
+
+/* Every entry in use is on the chain of its own bucket exactly once,
+ * every other one on the free list, and no chain loops */
+static bool
+table_ok(void) {
+  unsigned seen[UIP_ARPTAB_SIZE];
+  unsigned b, n, steps = 0;
+  arp_index_t e;
+
+  memset(seen, 0, sizeof(seen));
+  for(b = 0; b < UIP_ARP_HASH; b++) {
+    for(e = arp_hash[b]; e != ARP_NONE && steps <= UIP_ARPTAB_SIZE;
+	e = arp_table[e].next, steps++) {
+      if(e >= UIP_ARPTAB_SIZE || arp_bucket(arp_table[e].ipaddr) != b ||
+	 (arp_table[e].ipaddr[0] | arp_table[e].ipaddr[1]) == 0) {
+	return false;
+      }
+      seen[e]++;
+    }
+  }
+  for(e = arp_free; e != ARP_NONE && steps <= UIP_ARPTAB_SIZE;
+      e = arp_table[e].next, steps++) {
+    if(e >= UIP_ARPTAB_SIZE ||
+       (arp_table[e].ipaddr[0] | arp_table[e].ipaddr[1]) != 0) {
+      return false;
+    }
+    seen[e]++;
+  }
+  for(n = 0; n < UIP_ARPTAB_SIZE; n++) {
+    if(seen[n] != 1) {
+      return false;
+    }
+  }
+  return steps == UIP_ARPTAB_SIZE;
+}
+
+static void
+setup(void) {
+  host_uip_init();
+  memset(&uip_stat, 0, sizeof(uip_stat));
+  arptime = 0;
+}
+
+/* A packet to an unknown host waits for its reply, and only that */
+static void
+test_queue(void) {
+  setup();
+  CHECK(!send_to(50, 1));
+  CHECK(!send_to(51, 2));
+  CHECK(uip_stat.arp.queued == 2);
+  CHECK(dequeue() == -1);
+
+  reply_from(51);
+  CHECK(dequeue() == 2);
+  CHECK(dequeue() == -1);
+  CHECK(send_to(51, 3));
+
+  reply_from(50);
+  CHECK(dequeue() == 1);
+  CHECK(dequeue() == -1);
+  CHECK(uip_stat.arp.sent == 2);
+  CHECK(table_ok());
+}
+
+/* Misses beyond UIP_ARP_QUEUE only send the request, and queued
+ * packets are dropped after UIP_ARP_QUEUE_MAXAGE timer calls */
+static void
+test_queue_limits(void) {
+  unsigned n;
+
+  setup();
+  for(n = 0; n <= UIP_ARP_QUEUE; n++) {
+    CHECK(!send_to(60 + n, n));
+  }
+  CHECK(uip_stat.arp.queued == UIP_ARP_QUEUE);
+  CHECK(uip_stat.arp.full == 1);
+  for(n = 0; n <= UIP_ARP_QUEUE; n++) {
+    reply_from(60 + n);
+  }
+  for(n = 0; n < UIP_ARP_QUEUE; n++) {
+    CHECK(dequeue() == (int)n);
+  }
+  CHECK(dequeue() == -1);
+
+  /* Freed slots take new packets */
+  CHECK(!send_to(70, 10));
+  for(n = 1; n < UIP_ARP_QUEUE_MAXAGE; n++) {
+    uip_arp_timer();
+  }
+  CHECK(!send_to(71, 11));
+  uip_arp_timer();
+  CHECK(uip_stat.arp.timeout == 1);
+  reply_from(70);
+  reply_from(71);
+  CHECK(dequeue() == 11);
+  CHECK(dequeue() == -1);
+}
+
+/* With the table full, a new host takes the entry used longest ago.
+ * The chains stay intact, and the entry of the last packet sent is
+ * not used for another host. */
+static void
+test_evict(void) {
+  arp_index_t victim, e;
+  unsigned n;
+  bool ok = true;
+
+  setup();
+  reply_from(2);
+  CHECK(send_to(2, 0));
+  victim = find(2);
+  CHECK(victim != ARP_NONE && arp_last == victim);
+
+  uip_arp_timer();
+  for(n = 1; n < UIP_ARPTAB_SIZE; n++) {
+    reply_from(2 + n);
+  }
+  CHECK(arp_free == ARP_NONE && uip_stat.arp.evict == 0);
+  CHECK(table_ok());
+
+  reply_from(2 + UIP_ARPTAB_SIZE);
+  CHECK(uip_stat.arp.evict == 1);
+  CHECK(find(2) == ARP_NONE && find(2 + UIP_ARPTAB_SIZE) == victim);
+  CHECK(arp_last == ARP_NONE);
+  /* Broken chains would hang uip_arp.c from here on */
+  ok = table_ok();
+  CHECK(ok);
+  if(!ok) {
+    return;
+  }
+  for(n = 1; n <= UIP_ARPTAB_SIZE; n++) {
+    ok = ok && find(2 + n) != ARP_NONE;
+  }
+  CHECK(ok);
+  CHECK(!send_to(2, 1));
+  CHECK(send_to(2 + UIP_ARPTAB_SIZE, 2));
+
+  /* Entries removed from the middle and ends of chains */
+  for(n = 0; ok && n < UIP_ARPTAB_SIZE; n += 3) {
+    e = find(3 + n);
+    if(e != ARP_NONE) {
+      arp_remove(e);
+    }
+    ok = ok && find(3 + n) == ARP_NONE && table_ok();
+  }
+  CHECK(ok);
+  if(!ok) {
+    return;
+  }
+
+  /* And all of them by age */
+  for(n = 0; n < UIP_ARP_MAXAGE; n++) {
+    uip_arp_timer();
+  }
+  CHECK(table_ok());
+  for(n = 0, e = arp_free; e != ARP_NONE && n <= UIP_ARPTAB_SIZE;
+      e = arp_table[e].next) {
+    n++;
+  }
+  CHECK(n == UIP_ARPTAB_SIZE);
+}
+
+int
+main(void) {
+  test_queue();
+  test_queue_limits();
+  test_evict();
+
+  printf("arp_test: %s\n", check_failures ? "FAILED" : "passed");
+  return check_failures != 0;
+}
@@ -0,0 +1,263 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "board.h"
+#include "encsim.h"
+#include "enc28j60.h"
+#include "spi.h"
+
+/* common.h maps printf to UARTprintf for the target, so stdio.h
+ * goes first */
+#undef printf
+
+#if ENC_USE_DMA
+#define ENC_RX_READY()		enc_rx_ready()
+#else
+#define ENC_RX_READY()		false
+#endif
+
+bool board_console;
+
+static struct board_stats stats;
+
+/* Chip selects, active low */
+static bool enc_selected;
+static bool sram_selected;
+
+/* Level of the INT line last seen, and an edge not acted on yet */
+static bool int_level;
+static bool int_edge;
+
+/* Set between spi_lock() and spi_unlock() */
+static bool bus_locked;
+
+static void
+int_update(void) {
+  bool level = encsim_int();
+
+  if(level && !int_level) {
+    int_edge = true;
+  }
+  int_level = level;
+}
+
+/*---------------------------------------------------------------------------*/
+/* 23K256 SRAM in sequential mode: command, 16-bit address, data */
+
+static uint8_t sram[SPI_MEM_SIZE];
+static uint16_t sram_pos;
+static uint8_t sram_cmd;
+static uint16_t sram_addr;
+
+static uint8_t
+sram_spi(uint8_t out) {
+  uint8_t in = 0xFF;
+
+  switch(sram_pos++) {
+  case 0:
+    sram_cmd = out;
+    break;
+  case 1:
+    sram_addr = out << 8;
+    break;
+  case 2:
+    sram_addr |= out;
+    break;
+  default:
+    if(sram_cmd == 0x02) {
+      sram[sram_addr % SPI_MEM_SIZE] = out;
+    } else if(sram_cmd == 0x03) {
+      in = sram[sram_addr % SPI_MEM_SIZE];
+    }
+    sram_addr++;
+    break;
+  }
+  return in;
+}
+
+/*---------------------------------------------------------------------------*/
+/* driverlib */
+
+void
+GPIOPinWrite(unsigned long ulPort, unsigned char ucPins, unsigned char ucVal) {
+  if(ulPort == ENC_CS_PORT && (ucPins & ENC_CS)) {
+    enc_selected = !(ucVal & ENC_CS);
+    encsim_select(enc_selected);
+    if(!enc_selected) {
+      int_update();
+    }
+  }
+  if(ulPort == GPIO_PORTA_BASE && (ucPins & SRAM_CS)) {
+    if(!(ucVal & SRAM_CS) && !sram_selected) {
+      sram_pos = 0;
+      stats.sram_transactions++;
+    }
+    sram_selected = !(ucVal & SRAM_CS);
+  }
+}
+
+unsigned long
+SysCtlClockGet(void) {
+  return 80000000;
+}
+
+void
+SysCtlDelay(unsigned long ulCount) {
+  (void)ulCount;
+}
+
+void
+UARTprintf(const char *pcString, ...) {
+  va_list ap;
+
+  if(board_console) {
+    va_start(ap, pcString);
+    vprintf(pcString, ap);
+    va_end(ap);
+  }
+}
+
+/*---------------------------------------------------------------------------*/
+/* spi.h */
+
+uint8_t
+spi_send(uint8_t c) {
+  if(enc_selected == sram_selected) {
+    stats.bus_errors++;
+    return 0xFF;
+  }
+  if(enc_selected) {
+    return encsim_spi(c);
+  }
+  stats.sram_bytes++;
+  return sram_spi(c);
+}
+
+void
+spi_lock(uint8_t dev) {
+  (void)dev;
+  if(bus_locked) {
+    stats.bus_errors++;
+  }
+  bus_locked = true;
+}
+
+void
+spi_unlock(uint8_t dev) {
+  (void)dev;
+  bus_locked = false;
+}
+
+void
+spi_write_burst(const uint8_t *buf, uint16_t count) {
+  while(count--) {
+    spi_send(*buf++);
+  }
+}
+
+void
+spi_read_burst(uint8_t *buf, uint16_t count) {
+  while(count--) {
+    *buf++ = spi_send(0xFF);
+  }
+}
+
+void
+spi_submit(struct spi_xfer *xfer) {
+  unsigned long port = xfer->dev == SPI_DEV_ENC ? ENC_CS_PORT :
+    GPIO_PORTA_BASE;
+  unsigned char pin = xfer->dev == SPI_DEV_ENC ? ENC_CS : SRAM_CS;
+  uint16_t i;
+  uint8_t in;
+
+  if(bus_locked) {
+    stats.bus_errors++;
+  }
+  GPIOPinWrite(port, pin, 0);
+  for(i = 0; i < xfer->cmd_len; i++) {
+    spi_send(xfer->cmd[i]);
+  }
+  for(i = 0; i < xfer->count; i++) {
+    in = spi_send(xfer->tx ? xfer->tx[i] : 0xFF);
+    if(xfer->rx) {
+      xfer->rx[i] = in;
+    }
+  }
+  GPIOPinWrite(port, pin, pin);
+
+  if(xfer->done) {
+    xfer->done(xfer);
+  }
+}
+
+#define SELECT_MEM() do { \
+  spi_lock(SPI_DEV_MEM); \
+  GPIOPinWrite(GPIO_PORTA_BASE, SRAM_CS, 0); \
+} while(0)
+#define DESELECT_MEM() do { \
+  GPIOPinWrite(GPIO_PORTA_BASE, SRAM_CS, SRAM_CS); \
+  spi_unlock(SPI_DEV_MEM); \
+} while(0)
+
+void
+spi_mem_write(uint16_t addr, const uint8_t *buf, uint16_t count) {
+  SELECT_MEM();
+  spi_send(0x02);
+  spi_send(addr >> 8);
+  spi_send(addr & 0xFF);
+  spi_write_burst(buf, count);
+  DESELECT_MEM();
+}
+
+void
+spi_mem_read(uint16_t addr, uint8_t *buf, uint16_t count) {
+  SELECT_MEM();
+  spi_send(0x03);
+  spi_send(addr >> 8);
+  spi_send(addr & 0xFF);
+  spi_read_burst(buf, count);
+  DESELECT_MEM();
+}
+
+/*---------------------------------------------------------------------------*/
+
+void
+board_init(void) {
+  memset(sram, 0, sizeof(sram));
+  memset(&stats, 0, sizeof(stats));
+  enc_selected = sram_selected = false;
+  bus_locked = false;
+  encsim_init();
+  int_level = int_edge = false;
+}
+
+bool
+board_receive(const uint8_t *frame, uint16_t len) {
+  bool ok = encsim_receive(frame, len);
+
+  int_update();
+  return ok;
+}
+
+void
+board_run(void) {
+  /* The model may have changed INT since the last transaction */
+  int_update();
+  for(;;) {
+    if(int_edge || ENC_RX_READY()) {
+      int_edge = false;
+      stats.enc_actions++;
+      enc_action();
+    } else if(encsim_tx_finish()) {
+      int_update();
+    } else {
+      break;
+    }
+  }
+}
+
+void
+board_get_stats(struct board_stats *s) {
+  *s = stats;
+}
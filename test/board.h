@@ -0,0 +1,49 @@
+#ifndef _BOARD_H
+#define _BOARD_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * The board around enc28j60.c on the host: SSI2 with the ENC28J60
+ * model and the SPI SRAM on it, the chip select GPIOs, the console,
+ * and the part of the main loop that calls enc_action().
+ *
+ * The spi.h functions stand in for those of spi.c and main.c. They
+ * clock every byte through the devices, so transfers are counted the
+ * same way whether the driver uses the polled or the queued
+ * functions, but queued transfers complete before spi_submit()
+ * returns.
+ */
+
+/* UARTprintf() writes to stdout while set */
+extern bool board_console;
+
+/* Power on the ENC28J60 model and clear the SRAM */
+void board_init(void);
+
+/**
+ * Run the main loop until the driver has nothing left to do:
+ * enc_action() on each falling edge of INT and whenever a received
+ * frame is ready. A transmission still in progress then completes,
+ * as if the bus had been idle for that long.
+ */
+void board_run(void);
+
+/* A frame arrives from the wire, see encsim_receive() */
+bool board_receive(const uint8_t *frame, uint16_t len);
+
+/**
+ * Counters for the SRAM, and for misuse of the bus: transfers while
+ * it is locked, bytes with no chip or both chips selected.
+ */
+struct board_stats {
+  uint32_t sram_transactions;
+  uint32_t sram_bytes;
+  uint32_t bus_errors;
+  uint32_t enc_actions;
+};
+
+void board_get_stats(struct board_stats *stats);
+
+#endif
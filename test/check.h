@@ -0,0 +1,16 @@
+#ifndef _CHECK_H
+#define _CHECK_H
+
+#include <stdio.h>
+
+/* Print a failed check and count it in check_failures */
+extern unsigned check_failures;
+
+#define CHECK(cond) do {						\
+    if(!(cond)) {							\
+      printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);	\
+      check_failures++;							\
+    }									\
+  } while(0)
+
+#endif
@@ -0,0 +1,144 @@
+/*
+ * The checksums of uip-arch.c against the generic ones of uip.c,
+ * which this program is built with (TEST_ARCH_CHKSUM=0). On the host
+ * sum_blocks() is the C version, not the Thumb-2 one. With
+ * CHKSUM_BENCH defined, both are timed instead.
+ */
+#define uip_chksum	arch_chksum
+#define uip_ipchksum	arch_ipchksum
+#define uip_tcpchksum	arch_tcpchksum
+#include "uip-arch.c"
+#undef uip_chksum
+#undef uip_ipchksum
+#undef uip_tcpchksum
+
+/* Hidden by the renaming above */
+u16_t uip_chksum(u16_t *buf, u16_t len);
+u16_t uip_ipchksum(void);
+u16_t uip_tcpchksum(void);
+
+#include "host.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+void
+test_appcall(void) {
+}
+
+/* Room for a full frame at any of 8 offsets from a word boundary */
+static union {
+  uint64_t align;
+  uint8_t data[8 + UIP_BUFSIZE];
+} buf;
+
+static void
+fill(uint8_t *p, uint16_t len, int pattern) {
+  uint16_t i;
+
+  for(i = 0; i < len; i++) {
+    switch(pattern) {
+    case 0:
+      p[i] = host_random();
+      break;
+    case 1:
+      /* Carries on every add */
+      p[i] = 0xff;
+      break;
+    default:
+      p[i] = 0;
+      break;
+    }
+  }
+}
+
+#ifndef CHKSUM_BENCH
+static void
+test_chksum(void) {
+  unsigned long n;
+  uint16_t off, len;
+  u16_t *p;
+
+  for(n = 0; n < 200000; n++) {
+    off = host_random() & 7;
+    len = n < 3 * 1600 ? n % 1600 : host_random() % (UIP_BUFSIZE + 1);
+    p = (u16_t *)(buf.data + off);
+    fill(buf.data + off, len, n < 3 * 1600 ? n / 1600 : 0);
+    if(arch_chksum(p, len) != uip_chksum(p, len)) {
+      printf("  chksum differs at offset %u, length %u\n", off, len);
+      check_failures++;
+      return;
+    }
+  }
+}
+
+static void
+test_packet(void) {
+  unsigned long n;
+  uint16_t len;
+
+  for(n = 0; n < 20000; n++) {
+    len = host_random() % (UIP_TCP_MSS + 1);
+    frame_tcp(uip_buf, host_random(), host_random(), 80, host_random(),
+	      host_random(), TCP_ACK, len);
+    /* Valid checksums sum up to zero, reported as 0xffff */
+    CHECK(arch_ipchksum() == 0xffff && uip_ipchksum() == 0xffff);
+    CHECK(arch_tcpchksum() == 0xffff && uip_tcpchksum() == 0xffff);
+
+    uip_buf[FRAME_IP + 10] = host_random();
+    uip_buf[FRAME_TCPDATA + len - 1] ^= 1 + (host_random() & 0x7f);
+    CHECK(arch_ipchksum() == uip_ipchksum());
+    CHECK(arch_tcpchksum() == uip_tcpchksum());
+    if(check_failures) {
+      printf("  packet with %u bytes of data\n", len);
+      return;
+    }
+  }
+}
+
+int
+main(void) {
+  host_uip_init();
+  test_chksum();
+  test_packet();
+  printf("chksum_test: %s\n", check_failures ? "FAILED" : "passed");
+  return check_failures != 0;
+}
+#else /* CHKSUM_BENCH */
+static void
+bench(const char *name, u16_t (*f)(u16_t *, u16_t), uint16_t off,
+      uint16_t len, unsigned long iterations) {
+  volatile u16_t sink;
+  unsigned long i;
+  uint64_t t;
+
+  t = host_cpu_ns();
+  for(i = 0; i < iterations; i++) {
+    sink = f((u16_t *)(buf.data + off), len);
+  }
+  t = host_cpu_ns() - t;
+  (void)sink;
+  printf("  %-8s %4u bytes at offset %u %8.1f ns %6.3f ns/byte\n",
+	 name, len, off, (double)t / iterations,
+	 (double)t / iterations / len);
+}
+
+int
+main(int argc, char **argv) {
+  unsigned long iterations = argc > 1 ? strtoul(argv[1], NULL, 0) : 1000000;
+  static const uint16_t lens[] = { 20, 40, 536, 1460 };
+  unsigned i, off;
+
+  fill(buf.data, sizeof(buf.data), 0);
+  printf("uip_chksum(), %lu calls each\n", iterations);
+  for(i = 0; i < sizeof(lens) / sizeof(lens[0]); i++) {
+    for(off = 0; off < 2; off++) {
+      bench("generic", uip_chksum, off * 2, lens[i], iterations);
+      bench("arch", arch_chksum, off * 2, lens[i], iterations);
+    }
+  }
+  bench("generic", uip_chksum, 1, 1460, iterations);
+  bench("arch", arch_chksum, 1, 1460, iterations);
+  return 0;
+}
+#endif /* CHKSUM_BENCH */
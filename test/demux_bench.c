@@ -0,0 +1,110 @@
+#include "host.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * The cost of finding the connection of a TCP segment, against the
+ * number of open connections. Built for several UIP_CONF_MAX_CONNECTIONS
+ * and UIP_CONF_CONN_HASH settings; every connection slot is in use.
+ */
+
+#define BENCH_PORT	80
+#define BENCH_DATA	64
+
+/* Connections in random order, looked up in turn */
+#define BENCH_ORDER	1024
+
+void
+bench_appcall(void) {
+}
+
+/* The peer's side of each connection */
+static struct {
+  uint8_t hdr[FRAME_TCPDATA];
+  uint32_t seq;
+} peers[UIP_CONNS];
+
+static uint16_t order[BENCH_ORDER];
+
+/* Remote port and address of connection i */
+#define PEER_PORT(i)	(40000 + (i) * 97)
+#define PEER_IP(i)	(1 + (i) % 4)
+
+int
+main(int argc, char **argv) {
+  unsigned long iterations = argc > 1 ? strtoul(argv[1], NULL, 0) : 1000000;
+  unsigned long i, hits;
+  uip_ipaddr_t ripaddr;
+  uint16_t frame_len;
+  struct uip_conn *volatile sink;
+  uint32_t ack;
+  uint64_t t;
+  int c;
+
+  host_uip_init();
+  uip_listen(HTONS(BENCH_PORT));
+
+  for(c = 0; c < UIP_CONNS; c++) {
+    peers[c].seq = host_tcp_connect(PEER_IP(c), PEER_PORT(c), BENCH_PORT,
+				    &ack);
+    CHECK(ack != 0);
+    frame_len = frame_tcp(uip_buf, PEER_IP(c), PEER_PORT(c), BENCH_PORT,
+			  peers[c].seq, ack, TCP_ACK | TCP_PSH, BENCH_DATA);
+    memcpy(peers[c].hdr, uip_buf, FRAME_TCPDATA);
+  }
+  for(i = 0; i < BENCH_ORDER; i++) {
+    order[i] = host_random() % UIP_CONNS;
+  }
+
+  printf("%d connections, UIP_CONN_HASH=%d, %lu lookups each\n",
+	 UIP_CONNS, UIP_CONN_HASH, iterations);
+
+  /* uip_conn_lookup() on its own, for open connections */
+  hits = 0;
+  t = host_cpu_ns();
+  for(i = 0; i < iterations; i++) {
+    c = order[i % BENCH_ORDER];
+    uip_ipaddr(ripaddr, peer_ip[0], peer_ip[1], peer_ip[2], PEER_IP(c));
+    sink = uip_conn_lookup(ripaddr, HTONS(PEER_PORT(c)), HTONS(BENCH_PORT));
+    hits += sink != NULL;
+  }
+  t = host_cpu_ns() - t;
+  CHECK(hits == iterations);
+  printf("  %-24s %8.1f ns\n", "lookup, found", (double)t / iterations);
+
+  /* and for segments that belong to no connection */
+  hits = 0;
+  t = host_cpu_ns();
+  for(i = 0; i < iterations; i++) {
+    c = order[i % BENCH_ORDER];
+    uip_ipaddr(ripaddr, peer_ip[0], peer_ip[1], peer_ip[2], PEER_IP(c));
+    sink = uip_conn_lookup(ripaddr, HTONS(PEER_PORT(c) + 1),
+			   HTONS(BENCH_PORT));
+    hits += sink != NULL;
+  }
+  t = host_cpu_ns() - t;
+  CHECK(hits == 0);
+  printf("  %-24s %8.1f ns\n", "lookup, not found", (double)t / iterations);
+
+  /* The whole of uip_input() for a segment on a random connection */
+  hits = 0;
+  t = host_cpu_ns();
+  for(i = 0; i < iterations; i++) {
+    c = order[i % BENCH_ORDER];
+    memcpy(uip_buf, peers[c].hdr, FRAME_TCPDATA);
+    frame_put32(&uip_buf[FRAME_SEQ], peers[c].seq);
+    uip_len = frame_len;
+    uip_input();
+    peers[c].seq += BENCH_DATA;
+    /* Answered by an ACK for the data */
+    hits += uip_len != 0 &&
+      frame_get32(&uip_buf[FRAME_ACK]) == peers[c].seq;
+  }
+  t = host_cpu_ns() - t;
+  CHECK(hits == iterations);
+  printf("  %-24s %8.1f ns/packet\n", "uip_input(), 64 bytes",
+	 (double)t / iterations);
+
+  return check_failures != 0;
+}
@@ -0,0 +1,179 @@
+#include "host.h"
+#include "board.h"
+#include "encsim.h"
+#include "enc28j60.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* common.h maps printf to UARTprintf for the target. stdio.h has
+ * been included by host.h already. */
+#undef printf
+
+/*
+ * The SPI traffic enc28j60.c causes per packet, against the ENC28J60
+ * model: transactions and bytes on the bus, of which buffer memory
+ * data, SRAM bytes, and the ERXRDPT updates that release ring space,
+ * for the packets the web server mostly sees, one at a time and in
+ * bursts.
+ * CPU time covers the driver, uIP and the model clocking each byte,
+ * so it only compares driver variants with each other.
+ */
+
+#define BENCH_PORT	80
+#define BENCH_MSS	512
+
+/* Accepts data and answers nothing but the ACK */
+void
+bench_appcall(void) {
+}
+
+/* Frames transmitted by the model, and the last of them */
+static unsigned sent_count;
+static uint8_t sent[1518];
+
+static void
+capture(const uint8_t *f, uint16_t len) {
+  memcpy(sent, f, len);
+  sent_count++;
+}
+
+static uint8_t frame[UIP_BUFSIZE];
+
+/* Counters at the start of a run */
+static struct encsim_stats sim_start;
+static struct board_stats board_start;
+static uint64_t ns;
+
+static void
+start(void) {
+  encsim_get_stats(&sim_start);
+  board_get_stats(&board_start);
+  ns = 0;
+}
+
+/* Receive 'count' frames of 'len' bytes, then let the driver handle
+ * them. Only the latter is timed. Returns the number of frames sent
+ * in reply. */
+static unsigned
+deliver(uint16_t len, unsigned count) {
+  unsigned before = sent_count;
+  uint64_t t;
+
+  while(count--) {
+    board_receive(frame, len);
+  }
+  t = host_cpu_ns();
+  board_run();
+  ns += host_cpu_ns() - t;
+  return sent_count - before;
+}
+
+static void
+report(const char *name, unsigned long n) {
+  struct encsim_stats sim;
+  struct board_stats board;
+
+  encsim_get_stats(&sim);
+  board_get_stats(&board);
+  printf("  %-24s %6.2f %8.1f %8.1f %8.1f %6.3f %9.1f\n", name,
+	 (double)(sim.transactions - sim_start.transactions) / n,
+	 (double)(sim.bytes - sim_start.bytes) / n,
+	 (double)(sim.buffer_bytes - sim_start.buffer_bytes) / n,
+	 (double)(board.sram_bytes - board_start.sram_bytes) / n,
+	 (double)(sim.rx_releases - sim_start.rx_releases) / n,
+	 (double)ns / n);
+  /* Every frame is still counted off on its own */
+  CHECK(sim.rx_pktdecs - sim_start.rx_pktdecs == n);
+}
+
+int
+main(int argc, char **argv) {
+  unsigned long iterations = argc > 1 ? strtoul(argv[1], NULL, 0) : 10000;
+  unsigned long i;
+  struct encsim_stats sim;
+  struct board_stats board;
+  uint32_t seq, ack;
+  uint16_t len;
+  bool ok;
+
+  board_init();
+  host_uip_init();
+  enc_init(host_mac);
+  encsim_set_tx_callback(capture);
+  uip_listen(HTONS(BENCH_PORT));
+
+  printf("enc28j60.c with ENC_RX_BURST=%d, %lu packets each\n",
+	 ENC_RX_BURST, iterations);
+  printf("  %-24s %6s %8s %8s %8s %6s %9s\n", "per packet", "trans",
+	 "bytes", "buffer", "sram", "rdpt", "ns");
+
+  /* The peer's address is learnt from its request only */
+  CHECK(deliver(frame_arp_request(frame), 1) == 1);
+
+  /* Echo request and reply */
+  len = frame_icmp_echo(frame, 1, 56);
+  start();
+  ok = true;
+  for(i = 0; i < iterations; i++) {
+    ok = ok && deliver(len, 1) == 1;
+  }
+  CHECK(ok);
+  report("ICMP echo, 56 bytes", iterations);
+
+  /* In-order data on an established connection, answered by an ACK */
+  seq = 1000;
+  CHECK(deliver(frame_tcp(frame, 0, 40000, BENCH_PORT, seq, 0,
+			  TCP_SYN, 0), 1) == 1);
+  ack = frame_get32(sent + FRAME_SEQ) + 1;
+  seq++;
+  CHECK(deliver(frame_tcp(frame, 0, 40000, BENCH_PORT, seq, ack,
+			  TCP_ACK, 0), 1) == 0);
+  start();
+  ok = true;
+  for(i = 0; i < iterations; i++) {
+    len = frame_tcp(frame, 0, 40000, BENCH_PORT, seq, ack,
+		    TCP_ACK | TCP_PSH, BENCH_MSS);
+    ok = ok && deliver(len, 1) == 1 &&
+      frame_get32(sent + FRAME_ACK) == seq + BENCH_MSS;
+    seq += BENCH_MSS;
+  }
+  CHECK(ok);
+  report("TCP data, 512 bytes", iterations);
+
+  /* Dropped by the driver from its headers */
+  len = frame_udp(frame, 5000, 5001, 400);
+  start();
+  ok = true;
+  for(i = 0; i < iterations; i++) {
+    ok = ok && deliver(len, 1) == 0;
+  }
+  CHECK(ok);
+  report("UDP to closed port", iterations);
+
+  /* Several frames waiting when the driver gets to run */
+  len = frame_icmp_echo(frame, 2, 56);
+  start();
+  ok = true;
+  for(i = 0; i < iterations / 8; i++) {
+    ok = ok && deliver(len, 8) == 8;
+  }
+  CHECK(ok);
+  report("ICMP echo, 8 at a time", iterations / 8 * 8);
+
+  len = frame_udp(frame, 5000, 5001, 100);
+  start();
+  ok = true;
+  for(i = 0; i < iterations / 8; i++) {
+    ok = ok && deliver(len, 8) == 0;
+  }
+  CHECK(ok);
+  report("UDP dropped, 8 at a time", iterations / 8 * 8);
+
+  encsim_get_stats(&sim);
+  board_get_stats(&board);
+  CHECK(sim.protocol_errors == 0 && board.bus_errors == 0);
+  CHECK(sim.rx_overflows == 0);
+
+  return check_failures != 0;
+}
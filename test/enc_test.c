@@ -0,0 +1,434 @@
+#include "host.h"
+#include "board.h"
+#include "encsim.h"
+#include "enc28j60.h"
+#include "enc28j60reg.h"
+
+#include <string.h>
+
+/* common.h maps printf to UARTprintf for the target. stdio.h has
+ * been included by host.h already. */
+#undef printf
+
+/*
+ * enc28j60.c against the ENC28J60 model, with uIP on top: address
+ * resolution, ping and TCP echo through the driver, the frames it
+ * drops early, the RX ring wrapping, bursts, spilling to SRAM and
+ * overflows, transmit errors and link changes.
+ */
+
+#define ECHO_PORT	7
+
+/* The buffer memory layout of enc28j60.c */
+#define TX_START	(0x2000 - ENC_TX_SLOTS * 0x600)
+#define RX_END		(TX_START - UIP_CONNS * ENC_REXMIT_SLOT_SIZE - 1)
+
+/* The longest frame, without the CRC */
+#define MAX_FRAME	1514
+
+void
+test_appcall(void) {
+  if(uip_newdata()) {
+    uip_send(uip_appdata, uip_datalen());
+  }
+}
+
+/* Frames transmitted by the model */
+#define SENT_MAX	64
+
+static struct {
+  uint8_t data[1518];
+  uint16_t len;
+} sent[SENT_MAX];
+static unsigned sent_count;
+
+/* The last SENT_MAX of them are kept */
+static void
+capture(const uint8_t *f, uint16_t len) {
+  memcpy(sent[sent_count % SENT_MAX].data, f, len);
+  sent[sent_count % SENT_MAX].len = len;
+  sent_count++;
+}
+
+#define LAST_SENT(n)	(sent[(sent_count - (n)) % SENT_MAX].data)
+
+static uint8_t frame[UIP_BUFSIZE];
+
+/* Receive 'len' bytes of 'frame' and let the driver handle them.
+ * Returns the number of frames sent in reply. */
+static unsigned
+deliver(uint16_t len) {
+  unsigned before = sent_count;
+
+  board_receive(frame, len);
+  board_run();
+  return sent_count - before;
+}
+
+static void
+test_init(void) {
+  board_init();
+  host_uip_init();
+  enc_init(host_mac);
+  encsim_set_tx_callback(capture);
+  uip_listen(HTONS(ECHO_PORT));
+
+  CHECK(encsim_reg16(0, ENC_ERXSTL) == 0);
+  CHECK(encsim_reg16(0, ENC_ERXNDL) == RX_END);
+  CHECK(encsim_reg16(0, ENC_ERXRDPTL) == 0);
+  CHECK(encsim_reg(0, ENC_ECON1) & ENC_ECON1_RXEN);
+  CHECK((encsim_reg(0, ENC_EIE) & (ENC_EIE_INTIE | ENC_EIE_PKTIE)) ==
+	(ENC_EIE_INTIE | ENC_EIE_PKTIE));
+  CHECK(encsim_reg(3, ENC_MAADR1) == host_mac[0] &&
+	encsim_reg(3, ENC_MAADR6) == host_mac[5]);
+  /* Half duplex, without loopback */
+  CHECK(!(encsim_reg(2, ENC_MACON3) & ENC_MACON3_FULDPX));
+  CHECK(encsim_phy(ENC_PHCON2) & ENC_PHCON2_HDLDIS);
+  CHECK(encsim_reg16(2, ENC_MAMXFLL) == 1518);
+  CHECK(enc_link_up());
+
+  CHECK(enc_spi_test() == 0);
+}
+
+static void
+test_arp(void) {
+  const uint8_t *f;
+
+  CHECK(deliver(frame_arp_request(frame)) == 1);
+  f = LAST_SENT(1);
+  CHECK(memcmp(f, peer_mac, 6) == 0 && memcmp(f + 6, host_mac, 6) == 0);
+  CHECK(frame_get16(f + 12) == 0x0806 && frame_get16(f + 20) == 2);
+  CHECK(memcmp(f + 28, host_ip, 4) == 0 && memcmp(f + 38, peer_ip, 4) == 0);
+}
+
+/* Send an echo request and check the reply */
+static bool
+ping(uint16_t seq, uint16_t len) {
+  const uint8_t *f;
+
+  if(deliver(frame_icmp_echo(frame, seq, len)) != 1) {
+    return false;
+  }
+  f = LAST_SENT(1);
+  return f[FRAME_TCP] == 0 && frame_get16(f + FRAME_TCP + 6) == seq &&
+    frame_checksums_ok(f) &&
+    memcmp(f + FRAME_TCP + 8, frame + FRAME_TCP + 8, len) == 0;
+}
+
+static void
+test_ping(void) {
+  struct enc_tx_stats tx;
+
+  CHECK(ping(1, 56));
+  CHECK(ping(2, 0));
+  CHECK(ping(3, 1472));
+  enc_get_tx_stats(&tx);
+  CHECK(tx.frames == 4 && tx.errors == 0);
+}
+
+static void
+test_tcp(void) {
+  struct enc_rexmit_stats rexmit;
+  const uint8_t *f;
+  uint32_t seq, ack;
+  clock_time_t t;
+  unsigned before;
+  int c, round;
+
+  /* The SYN-ACK checksum comes from the DMA engine */
+  seq = 1000;
+  CHECK(deliver(frame_tcp(frame, 0, 40000, ECHO_PORT, seq, 0,
+			  TCP_SYN, 0)) == 1);
+  f = LAST_SENT(1);
+  CHECK(f[FRAME_FLAGS] == (TCP_SYN | TCP_ACK) && frame_checksums_ok(f));
+  ack = frame_get32(f + FRAME_SEQ) + 1;
+  seq++;
+  CHECK(deliver(frame_tcp(frame, 0, 40000, ECHO_PORT, seq, ack,
+			  TCP_ACK, 0)) == 0);
+
+  /* Echoed, and kept in the retransmission slot */
+  CHECK(deliver(frame_tcp(frame, 0, 40000, ECHO_PORT, seq, ack,
+			  TCP_ACK | TCP_PSH, 300)) == 1);
+  f = LAST_SENT(1);
+  CHECK(frame_get16(f + FRAME_IP + 2) == 40 + 300 &&
+	frame_get32(f + FRAME_ACK) == seq + 300 && frame_checksums_ok(f));
+  CHECK(memcmp(f + FRAME_TCPDATA, frame + FRAME_TCPDATA, 300) == 0);
+  enc_get_rexmit_stats(&rexmit);
+  CHECK(rexmit.stored == 1);
+
+  /* Not acknowledged: sent again from buffer memory */
+  for(c = 0; c < UIP_CONNS; c++) {
+    if(uip_conns[c].lport == HTONS(ECHO_PORT) &&
+       uip_conns[c].tcpstateflags == UIP_ESTABLISHED) {
+      break;
+    }
+  }
+  CHECK(c < UIP_CONNS);
+  before = sent_count;
+  for(round = 0; round < 10 && sent_count == before; round++) {
+    if(uip_tcp_deadline(&uip_conns[c], &t)) {
+      host_clock = t;
+    }
+    uip_periodic(c);
+    if(uip_len > 0) {
+      uip_arp_out();
+      enc_send_packet(uip_buf, uip_len);
+      uip_len = 0;
+    }
+    board_run();
+  }
+  CHECK(sent_count == before + 1);
+  CHECK(memcmp(LAST_SENT(1), LAST_SENT(2), FRAME_TCPDATA + 300) == 0);
+  enc_get_rexmit_stats(&rexmit);
+  CHECK(rexmit.hits == 1);
+
+  seq += 300;
+  ack += 300;
+  CHECK(deliver(frame_tcp(frame, 0, 40000, ECHO_PORT, seq, ack,
+			  TCP_ACK | TCP_FIN, 0)) == 1);
+}
+
+static void
+test_drop(void) {
+  struct enc_rx_stats before, after;
+  uint16_t n;
+
+  enc_get_rx_stats(&before);
+
+  CHECK(deliver(frame_udp(frame, 5000, 5001, 400)) == 0);
+  CHECK(deliver(frame_tcp(frame, 0, 40001, ECHO_PORT + 1, 1, 1,
+			  TCP_RST, 0)) == 0);
+
+  n = frame_tcp(frame, 0, 40002, ECHO_PORT, 1, 0, TCP_SYN, 100);
+  frame[n - 1] ^= 0x55;
+  CHECK(deliver(n) == 0);
+
+  n = frame_udp(frame, 5000, 5001, 400);
+  frame_put16(frame + 12, 0x86DD);
+  CHECK(deliver(n) == 0);
+
+  enc_get_rx_stats(&after);
+  CHECK(after.drop_udp_port == before.drop_udp_port + 1);
+  CHECK(after.drop_tcp_port == before.drop_tcp_port + 1);
+  CHECK(after.drop_checksum == before.drop_checksum + 1);
+  CHECK(after.drop_ethertype == before.drop_ethertype + 1);
+  CHECK(after.bytes_skipped > before.bytes_skipped + 400);
+  CHECK(after.frames == before.frames);
+}
+
+/* One frame at a time, round the ring several times */
+static void
+test_wrap(void) {
+  struct encsim_stats sim;
+  uint16_t seq, rdpt;
+  bool ok = true;
+
+  for(seq = 100; seq < 140; seq++) {
+    ok = ok && ping(seq, 900 + seq);
+  }
+  CHECK(ok);
+  encsim_get_stats(&sim);
+  CHECK(sim.rx_wraps >= 5);
+  CHECK(encsim_reg(1, ENC_EPKTCNT) == 0);
+  /* ERXRDPT stays odd (errata 14) */
+  rdpt = encsim_reg16(0, ENC_ERXRDPTL);
+  CHECK(rdpt & 1);
+}
+
+/* Fill the ring before the driver gets to run. The replies must
+ * come in order. */
+static unsigned
+flood(uint16_t seq, uint16_t len, unsigned max, unsigned *received) {
+  unsigned i, before = sent_count;
+  bool ok = true;
+
+  *received = 0;
+  for(i = 0; i < max; i++) {
+    frame_icmp_echo(frame, seq + i, len);
+    if(board_receive(frame, FRAME_TCP + 8 + len)) {
+      (*received)++;
+    }
+  }
+  board_run();
+  for(i = before; i < sent_count && i - before < SENT_MAX; i++) {
+    ok = ok && frame_get16(sent[i % SENT_MAX].data + FRAME_TCP + 6) ==
+      seq + i - before && frame_checksums_ok(sent[i % SENT_MAX].data);
+  }
+  CHECK(ok);
+  return sent_count - before;
+}
+
+static void
+test_burst(void) {
+  struct enc_spill_stats spill;
+  unsigned received;
+
+  /* Fewer than a burst, well under the spill watermark */
+  CHECK(flood(200, 200, 6, &received) == 6 && received == 6);
+
+  /* Transmissions take their time on the wire */
+  encsim_set_tx_delay(true, 10000000);
+  CHECK(flood(300, 100, 12, &received) == 12 && received == 12);
+  encsim_set_tx_delay(false, 0);
+
+  enc_get_spill_stats(&spill);
+  CHECK(spill.spilled == 0);
+}
+
+static void
+test_spill(void) {
+  struct enc_spill_stats spill;
+  struct encsim_stats sim;
+  struct board_stats board;
+  unsigned received, n;
+
+  /* Past the high watermark, but without losses */
+  n = (RX_END + 1) * 7 / 8 / (6 + FRAME_TCP + 8 + 100 + 4);
+  CHECK(flood(400, 100, n, &received) == n && received == n);
+  enc_get_spill_stats(&spill);
+  CHECK(spill.spilled > 0 && spill.replayed == spill.spilled);
+  CHECK(spill.dropped == 0);
+  board_get_stats(&board);
+  CHECK(board.sram_bytes > spill.spilled * 100);
+
+  /* More than fits: the ring overflows, only the frames it took
+   * are answered, and the driver carries on */
+  CHECK(flood(500, 300, 20, &received) == received && received < 20);
+  encsim_get_stats(&sim);
+  enc_get_spill_stats(&spill);
+  CHECK(sim.rx_overflows > 0 && spill.dropped > 0);
+  CHECK(ping(600, 64));
+}
+
+/* Back-to-back frames of the maximum length: the ring takes at least
+ * the ENC_RX_MIN worth, the rest overflow, and each round starts at
+ * a different place in the ring */
+static void
+test_overflow(void) {
+  struct encsim_stats before, after;
+  unsigned received, round;
+  bool ok = true;
+
+  CHECK(RX_END + 1 >= ENC_RX_MIN);
+  encsim_get_stats(&before);
+  for(round = 0; round < 6; round++) {
+    ok = ok && flood(1000 + 16 * round, MAX_FRAME - FRAME_TCP - 8, 6,
+		     &received) == received &&
+      received >= ENC_RX_MIN / (6 + MAX_FRAME + 4) && received < 6;
+    ok = ok && ping(1100 + round, 100 + 250 * round);
+  }
+  CHECK(ok);
+  encsim_get_stats(&after);
+  CHECK(after.rx_overflows > before.rx_overflows);
+  CHECK(encsim_reg(1, ENC_EPKTCNT) == 0);
+}
+
+static void
+test_tx_error(void) {
+  struct enc_tx_stats before, after;
+
+  enc_get_tx_stats(&before);
+  encsim_fail_tx(1);
+  CHECK(deliver(frame_icmp_echo(frame, 700, 64)) == 0);
+  CHECK(ping(701, 64));
+  enc_get_tx_stats(&after);
+  CHECK(after.errors == before.errors + 1);
+  CHECK(after.frames == before.frames + 1);
+}
+
+/* Link changes reported to the callback, as 'u' and 'd' */
+static char link_changes[8];
+static unsigned link_count;
+
+static void
+link_changed(bool up) {
+  if(link_count < sizeof(link_changes)) {
+    link_changes[link_count++] = up ? 'u' : 'd';
+  }
+}
+
+static void
+test_link(void) {
+  struct enc_tx_stats before, after;
+
+  enc_set_link_callback(link_changed);
+  encsim_set_link(false);
+  board_run();
+  CHECK(!enc_link_up());
+  encsim_set_link(true);
+  board_run();
+  CHECK(enc_link_up());
+  CHECK(!(encsim_reg(2, ENC_MACON3) & ENC_MACON3_FULDPX));
+  CHECK(ping(800, 64));
+  CHECK(link_count == 2 && memcmp(link_changes, "du", 2) == 0);
+
+  /* A reply that never finishes going out as the link drops. When
+   * the link returns, the duplex mode is applied again once the
+   * transmitter has been given up on. */
+  enc_get_tx_stats(&before);
+  encsim_stall_tx(true);
+  CHECK(deliver(frame_icmp_echo(frame, 801, 64)) == 0);
+  CHECK(encsim_tx_busy());
+  encsim_stall_tx(false);
+  encsim_set_link(false);
+  board_run();
+  encsim_set_link(true);
+  board_run();
+  CHECK(enc_link_up() && !encsim_tx_busy());
+  CHECK(link_count == 4 && memcmp(link_changes, "dudu", 4) == 0);
+  enc_get_tx_stats(&after);
+  CHECK(after.timeouts == before.timeouts + 1);
+  CHECK(after.errors == before.errors + 1);
+  CHECK(ping(802, 64));
+  enc_set_link_callback(NULL);
+}
+
+static void
+test_filter(void) {
+  struct encsim_stats before, after;
+
+  enc_filter_arp(host_ip);
+  encsim_get_stats(&before);
+
+  CHECK(deliver(frame_arp_request(frame)) == 1);
+  frame[41] = host_ip[3] + 1;
+  CHECK(deliver(60) == 0);
+  frame_udp(frame, 67, 68, 300);
+  memset(frame, 0xFF, 6);
+  CHECK(deliver(FRAME_TCP + 8 + 300) == 0);
+  CHECK(ping(900, 64));
+
+  encsim_get_stats(&after);
+  CHECK(after.rx_filtered == before.rx_filtered + 2);
+}
+
+int
+main(void) {
+  struct enc_spi_stats spi;
+  struct encsim_stats sim;
+  struct board_stats board;
+
+  test_init();
+  test_arp();
+  test_ping();
+  test_tcp();
+  test_drop();
+  test_wrap();
+  test_burst();
+  test_spill();
+  test_overflow();
+  test_tx_error();
+  test_link();
+  test_filter();
+
+  /* The driver counts every transaction the model sees */
+  enc_get_spi_stats(&spi);
+  encsim_get_stats(&sim);
+  board_get_stats(&board);
+  CHECK(spi.transactions == sim.transactions);
+  CHECK(sim.protocol_errors == 0);
+  CHECK(board.bus_errors == 0);
+
+  printf("enc_test: %s\n", check_failures ? "FAILED" : "passed");
+  return check_failures != 0;
+}
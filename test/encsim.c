@@ -0,0 +1,802 @@
+#include "encsim.h"
+#include "enc28j60reg.h"
+
+#include <string.h>
+
+/*
+ * The register addresses and bits are taken from the driver's
+ * enc28j60reg.h, so a wrong address there goes unnoticed here.
+ * Everything else follows the data sheet (DS39662E).
+ */
+
+#define MEM_SIZE	0x2000
+#define MEM_MASK	0x1FFF
+
+/* SPI opcodes, in the top three bits of the first byte */
+#define OP_RCR		0
+#define OP_RBM		1
+#define OP_WCR		2
+#define OP_WBM		3
+#define OP_BFS		4
+#define OP_BFC		5
+#define OP_SRC		7
+
+#define ARG_BM		0x1A
+
+/* First of the registers present in every bank */
+#define COMMON		0x1B
+
+#define MIN_FRAME	60
+#define MAX_FRAME	1518
+#define CRC_LEN		4
+
+/* Receive status vector bits, above the byte count */
+#define RSV_OK		(1UL << 23)
+#define RSV_MULTICAST	(1UL << 24)
+#define RSV_BROADCAST	(1UL << 25)
+
+/* Transmit status vector bits */
+#define TSV_DONE	(1UL << 23)
+#define TSV_MULTICAST	(1UL << 24)
+#define TSV_BROADCAST	(1UL << 25)
+#define TSV_EXCOL	(1UL << 28)
+
+/* PHY registers and bits the driver does not define */
+#define PHID1		0x02
+#define PHID2		0x03
+#define PHIR_PGIF	(1 << 2)
+#define PHIR_PLNKIF	(1 << 4)
+
+#define EREVID_B7	0x06
+
+static uint8_t mem[MEM_SIZE];
+static uint8_t banked[4][COMMON];
+static uint8_t common[0x20 - COMMON];
+static uint16_t phy[0x20];
+static bool link = true;
+
+/* ERXRDPTL only takes effect with ERXRDPTH */
+static uint8_t rxrdpt_low;
+
+/* The transaction in progress */
+static bool selected;
+static uint16_t position;
+static uint8_t opcode;
+static uint8_t arg;
+
+/* The transmission in progress */
+static bool tx_busy;
+static uint32_t tx_remaining;
+static bool tx_delay;
+static uint32_t tx_spi_rate;
+static uint8_t tx_failures;
+static bool tx_stall;
+static bool tx_stalled;		/* The transmission in progress is stuck */
+static encsim_tx_callback_t tx_callback;
+
+static struct encsim_stats stats;
+
+static uint8_t *
+reg_ptr(uint8_t bank, uint8_t addr) {
+  if(addr >= COMMON) {
+    return &common[addr - COMMON];
+  }
+  return &banked[bank][addr];
+}
+
+#define REG(bank, addr)	(*reg_ptr(bank, addr))
+#define ECON1		common[ENC_ECON1 - COMMON]
+#define ECON2		common[ENC_ECON2 - COMMON]
+#define ESTAT		common[ENC_ESTAT - COMMON]
+#define EIR		common[ENC_EIR - COMMON]
+#define EIE		common[ENC_EIE - COMMON]
+#define EPKTCNT		banked[1][ENC_EPKTCNT]
+
+static uint16_t
+get16(uint8_t bank, uint8_t addr_l) {
+  return banked[bank][addr_l] | (banked[bank][addr_l + 1] << 8);
+}
+
+static void
+set16(uint8_t bank, uint8_t addr_l, uint16_t value) {
+  banked[bank][addr_l] = value & 0xFF;
+  banked[bank][addr_l + 1] = value >> 8;
+}
+
+/* MAC, MII and PHY address registers answer reads with a dummy
+ * byte first */
+static bool
+is_mac_reg(uint8_t bank, uint8_t addr) {
+  if(addr >= COMMON) {
+    return false;
+  }
+  return bank == 2 || (bank == 3 && (addr <= ENC_MAADR2 ||
+				     addr == ENC_MISTAT));
+}
+
+/* Registers holding the high byte of a buffer memory address */
+static bool
+is_pointer_high(uint8_t bank, uint8_t addr) {
+  return bank == 0 && addr < ENC_EDMACSL && (addr & 1);
+}
+
+static void
+reset_registers(void) {
+  memset(banked, 0, sizeof(banked));
+  memset(common, 0, sizeof(common));
+  ECON2 = ENC_ECON2_AUTOINC;
+  ESTAT = ENC_ESTAT_CLKRDY;
+  set16(0, ENC_ERDPTL, 0x05FA);
+  set16(0, ENC_ERXNDL, MEM_MASK);
+  set16(0, ENC_ERXRDPTL, 0x05FA);
+  banked[1][ENC_ERXFCON] = ENC_ERXFCON_UCEN | ENC_ERXFCON_CRCEN |
+    ENC_ERXFCON_BCEN;
+  set16(2, ENC_MAMXFLL, 0x0600);
+  banked[3][ENC_EREVID] = EREVID_B7;
+
+  memset(phy, 0, sizeof(phy));
+  phy[PHID1] = 0x0083;
+  phy[PHID2] = 0x1400;
+
+  tx_busy = false;
+}
+
+void
+encsim_init(void) {
+  memset(mem, 0, sizeof(mem));
+  memset(&stats, 0, sizeof(stats));
+  selected = false;
+  link = true;
+  tx_delay = false;
+  tx_failures = 0;
+  tx_stall = false;
+  tx_callback = NULL;
+  reset_registers();
+}
+
+/*---------------------------------------------------------------------------*/
+/* Receive ring */
+
+static uint16_t
+rx_start(void) {
+  return get16(0, ENC_ERXSTL);
+}
+
+static uint16_t
+rx_end(void) {
+  return get16(0, ENC_ERXNDL);
+}
+
+/* The address after 'addr', wrapping from ERXND to ERXST like
+ * the read pointer and the DMA engine do */
+static uint16_t
+ring_next(uint16_t addr) {
+  if(addr == rx_end()) {
+    return rx_start();
+  }
+  return (addr + 1) & MEM_MASK;
+}
+
+/* Bytes the hardware may write before reaching ERXRDPT */
+static uint16_t
+rx_free(void) {
+  uint16_t size = rx_end() - rx_start() + 1;
+  uint16_t wrpt = get16(0, ENC_ERXWRPTL) - rx_start();
+  uint16_t rdpt = get16(0, ENC_ERXRDPTL) - rx_start();
+
+  return (rdpt + 2 * size - wrpt - 1) % size;
+}
+
+/* Size of a frame in the ring: header, frame with CRC, and
+ * padding to an even address */
+static uint16_t
+rx_need(uint16_t len) {
+  if(len < MIN_FRAME) {
+    len = MIN_FRAME;
+  }
+  return (6 + len + CRC_LEN + 1) & ~1;
+}
+
+bool
+encsim_rx_room(uint16_t len) {
+  return EPKTCNT < 255 && rx_need(len) <= rx_free();
+}
+
+static uint32_t
+crc32(const uint8_t *p, uint16_t len) {
+  uint32_t crc = 0xFFFFFFFF;
+  int i;
+
+  while(len--) {
+    crc ^= *p++;
+    for(i = 0; i < 8; i++) {
+      crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+    }
+  }
+  return ~crc;
+}
+
+/* Checksum over the bytes the pattern mask selects, as the DMA
+ * engine computes it. 'len' includes the CRC, so the window fits
+ * a frame of the minimum size. */
+static bool
+pattern_match(const uint8_t *f, uint16_t len) {
+  uint16_t offset = get16(1, ENC_EPMOL);
+  uint32_t sum = 0;
+  bool high = true;
+  int i;
+
+  if(offset + 64 > len) {
+    return false;
+  }
+  for(i = 0; i < 64; i++) {
+    if(banked[1][ENC_EPMM0 + i / 8] & (1 << (i % 8))) {
+      sum += high ? f[offset + i] << 8 : f[offset + i];
+      high = !high;
+    }
+  }
+  while(sum >> 16) {
+    sum = (sum & 0xFFFF) + (sum >> 16);
+  }
+  return (~sum & 0xFFFF) == get16(1, ENC_EPMCSL);
+}
+
+static bool
+is_broadcast(const uint8_t *f) {
+  static const uint8_t all[6] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+
+  return memcmp(f, all, 6) == 0;
+}
+
+/* The receive filters of ERXFCON, for a frame of 'len' bytes with
+ * its CRC. The hash table and magic packet filters never match, and
+ * the CRC is always valid. */
+static bool
+rx_filter(const uint8_t *f, uint16_t len) {
+  uint8_t fcon = banked[1][ENC_ERXFCON];
+  uint8_t mac[6];
+  bool any = false, all = true, match;
+
+  if((fcon & ~(ENC_ERXFCON_CRCEN | ENC_ERXFCON_ANDOR)) == 0) {
+    /* Promiscuous */
+    return true;
+  }
+
+  mac[0] = banked[3][ENC_MAADR1];
+  mac[1] = banked[3][ENC_MAADR2];
+  mac[2] = banked[3][ENC_MAADR3];
+  mac[3] = banked[3][ENC_MAADR4];
+  mac[4] = banked[3][ENC_MAADR5];
+  mac[5] = banked[3][ENC_MAADR6];
+
+#define FILTER(bit, cond) do {			\
+    if(fcon & (bit)) {				\
+      match = (cond);				\
+      any = any || match;			\
+      all = all && match;			\
+    }						\
+  } while(0)
+
+  FILTER(ENC_ERXFCON_UCEN, memcmp(f, mac, 6) == 0);
+  FILTER(ENC_ERXFCON_PMEN, pattern_match(f, len));
+  FILTER(ENC_ERXFCON_MPEN, false);
+  FILTER(ENC_ERXFCON_HTEN, false);
+  FILTER(ENC_ERXFCON_MCEN, (f[0] & 1) && !is_broadcast(f));
+  FILTER(ENC_ERXFCON_BCEN, is_broadcast(f));
+
+#undef FILTER
+
+  return (fcon & ENC_ERXFCON_ANDOR) ? all : any;
+}
+
+bool
+encsim_receive(const uint8_t *frame, uint16_t len) {
+  uint8_t f[MAX_FRAME];
+  uint8_t header[6];
+  uint32_t status, crc;
+  uint16_t count, addr, next, i;
+
+  if(len > MAX_FRAME - CRC_LEN) {
+    len = MAX_FRAME - CRC_LEN;
+  }
+  memcpy(f, frame, len);
+  if(len < MIN_FRAME) {
+    memset(f + len, 0, MIN_FRAME - len);
+    len = MIN_FRAME;
+  }
+  crc = crc32(f, len);
+  for(i = 0; i < CRC_LEN; i++) {
+    f[len + i] = crc >> (8 * i);
+  }
+  count = len + CRC_LEN;
+
+  if(!(ECON1 & ENC_ECON1_RXEN) || !rx_filter(f, count)) {
+    stats.rx_filtered++;
+    return false;
+  }
+  if(!encsim_rx_room(len)) {
+    EIR |= ENC_EIR_RXERIF;
+    stats.rx_overflows++;
+    return false;
+  }
+
+  status = RSV_OK | count;
+  if(is_broadcast(f)) {
+    status |= RSV_BROADCAST;
+  } else if(f[0] & 1) {
+    status |= RSV_MULTICAST;
+  }
+
+  addr = get16(0, ENC_ERXWRPTL);
+  next = addr;
+  for(i = 0; i < rx_need(len); i++) {
+    if(next == rx_end()) {
+      stats.rx_wraps++;
+    }
+    next = ring_next(next);
+  }
+
+  header[0] = next & 0xFF;
+  header[1] = next >> 8;
+  for(i = 0; i < 4; i++) {
+    header[2 + i] = status >> (8 * i);
+  }
+  for(i = 0; i < sizeof(header); i++) {
+    mem[addr] = header[i];
+    addr = ring_next(addr);
+  }
+  for(i = 0; i < count; i++) {
+    mem[addr] = f[i];
+    addr = ring_next(addr);
+  }
+
+  set16(0, ENC_ERXWRPTL, next);
+  EPKTCNT++;
+  stats.rx_frames++;
+  return true;
+}
+
+/*---------------------------------------------------------------------------*/
+/* Transmission */
+
+static void
+tx_complete(void) {
+  uint16_t start = get16(0, ENC_ETXSTL);
+  uint16_t end = get16(0, ENC_ETXNDL);
+  uint16_t len = (end - start) & MEM_MASK;
+  uint8_t f[MAX_FRAME];
+  uint16_t addr, i, wire;
+  uint32_t status;
+
+  if(len > MAX_FRAME - CRC_LEN) {
+    len = MAX_FRAME - CRC_LEN;
+  }
+  /* The control byte at ETXST is 0: MACON3 decides padding and CRC */
+  for(i = 0, addr = (start + 1) & MEM_MASK; i < len; i++) {
+    f[i] = mem[addr];
+    addr = (addr + 1) & MEM_MASK;
+  }
+  if(len < MIN_FRAME &&
+     (banked[2][ENC_MACON3] >> ENC_MACON3_PADCFG_SHIFT) != 0) {
+    memset(f + len, 0, MIN_FRAME - len);
+    len = MIN_FRAME;
+  }
+  wire = len;
+  if(banked[2][ENC_MACON3] & ENC_MACON3_TXRCEN) {
+    wire += CRC_LEN;
+  }
+
+  status = wire;
+  if(is_broadcast(f)) {
+    status |= TSV_BROADCAST;
+  } else if(f[0] & 1) {
+    status |= TSV_MULTICAST;
+  }
+
+  if(tx_failures > 0) {
+    /* Aborted after 15 collisions */
+    tx_failures--;
+    status |= TSV_EXCOL | (15UL << 16);
+    EIR |= ENC_EIR_TXERIF;
+    ESTAT |= ENC_ESTAT_TXABRT;
+    stats.tx_errors++;
+  } else {
+    status |= TSV_DONE;
+    EIR |= ENC_EIR_TXIF;
+    stats.tx_frames++;
+  }
+
+  /* The status vector goes right after the frame */
+  addr = (end + 1) & MEM_MASK;
+  for(i = 0; i < 7; i++) {
+    mem[addr] = i < 4 ? status >> (8 * i) :
+      i < 6 ? wire >> (8 * (i - 4)) : 0;
+    addr = (addr + 1) & MEM_MASK;
+  }
+
+  ECON1 &= ~ENC_ECON1_TXRTS;
+  tx_busy = false;
+
+  if(!(status & TSV_EXCOL) && tx_callback) {
+    tx_callback(f, len);
+  }
+}
+
+static void
+tx_start(void) {
+  uint16_t len = get16(0, ENC_ETXNDL) - get16(0, ENC_ETXSTL);
+
+  tx_busy = true;
+  tx_stalled = tx_stall;
+  if(tx_stalled) {
+    return;
+  }
+  if(!tx_delay) {
+    tx_complete();
+    return;
+  }
+  /* Preamble, frame with padding and CRC, and inter-packet gap,
+   * at 10 Mbit/s, in bytes clocked at tx_spi_rate */
+  if(len < MIN_FRAME) {
+    len = MIN_FRAME;
+  }
+  tx_remaining = (uint64_t)(8 + len + CRC_LEN + 12) * tx_spi_rate / 10000000;
+  if(tx_remaining == 0) {
+    tx_complete();
+  }
+}
+
+void
+encsim_set_tx_callback(encsim_tx_callback_t callback) {
+  tx_callback = callback;
+}
+
+void
+encsim_set_tx_delay(bool delay, uint32_t spi_rate) {
+  tx_delay = delay;
+  tx_spi_rate = spi_rate;
+}
+
+bool
+encsim_tx_busy(void) {
+  return tx_busy;
+}
+
+bool
+encsim_tx_finish(void) {
+  if(!tx_busy || tx_stalled) {
+    return false;
+  }
+  tx_complete();
+  return true;
+}
+
+void
+encsim_fail_tx(uint8_t count) {
+  tx_failures = count;
+}
+
+void
+encsim_stall_tx(bool stall) {
+  tx_stall = stall;
+}
+
+/*---------------------------------------------------------------------------*/
+/* DMA */
+
+static void
+dma_run(void) {
+  uint16_t src = get16(0, ENC_EDMASTL);
+  uint16_t end = get16(0, ENC_EDMANDL);
+  uint16_t dst = get16(0, ENC_EDMADSTL);
+  uint32_t sum = 0;
+  bool high = true;
+  int n;
+
+  /* Inclusive of 'end', at most once round the memory */
+  for(n = 0; n < MEM_SIZE; n++) {
+    if(ECON1 & ENC_ECON1_CSUMEN) {
+      sum += high ? mem[src] << 8 : mem[src];
+      high = !high;
+    } else {
+      mem[dst] = mem[src];
+      dst = ring_next(dst);
+    }
+    if(src == end) {
+      break;
+    }
+    src = ring_next(src);
+  }
+
+  if(ECON1 & ENC_ECON1_CSUMEN) {
+    while(sum >> 16) {
+      sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    sum = ~sum & 0xFFFF;
+    banked[0][ENC_EDMACSH] = sum >> 8;
+    banked[0][ENC_EDMACSL] = sum & 0xFF;
+    stats.dma_checksums++;
+  } else {
+    stats.dma_copies++;
+  }
+
+  ECON1 &= ~ENC_ECON1_DMAST;
+  EIR |= ENC_EIR_DMAIF;
+}
+
+/*---------------------------------------------------------------------------*/
+/* PHY */
+
+static uint16_t
+phy_read(uint8_t addr) {
+  uint16_t value = phy[addr & 0x1F];
+
+  if(addr == ENC_PHSTAT2) {
+    value = 0;
+    if(link) {
+      value |= ENC_PHSTAT2_LSTAT;
+    }
+    if(phy[ENC_PHCON1] & ENC_PHCON_PDPXMD) {
+      value |= ENC_PHSTAT2_DPXSTAT;
+    }
+  } else if(addr == ENC_PHIR) {
+    /* Reading PHIR clears the PHY interrupt */
+    phy[ENC_PHIR] = 0;
+    EIR &= ~ENC_EIR_LINKIF;
+  }
+  return value;
+}
+
+void
+encsim_set_link(bool up) {
+  link = up;
+  phy[ENC_PHIR] |= PHIR_PGIF | PHIR_PLNKIF;
+  if((phy[ENC_PHIE] & (ENC_PHIE_PGEIE | ENC_PHIE_PLNKIE)) ==
+     (ENC_PHIE_PGEIE | ENC_PHIE_PLNKIE)) {
+    EIR |= ENC_EIR_LINKIF;
+  }
+}
+
+/*---------------------------------------------------------------------------*/
+/* Registers */
+
+static uint8_t
+read_reg(uint8_t bank, uint8_t addr) {
+  uint8_t value = REG(bank, addr);
+
+  if(addr == ENC_EIR) {
+    /* PKTIF follows the packet counter */
+    value &= ~ENC_EIR_PKTIF;
+    if(EPKTCNT > 0) {
+      value |= ENC_EIR_PKTIF;
+    }
+  } else if(addr == ENC_ESTAT) {
+    value &= ~ENC_ESTAT_INT;
+    if(encsim_int()) {
+      value |= ENC_ESTAT_INT;
+    }
+  }
+  return value;
+}
+
+static void
+write_reg(uint8_t bank, uint8_t addr, uint8_t value) {
+  uint8_t old = REG(bank, addr);
+
+  if(is_pointer_high(bank, addr)) {
+    value &= MEM_MASK >> 8;
+  }
+
+  switch(addr) {
+  case ENC_EIR:
+    /* PKTIF and LINKIF are read-only */
+    REG(bank, addr) = (old & (ENC_EIR_PKTIF | ENC_EIR_LINKIF)) |
+      (value & ~(ENC_EIR_PKTIF | ENC_EIR_LINKIF));
+    return;
+  case ENC_ESTAT:
+    /* Only the error bits can be cleared */
+    REG(bank, addr) = old & (value | ~(ENC_ESTAT_TXABRT |
+				       ENC_ESTAT_LATECOL |
+				       ENC_ESTAT_BUFFER));
+    return;
+  case ENC_ECON2:
+    if((value & ENC_ECON2_PKTDEC) && EPKTCNT > 0) {
+      EPKTCNT--;
+      stats.rx_pktdecs++;
+    }
+    ECON2 = value & ~ENC_ECON2_PKTDEC;
+    return;
+  case ENC_ECON1:
+    ECON1 = value;
+    if(value & ENC_ECON1_TXRST) {
+      /* Resetting the transmit logic aborts the transmission */
+      tx_busy = false;
+    }
+    if((value & ENC_ECON1_DMAST) && !(old & ENC_ECON1_DMAST)) {
+      dma_run();
+    }
+    if((value & ENC_ECON1_TXRTS) && !(old & ENC_ECON1_TXRTS) &&
+       !(value & ENC_ECON1_TXRST)) {
+      tx_start();
+    }
+    return;
+  }
+
+  if(addr >= COMMON) {
+    REG(bank, addr) = value;
+    return;
+  }
+
+  switch(bank) {
+  case 0:
+    switch(addr) {
+    case ENC_ERXRDPTL:
+      rxrdpt_low = value;
+      return;
+    case ENC_ERXRDPTH:
+      banked[0][ENC_ERXRDPTL] = rxrdpt_low;
+      stats.rx_releases++;
+      break;
+    case ENC_ERXWRPTL:
+    case ENC_ERXWRPTH:
+    case ENC_EDMACSL:
+    case ENC_EDMACSH:
+      return;
+    }
+    banked[0][addr] = value;
+    if(addr == ENC_ERXSTL || addr == ENC_ERXSTH) {
+      /* The write pointer follows the start of the ring */
+      set16(0, ENC_ERXWRPTL, rx_start());
+    }
+    return;
+  case 1:
+    if(addr == ENC_EPKTCNT) {
+      return;
+    }
+    break;
+  case 2:
+    if(addr == ENC_MICMD && (value & 1)) {
+      /* MIIRD: the result is ready by the time MISTAT is polled */
+      set16(2, ENC_MIRDL, phy_read(banked[2][ENC_MIREGADR]));
+    } else if(addr == ENC_MIWRH) {
+      phy[banked[2][ENC_MIREGADR] & 0x1F] =
+	banked[2][ENC_MIWRL] | (value << 8);
+    }
+    break;
+  case 3:
+    if(addr == ENC_MISTAT || addr == ENC_EREVID) {
+      return;
+    }
+    break;
+  }
+  banked[bank][addr] = value;
+}
+
+bool
+encsim_int(void) {
+  uint8_t eir = read_reg(0, ENC_EIR);
+
+  return (EIE & ENC_EIE_INTIE) && (EIE & eir & ~ENC_EIE_INTIE) != 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* SPI */
+
+void
+encsim_select(bool select) {
+  if(select && !selected) {
+    stats.transactions++;
+    position = 0;
+  }
+  selected = select;
+}
+
+uint8_t
+encsim_spi(uint8_t out) {
+  uint8_t bank = ECON1 & ENC_ECON1_BSEL_MASK;
+  uint8_t in = 0xFF;
+  uint16_t pos = position++;
+
+  stats.bytes++;
+  if(tx_busy && tx_delay && --tx_remaining == 0) {
+    tx_complete();
+  }
+  if(!selected) {
+    stats.protocol_errors++;
+    return in;
+  }
+
+  if(pos == 0) {
+    opcode = out >> 5;
+    arg = out & 0x1F;
+    if(out == 0xFF) {
+      reset_registers();
+    } else if((opcode == OP_RBM || opcode == OP_WBM) && arg != ARG_BM) {
+      stats.protocol_errors++;
+    } else if((opcode == OP_BFS || opcode == OP_BFC) &&
+	      is_mac_reg(bank, arg)) {
+      /* Bit field operations only work on ETH registers */
+      stats.protocol_errors++;
+    } else if(opcode == 6 || opcode == OP_SRC) {
+      stats.protocol_errors++;
+    }
+    return in;
+  }
+
+  switch(opcode) {
+  case OP_RCR:
+    if(pos == 1 && is_mac_reg(bank, arg)) {
+      /* The dummy byte */
+      return 0xFF;
+    }
+    return read_reg(bank, arg);
+
+  case OP_RBM:
+    if(arg == ARG_BM) {
+      uint16_t rdpt = get16(0, ENC_ERDPTL);
+
+      in = mem[rdpt];
+      if(ECON2 & ENC_ECON2_AUTOINC) {
+	set16(0, ENC_ERDPTL, ring_next(rdpt));
+      }
+      stats.buffer_bytes++;
+    }
+    return in;
+
+  case OP_WBM:
+    if(arg == ARG_BM) {
+      uint16_t wrpt = get16(0, ENC_EWRPTL);
+
+      mem[wrpt] = out;
+      if(ECON2 & ENC_ECON2_AUTOINC) {
+	set16(0, ENC_EWRPTL, (wrpt + 1) & MEM_MASK);
+      }
+      stats.buffer_bytes++;
+    }
+    return in;
+
+  case OP_WCR:
+  case OP_BFS:
+  case OP_BFC:
+    if(pos != 1) {
+      stats.protocol_errors++;
+    } else if(opcode == OP_WCR) {
+      write_reg(bank, arg, out);
+    } else if(!is_mac_reg(bank, arg)) {
+      uint8_t value = read_reg(bank, arg);
+
+      write_reg(bank, arg, opcode == OP_BFS ? value | out : value & ~out);
+    }
+    return in;
+  }
+
+  stats.protocol_errors++;
+  return in;
+}
+
+/*---------------------------------------------------------------------------*/
+
+uint8_t
+encsim_reg(uint8_t bank, uint8_t addr) {
+  return read_reg(bank, addr);
+}
+
+uint16_t
+encsim_reg16(uint8_t bank, uint8_t addr_l) {
+  return read_reg(bank, addr_l) | (read_reg(bank, addr_l + 1) << 8);
+}
+
+uint16_t
+encsim_phy(uint8_t addr) {
+  return phy[addr & 0x1F];
+}
+
+const uint8_t *
+encsim_mem(void) {
+  return mem;
+}
+
+void
+encsim_get_stats(struct encsim_stats *s) {
+  *s = stats;
+}
@@ -0,0 +1,99 @@
+#ifndef _ENCSIM_H
+#define _ENCSIM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * Behavioural model of the ENC28J60, as seen over SPI by
+ * enc28j60.c: the register banks, the 8 KB buffer memory with
+ * auto-incrementing pointers, the receive ring with its header,
+ * packet counter and filters, transmission with status vectors,
+ * the DMA copy and checksum engine, the PHY registers and the
+ * interrupt flags. Frames are received and transmitted at once,
+ * unless a transmit delay is set.
+ *
+ * Not modelled: timing, collisions, flow control, magic packet and
+ * hash table filters, and the errata, other than where the driver
+ * must work around them for the model too.
+ */
+
+/* Power on, as after a reset. The link is up. */
+void encsim_init(void);
+
+/* The SPI side: chip select and one byte in each direction */
+void encsim_select(bool selected);
+uint8_t encsim_spi(uint8_t out);
+
+/* State of the INT pin, true when asserted (driven low) */
+bool encsim_int(void);
+
+/**
+ * A frame from the wire, without its CRC, which the model adds.
+ * Frames shorter than the minimum are padded. Returns false if it
+ * was not received: filtered out, receiver off, or no room in
+ * the ring (which sets RXERIF).
+ */
+bool encsim_receive(const uint8_t *frame, uint16_t len);
+
+/* Room in the ring for a frame of 'len' bytes */
+bool encsim_rx_room(uint16_t len);
+
+/**
+ * Transmitted frames, without control byte and status vector.
+ * The callback may call encsim_receive().
+ */
+typedef void (*encsim_tx_callback_t)(const uint8_t *frame, uint16_t len);
+void encsim_set_tx_callback(encsim_tx_callback_t callback);
+
+/**
+ * With 'delay' set, a transmission completes once as many SPI bytes
+ * have been clocked as it takes on the wire at 10 Mbit/s and the
+ * given SPI clock rate, rather than at once. encsim_tx_finish()
+ * completes it earlier, as if the bus had been idle, and returns
+ * false if there was none or it is stalled.
+ */
+void encsim_set_tx_delay(bool delay, uint32_t spi_rate);
+bool encsim_tx_busy(void);
+bool encsim_tx_finish(void);
+
+/* Fail the next 'count' transmissions with TXERIF */
+void encsim_fail_tx(uint8_t count);
+
+/* Transmissions started while 'stall' is set never complete, and
+ * only setting ECON1.TXRST ends them */
+void encsim_stall_tx(bool stall);
+
+/* Change the link state, interrupting if the driver asked for it */
+void encsim_set_link(bool up);
+
+/* Direct access to state, for checking the driver */
+uint8_t encsim_reg(uint8_t bank, uint8_t addr);
+uint16_t encsim_reg16(uint8_t bank, uint8_t addr_l);
+uint16_t encsim_phy(uint8_t addr);
+const uint8_t *encsim_mem(void);
+
+/**
+ * Counters. Each chip select assertion is one transaction; bytes
+ * include the opcode bytes.
+ */
+struct encsim_stats {
+  uint32_t transactions;
+  uint32_t bytes;
+  uint32_t buffer_bytes;	/* Data bytes of RBM and WBM */
+  uint32_t protocol_errors;	/* Invalid opcodes and misplaced bytes */
+  uint32_t rx_frames;
+  uint32_t rx_filtered;
+  uint32_t rx_overflows;	/* Frames lost for lack of room */
+  uint32_t rx_wraps;		/* Frames written across the ring end */
+  uint32_t rx_releases;		/* ERXRDPT updates */
+  uint32_t rx_pktdecs;		/* EPKTCNT decrements */
+  uint32_t tx_frames;
+  uint32_t tx_errors;
+  uint32_t dma_copies;
+  uint32_t dma_checksums;
+};
+
+void encsim_get_stats(struct encsim_stats *stats);
+
+#endif
@@ -0,0 +1,187 @@
+#include "event.h"
+#include "check.h"
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/*
+ * The event ring, with a signal handler on a fast timer as the
+ * interrupt that produces events and the main program consuming
+ * them, at times too slowly to keep up.
+ */
+
+unsigned check_failures;
+
+/* Every field is derived from a sequence number, so that a torn
+ * event shows up as a mismatch */
+#define SEQ_TYPE(seq)	((uint8_t)((seq) & 1))
+#define SEQ_PINS(seq)	((uint8_t)((seq) * 7))
+
+static void
+push_seq(unsigned long seq) {
+  event_push(SEQ_TYPE(seq), SEQ_PINS(seq), seq);
+}
+
+static bool
+event_ok(const struct event *ev) {
+  return ev->type == SEQ_TYPE(ev->arg) && ev->pins == SEQ_PINS(ev->arg);
+}
+
+/* Without an interrupt: order, capacity and overflow */
+static void
+test_sequential(void) {
+  struct event ev;
+  unsigned long seq, next;
+  int round;
+
+  CHECK(!event_pending());
+  CHECK(!event_pop(&ev));
+  CHECK(!event_overflowed());
+
+  /* Go round the ring a few times, to cross the wrap */
+  next = 0;
+  for(round = 0; round < 5; round++) {
+    for(seq = next; seq < next + EVENT_QUEUE_SIZE / 2 + round; seq++) {
+      push_seq(seq);
+    }
+    CHECK(event_pending());
+    while(event_pop(&ev)) {
+      CHECK(event_ok(&ev) && ev.arg == next);
+      next++;
+    }
+    CHECK(next == seq);
+    CHECK(!event_pending());
+    CHECK(!event_overflowed());
+  }
+
+  /* One slot is always kept free */
+  for(seq = 0; seq < EVENT_QUEUE_SIZE; seq++) {
+    push_seq(seq);
+  }
+  CHECK(event_pending());
+  for(seq = 0; event_pop(&ev); seq++) {
+    CHECK(event_ok(&ev) && ev.arg == seq);
+  }
+  CHECK(seq == EVENT_QUEUE_SIZE - 1);
+  CHECK(event_pending());
+  CHECK(event_overflowed());
+  CHECK(!event_overflowed());
+  CHECK(!event_pending());
+}
+
+/* Producer side, run from the signal handler */
+static volatile unsigned long produced;
+static volatile bool producing;
+
+static void
+producer(int sig) {
+  (void)sig;
+  if(producing) {
+    push_seq(produced);
+    produced = produced + 1;
+  }
+}
+
+/* Spin for about 'ns' of CPU time, without making system calls that
+ * a signal could interrupt */
+static void
+spin(long ns) {
+  struct timespec a, b;
+
+  clock_gettime(CLOCK_MONOTONIC, &a);
+  do {
+    clock_gettime(CLOCK_MONOTONIC, &b);
+  } while((b.tv_sec - a.tv_sec) * 1000000000L + b.tv_nsec - a.tv_nsec < ns);
+}
+
+/* Consumer side: what has been seen of the sequence */
+static unsigned long expected, popped, lost, overflows, bad, disorder;
+
+static void
+drain(void) {
+  struct event ev;
+
+  while(event_pop(&ev)) {
+    popped++;
+    if(!event_ok(&ev)) {
+      bad++;
+    }
+    if(ev.arg < expected) {
+      disorder++;
+    } else {
+      lost += ev.arg - expected;
+    }
+    expected = ev.arg + 1;
+  }
+  if(event_overflowed()) {
+    overflows++;
+  }
+}
+
+static void
+test_preempted(void) {
+  struct sigaction sa = { .sa_handler = producer };
+  struct sigevent sev = { .sigev_notify = SIGEV_SIGNAL,
+			  .sigev_signo = SIGALRM };
+  struct itimerspec its = { .it_interval = { 0, 20000 },
+			    .it_value = { 0, 20000 } };
+  timer_t timer;
+  uint64_t elapsed = 0, stall = 0;
+  struct timespec start, now;
+
+  sigemptyset(&sa.sa_mask);
+  sa.sa_flags = SA_RESTART;
+  sigaction(SIGALRM, &sa, NULL);
+  if(timer_create(CLOCK_MONOTONIC, &sev, &timer) != 0) {
+    perror("timer_create");
+    check_failures++;
+    return;
+  }
+
+  producing = true;
+  timer_settime(timer, 0, &its, NULL);
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  while(elapsed < 1000000000u) {
+    drain();
+
+    /* Every 10 ms, fall behind by about two rings' worth */
+    if(elapsed >= stall) {
+      spin(EVENT_QUEUE_SIZE * 40000);
+      stall = elapsed + 10000000;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    elapsed = (now.tv_sec - start.tv_sec) * 1000000000ull +
+      now.tv_nsec - start.tv_nsec;
+  }
+
+  producing = false;
+  its.it_value.tv_nsec = its.it_interval.tv_nsec = 0;
+  timer_settime(timer, 0, &its, NULL);
+  timer_delete(timer);
+
+  /* Everything pushed has been either popped or lost */
+  drain();
+  lost += produced - expected;
+
+  printf("  %lu pushed, %lu popped, %lu lost in %lu overflows\n",
+	 produced, popped, lost, overflows);
+  CHECK(produced > 1000);
+  CHECK(bad == 0);
+  CHECK(disorder == 0);
+  CHECK(popped + lost == produced);
+  /* Losses are reported, and only losses are */
+  CHECK((lost > 0) == (overflows > 0));
+  CHECK(overflows > 0);
+}
+
+int
+main(void) {
+  test_sequential();
+  test_preempted();
+  printf("event_test: %s\n", check_failures ? "FAILED" : "passed");
+  return check_failures != 0;
+}
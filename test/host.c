@@ -0,0 +1,329 @@
+#include "host.h"
+
+#include <string.h>
+#include <time.h>
+
+#ifdef UIP_CONF_EXTERNAL_BUFFER
+#include "pktbuf.h"
+#endif
+
+clock_time_t host_clock;
+
+const uint8_t host_mac[6] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x02 };
+const uint8_t peer_mac[6] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 };
+const uint8_t host_ip[4] = { 10, 0, 0, 201 };
+const uint8_t peer_ip[4] = { 10, 0, 0, 1 };
+
+unsigned long host_log_count;
+bool host_log_print;
+
+unsigned check_failures;
+
+clock_time_t
+clock_time(void) {
+  return host_clock;
+}
+
+void
+uip_log(char *msg) {
+  host_log_count++;
+  if(host_log_print) {
+    printf("UIP: %s\n", msg);
+  }
+}
+
+/* The SPI SRAM regions main.c keeps these in, sized for any
+ * UIP_CONNS */
+#if UIP_SEND_WINDOW
+static u8_t host_window[UIP_CONNS][UIP_SEND_WINDOW][UIP_TCP_MSS];
+
+void uip_window_write(struct uip_conn *conn, u8_t slot,
+		      const void *data, u16_t len) {
+  memcpy(host_window[conn - uip_conns][slot], data, len);
+}
+
+void uip_window_read(struct uip_conn *conn, u8_t slot, u16_t offset,
+		     void *data, u16_t len) {
+  memcpy(data, host_window[conn - uip_conns][slot] + offset, len);
+}
+#endif
+
+#if UIP_ARP_QUEUE
+static u8_t host_arp_queue[UIP_ARP_QUEUE][UIP_BUFSIZE - UIP_LLH_LEN];
+
+void uip_arp_queue_write(u8_t slot, const void *data, u16_t len) {
+  memcpy(host_arp_queue[slot], data, len);
+}
+
+void uip_arp_queue_read(u8_t slot, void *data, u16_t len) {
+  memcpy(data, host_arp_queue[slot], len);
+}
+#endif
+
+#if UIP_REXMIT_CACHE
+/* Replaced by the one in enc28j60.c when the driver is linked in */
+__attribute__((weak)) int
+uip_rexmit_cache_resend(struct uip_conn *conn) {
+  (void)conn;
+  return 0;
+}
+#endif
+
+/* dhcpc.c is not linked in; the address is set by host_uip_init() */
+void
+dhcpc_appcall(void) {
+}
+
+void
+host_uip_init(void) {
+  struct uip_eth_addr eth_addr;
+  uip_ipaddr_t ipaddr;
+
+#ifdef UIP_CONF_EXTERNAL_BUFFER
+  pktbuf_init();
+#endif
+  uip_init();
+  uip_arp_init();
+
+  memcpy(eth_addr.addr, host_mac, 6);
+  uip_setethaddr(eth_addr);
+
+  uip_ipaddr(ipaddr, host_ip[0], host_ip[1], host_ip[2], host_ip[3]);
+  uip_sethostaddr(ipaddr);
+  uip_ipaddr(ipaddr, 255, 255, 255, 0);
+  uip_setnetmask(ipaddr);
+  uip_ipaddr(ipaddr, peer_ip[0], peer_ip[1], peer_ip[2], peer_ip[3]);
+  uip_setdraddr(ipaddr);
+}
+
+uint16_t
+frame_get16(const uint8_t *p) {
+  return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+uint32_t
+frame_get32(const uint8_t *p) {
+  return ((uint32_t)frame_get16(p) << 16) | frame_get16(p + 2);
+}
+
+void
+frame_put16(uint8_t *p, uint16_t v) {
+  p[0] = v >> 8;
+  p[1] = v & 0xff;
+}
+
+void
+frame_put32(uint8_t *p, uint32_t v) {
+  frame_put16(p, v >> 16);
+  frame_put16(p + 2, v & 0xffff);
+}
+
+/* A byte at a time, so as not to share any code with what is
+ * being tested */
+static uint32_t
+frame_sum(uint32_t sum, const uint8_t *p, uint16_t len) {
+  uint16_t i;
+
+  for(i = 0; i + 1 < len; i += 2) {
+    sum += frame_get16(p + i);
+  }
+  if(len & 1) {
+    sum += p[len - 1] << 8;
+  }
+  return sum;
+}
+
+static uint16_t
+frame_fold(uint32_t sum) {
+  while(sum >> 16) {
+    sum = (sum & 0xffff) + (sum >> 16);
+  }
+  return (uint16_t)~sum;
+}
+
+/* Ethernet and IP headers for 'len' bytes of 'proto' payload */
+static uint16_t
+frame_ip(uint8_t *f, uint8_t ip_last, uint8_t proto, uint16_t len) {
+  static uint16_t ipid;
+  uint8_t *ip = f + FRAME_IP;
+
+  memcpy(f, host_mac, 6);
+  memcpy(f + 6, peer_mac, 6);
+  frame_put16(f + 12, 0x0800);
+
+  memset(ip, 0, 20);
+  ip[0] = 0x45;
+  frame_put16(ip + 2, 20 + len);
+  frame_put16(ip + 4, ++ipid);
+  ip[8] = 64;
+  ip[9] = proto;
+  memcpy(ip + 12, peer_ip, 4);
+  if(ip_last != 0) {
+    ip[15] = ip_last;
+  }
+  memcpy(ip + 16, host_ip, 4);
+  frame_put16(ip + 10, frame_fold(frame_sum(0, ip, 20)));
+
+  return FRAME_IP + 20 + len;
+}
+
+/* Checksum over the pseudo header and the payload of an IP frame */
+static uint16_t
+frame_upper_sum(const uint8_t *f, uint16_t len) {
+  const uint8_t *ip = f + FRAME_IP;
+  uint32_t sum;
+
+  sum = ip[9] + len;
+  sum = frame_sum(sum, ip + 12, 8);
+  return frame_fold(frame_sum(sum, ip + 20, len));
+}
+
+/* Payload bytes, different for every frame */
+static void
+frame_fill(uint8_t *p, uint16_t len) {
+  static uint8_t fill;
+  uint16_t i;
+
+  fill++;
+  for(i = 0; i < len; i++) {
+    p[i] = fill + i;
+  }
+}
+
+uint16_t
+frame_tcp(uint8_t *f, uint8_t ip_last, uint16_t sport, uint16_t dport,
+	  uint32_t seq, uint32_t ack, uint8_t flags, uint16_t len) {
+  uint8_t *tcp = f + FRAME_TCP;
+  uint16_t n;
+
+  n = frame_ip(f, ip_last, 6, 20 + len);
+  memset(tcp, 0, 20);
+  frame_put16(tcp, sport);
+  frame_put16(tcp + 2, dport);
+  frame_put32(tcp + 4, seq);
+  frame_put32(tcp + 8, ack);
+  tcp[12] = 5 << 4;
+  tcp[13] = flags;
+  frame_put16(tcp + 14, 8192);
+  frame_fill(tcp + 20, len);
+  frame_put16(tcp + 16, frame_upper_sum(f, 20 + len));
+  return n;
+}
+
+uint16_t
+frame_icmp_echo(uint8_t *f, uint16_t seq, uint16_t len) {
+  uint8_t *icmp = f + FRAME_TCP;
+  uint16_t n;
+
+  n = frame_ip(f, 0, 1, 8 + len);
+  memset(icmp, 0, 8);
+  icmp[0] = 8;
+  frame_put16(icmp + 4, 0x1234);
+  frame_put16(icmp + 6, seq);
+  frame_fill(icmp + 8, len);
+  frame_put16(icmp + 2, frame_fold(frame_sum(0, icmp, 8 + len)));
+  return n;
+}
+
+uint16_t
+frame_udp(uint8_t *f, uint16_t sport, uint16_t dport, uint16_t len) {
+  uint8_t *udp = f + FRAME_TCP;
+  uint16_t n;
+
+  n = frame_ip(f, 0, 17, 8 + len);
+  frame_put16(udp, sport);
+  frame_put16(udp + 2, dport);
+  frame_put16(udp + 4, 8 + len);
+  frame_put16(udp + 6, 0);
+  frame_fill(udp + 8, len);
+  frame_put16(udp + 6, frame_upper_sum(f, 8 + len));
+  return n;
+}
+
+bool
+frame_checksums_ok(const uint8_t *f) {
+  const uint8_t *ip = f + FRAME_IP;
+  uint16_t len;
+
+  if(frame_get16(f + 12) != 0x0800) {
+    return true;
+  }
+  if(frame_fold(frame_sum(0, ip, 20)) != 0) {
+    return false;
+  }
+  len = frame_get16(ip + 2) - 20;
+  switch(ip[9]) {
+  case 1:
+    return frame_fold(frame_sum(0, ip + 20, len)) == 0;
+  case 17:
+    if(frame_get16(ip + 26) == 0) {
+      return true;
+    }
+    /* Fall through */
+  case 6:
+    return frame_upper_sum(f, len) == 0;
+  }
+  return true;
+}
+
+uint16_t
+frame_arp_request(uint8_t *f) {
+  uint8_t *arp = f + 14;
+
+  memset(f, 0xff, 6);
+  memcpy(f + 6, peer_mac, 6);
+  frame_put16(f + 12, 0x0806);
+
+  frame_put16(arp, 1);
+  frame_put16(arp + 2, 0x0800);
+  arp[4] = 6;
+  arp[5] = 4;
+  frame_put16(arp + 6, 1);
+  memcpy(arp + 8, peer_mac, 6);
+  memcpy(arp + 14, peer_ip, 4);
+  memset(arp + 18, 0, 6);
+  memcpy(arp + 24, host_ip, 4);
+  /* Padded to the minimum frame size */
+  memset(arp + 28, 0, 18);
+  return 60;
+}
+
+uint32_t
+host_tcp_connect(uint8_t ip_last, uint16_t sport, uint16_t port,
+		 uint32_t *ack) {
+  uint32_t seq = host_random();
+
+  uip_len = frame_tcp(uip_buf, ip_last, sport, port, seq, 0, TCP_SYN, 0);
+  uip_input();
+  if(uip_len == 0 || uip_buf[FRAME_FLAGS] != (TCP_SYN | TCP_ACK)) {
+    *ack = 0;
+    return 0;
+  }
+  *ack = frame_get32(&uip_buf[FRAME_SEQ]) + 1;
+  seq++;
+
+  uip_len = frame_tcp(uip_buf, ip_last, sport, port, seq, *ack,
+		      TCP_ACK, 0);
+  uip_input();
+  uip_len = 0;
+  return seq;
+}
+
+uint32_t
+host_random(void) {
+  static uint32_t x = 2463534242u;
+
+  /* xorshift32 */
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return x;
+}
+
+uint64_t
+host_cpu_ns(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
@@ -0,0 +1,89 @@
+#ifndef _HOST_H
+#define _HOST_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "check.h"
+#include <uip/uip.h>
+#include <uip/uip_arp.h>
+
+/**
+ * Support for running uIP, and the code around it, on the build
+ * host: the system functions uIP expects, frames from a peer on
+ * the local network, and timing.
+ */
+
+/* What clock_time() returns */
+extern clock_time_t host_clock;
+
+/* Our addresses, and those of the peer frames come from */
+extern const uint8_t host_mac[6];
+extern const uint8_t peer_mac[6];
+extern const uint8_t host_ip[4];
+extern const uint8_t peer_ip[4];
+
+/* Number of uip_log() calls; the messages are printed if set */
+extern unsigned long host_log_count;
+extern bool host_log_print;
+
+/**
+ * Bring up uIP with host_ip and host_mac, as main() does once DHCP
+ * has completed.
+ */
+void host_uip_init(void);
+
+/**
+ * Frames from the peer to us, with valid checksums. Each returns
+ * the length of the frame written to 'f', Ethernet header included.
+ * 'ip_last' is the last byte of the peer's address, or 0 for
+ * peer_ip.
+ */
+#define TCP_FIN		0x01
+#define TCP_SYN		0x02
+#define TCP_RST		0x04
+#define TCP_PSH		0x08
+#define TCP_ACK		0x10
+
+uint16_t frame_tcp(uint8_t *f, uint8_t ip_last, uint16_t sport,
+		   uint16_t dport, uint32_t seq, uint32_t ack,
+		   uint8_t flags, uint16_t len);
+uint16_t frame_icmp_echo(uint8_t *f, uint16_t seq, uint16_t len);
+uint16_t frame_udp(uint8_t *f, uint16_t sport, uint16_t dport,
+		   uint16_t len);
+uint16_t frame_arp_request(uint8_t *f);
+
+/* Whether the IP header checksum, and that of TCP, UDP or ICMP,
+ * are valid. Frames other than IP pass. */
+bool frame_checksums_ok(const uint8_t *f);
+
+/* Field access for frames in either direction */
+uint16_t frame_get16(const uint8_t *p);
+uint32_t frame_get32(const uint8_t *p);
+void frame_put16(uint8_t *p, uint16_t v);
+void frame_put32(uint8_t *p, uint32_t v);
+
+/* Offsets into a TCP/IP frame */
+#define FRAME_IP	14
+#define FRAME_PROTO	(FRAME_IP + 9)
+#define FRAME_TCP	(FRAME_IP + 20)
+#define FRAME_SEQ	(FRAME_TCP + 4)
+#define FRAME_ACK	(FRAME_TCP + 8)
+#define FRAME_FLAGS	(FRAME_TCP + 13)
+#define FRAME_TCPDATA	(FRAME_TCP + 20)
+
+/**
+ * Set up a connection to uIP on 'port' from 'sport' by a
+ * handshake through uip_input(). Returns the peer's next sequence
+ * number, and uIP's in 'ack'.
+ */
+uint32_t host_tcp_connect(uint8_t ip_last, uint16_t sport, uint16_t port,
+			  uint32_t *ack);
+
+/* Pseudo random numbers, the same sequence on every run */
+uint32_t host_random(void);
+
+/* CPU time used by the process, in nanoseconds */
+uint64_t host_cpu_ns(void);
+
+#endif
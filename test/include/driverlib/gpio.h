@@ -0,0 +1,22 @@
+#ifndef __GPIO_H__
+#define __GPIO_H__
+
+//
+// Host stand-in. GPIOPinWrite() drives the chip selects of the
+// simulated SPI devices, see board.c.
+//
+#define GPIO_PIN_0              0x00000001
+#define GPIO_PIN_1              0x00000002
+#define GPIO_PIN_2              0x00000004
+#define GPIO_PIN_3              0x00000008
+#define GPIO_PIN_4              0x00000010
+#define GPIO_PIN_5              0x00000020
+#define GPIO_PIN_6              0x00000040
+#define GPIO_PIN_7              0x00000080
+
+extern void GPIOPinConfigure(unsigned long ulPinConfig);
+extern void GPIOPinTypeSSI(unsigned long ulPort, unsigned char ucPins);
+extern void GPIOPinWrite(unsigned long ulPort, unsigned char ucPins,
+                         unsigned char ucVal);
+
+#endif // __GPIO_H__
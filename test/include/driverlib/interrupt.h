@@ -0,0 +1,12 @@
+#ifndef __INTERRUPT_H__
+#define __INTERRUPT_H__
+
+//
+// Host stand-in. spi_test.c masks and delivers the SSI2 interrupt;
+// the other interrupts do not exist on the host.
+//
+extern tBoolean IntMasterEnable(void);
+extern tBoolean IntMasterDisable(void);
+extern void IntEnable(unsigned long ulInterrupt);
+
+#endif // __INTERRUPT_H__
@@ -0,0 +1,12 @@
+#ifndef __PIN_MAP_H__
+#define __PIN_MAP_H__
+
+//
+// Host stand-in: the pins spi_init() muxes to SSI2. Nothing is muxed
+// on the host.
+//
+#define GPIO_PB4_SSI2CLK        0x00011002
+#define GPIO_PB6_SSI2RX         0x00011802
+#define GPIO_PB7_SSI2TX         0x00011C02
+
+#endif // __PIN_MAP_H__
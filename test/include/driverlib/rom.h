@@ -0,0 +1,9 @@
+#ifndef __ROM_H__
+#define __ROM_H__
+
+//
+// Host stand-in: there is no ROM, rom_map.h maps everything to the
+// functions of board.c.
+//
+
+#endif // __ROM_H__
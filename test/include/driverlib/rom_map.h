@@ -0,0 +1,40 @@
+#ifndef __ROM_MAP_H__
+#define __ROM_MAP_H__
+
+//
+// Host stand-in: the driverlib calls of the code built on the host,
+// implemented by board.c and spi_test.c.
+//
+#include <driverlib/gpio.h>
+#include <driverlib/ssi.h>
+#include <driverlib/sysctl.h>
+
+#define MAP_GPIOPinConfigure    GPIOPinConfigure
+#define MAP_GPIOPinTypeSSI      GPIOPinTypeSSI
+#define MAP_GPIOPinWrite        GPIOPinWrite
+#define MAP_IntEnable           IntEnable
+#define MAP_IntMasterDisable    IntMasterDisable
+#define MAP_IntMasterEnable     IntMasterEnable
+#define MAP_SSIBusy             SSIBusy
+#define MAP_SSIConfigSetExpClk  SSIConfigSetExpClk
+#define MAP_SSIDataGet          SSIDataGet
+#define MAP_SSIDataGetNonBlocking SSIDataGetNonBlocking
+#define MAP_SSIDataPut          SSIDataPut
+#define MAP_SSIDataPutNonBlocking SSIDataPutNonBlocking
+#define MAP_SSIDisable          SSIDisable
+#define MAP_SSIDMADisable       SSIDMADisable
+#define MAP_SSIDMAEnable        SSIDMAEnable
+#define MAP_SSIEnable           SSIEnable
+#define MAP_SysCtlClockGet      SysCtlClockGet
+#define MAP_SysCtlDelay         SysCtlDelay
+#define MAP_SysCtlPeripheralEnable SysCtlPeripheralEnable
+#define MAP_uDMAChannelAssign   uDMAChannelAssign
+#define MAP_uDMAChannelAttributeDisable uDMAChannelAttributeDisable
+#define MAP_uDMAChannelControlSet uDMAChannelControlSet
+#define MAP_uDMAChannelEnable   uDMAChannelEnable
+#define MAP_uDMAChannelModeGet  uDMAChannelModeGet
+#define MAP_uDMAChannelTransferSet uDMAChannelTransferSet
+#define MAP_uDMAControlBaseSet  uDMAControlBaseSet
+#define MAP_uDMAEnable          uDMAEnable
+
+#endif // __ROM_MAP_H__
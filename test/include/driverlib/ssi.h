@@ -0,0 +1,31 @@
+#ifndef __SSI_H__
+#define __SSI_H__
+
+//
+// Host stand-in. The enc28j60.c build replaces the SSI as a whole by
+// the spi.h functions of board.c; spi_test.c implements these calls
+// with a model of the FIFOs and the DMA requests.
+//
+#define SSI_FRF_MOTO_MODE_0     0x00000000
+#define SSI_MODE_MASTER         0x00000000
+
+#define SSI_DMA_TX              0x00000002
+#define SSI_DMA_RX              0x00000001
+
+extern void SSIConfigSetExpClk(unsigned long ulBase, unsigned long ulSSIClk,
+                               unsigned long ulProtocol, unsigned long ulMode,
+                               unsigned long ulBitRate,
+                               unsigned long ulDataWidth);
+extern void SSIEnable(unsigned long ulBase);
+extern void SSIDisable(unsigned long ulBase);
+extern tBoolean SSIBusy(unsigned long ulBase);
+extern void SSIDMAEnable(unsigned long ulBase, unsigned long ulDMAFlags);
+extern void SSIDMADisable(unsigned long ulBase, unsigned long ulDMAFlags);
+extern void SSIDataPut(unsigned long ulBase, unsigned long ulData);
+extern long SSIDataPutNonBlocking(unsigned long ulBase,
+                                  unsigned long ulData);
+extern void SSIDataGet(unsigned long ulBase, unsigned long *pulData);
+extern long SSIDataGetNonBlocking(unsigned long ulBase,
+                                  unsigned long *pulData);
+
+#endif // __SSI_H__
@@ -0,0 +1,16 @@
+#ifndef __SYSCTL_H__
+#define __SYSCTL_H__
+
+//
+// Host stand-in. Delays return at once; the simulated devices are
+// never busy for long enough to need them.
+//
+#define SYSCTL_PERIPH_UDMA      0x00002000
+#define SYSCTL_PERIPH_SSI2      0x10000040
+#define SYSCTL_PERIPH_GPIOB     0x20000002
+
+extern unsigned long SysCtlClockGet(void);
+extern void SysCtlPeripheralEnable(unsigned long ulPeripheral);
+extern void SysCtlDelay(unsigned long ulCount);
+
+#endif // __SYSCTL_H__
@@ -0,0 +1,8 @@
+#ifndef __UART_H__
+#define __UART_H__
+
+//
+// Host stand-in: console output goes through UARTprintf() only.
+//
+
+#endif // __UART_H__
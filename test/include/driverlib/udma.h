@@ -0,0 +1,41 @@
+#ifndef __UDMA_H__
+#define __UDMA_H__
+
+//
+// Host stand-in. spi_test.c implements these calls with a model of the
+// channels spi.c uses: the control word, the source and destination,
+// the transfer count and mode, and the peripheral requests of SSI2.
+//
+#define UDMA_ATTR_ALL           0x0000000F
+
+#define UDMA_MODE_STOP          0x00000000
+#define UDMA_MODE_BASIC         0x00000001
+
+#define UDMA_DST_INC_8          0x00000000
+#define UDMA_DST_INC_NONE       0xc0000000
+#define UDMA_SRC_INC_8          0x00000000
+#define UDMA_SRC_INC_NONE       0x0c000000
+#define UDMA_SIZE_8             0x00000000
+#define UDMA_ARB_4              0x00008000
+
+#define UDMA_PRI_SELECT         0x00000000
+#define UDMA_ALT_SELECT         0x00000020
+
+#define UDMA_CH12_SSI2RX        0x0002000C
+#define UDMA_CH13_SSI2TX        0x0002000D
+
+extern void uDMAEnable(void);
+extern void uDMAControlBaseSet(void *pControlTable);
+extern void uDMAChannelAssign(unsigned long ulMapping);
+extern void uDMAChannelAttributeDisable(unsigned long ulChannelNum,
+                                        unsigned long ulAttr);
+extern void uDMAChannelControlSet(unsigned long ulChannelStructIndex,
+                                  unsigned long ulControl);
+extern void uDMAChannelTransferSet(unsigned long ulChannelStructIndex,
+                                   unsigned long ulMode, void *pvSrcAddr,
+                                   void *pvDstAddr,
+                                   unsigned long ulTransferSize);
+extern void uDMAChannelEnable(unsigned long ulChannelNum);
+extern unsigned long uDMAChannelModeGet(unsigned long ulChannelStructIndex);
+
+#endif // __UDMA_H__
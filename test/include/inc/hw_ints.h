@@ -0,0 +1,9 @@
+#ifndef __HW_INTS_H__
+#define __HW_INTS_H__
+
+//
+// Host stand-in: the interrupt numbers of the code built on the host.
+//
+#define INT_SSI2                73
+
+#endif // __HW_INTS_H__
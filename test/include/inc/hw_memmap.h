@@ -0,0 +1,15 @@
+#ifndef __HW_MEMMAP_H__
+#define __HW_MEMMAP_H__
+
+//
+// Host stand-in: the base addresses only tell the ports apart.
+//
+#define GPIO_PORTA_BASE         0x40004000
+#define GPIO_PORTB_BASE         0x40005000
+#define GPIO_PORTC_BASE         0x40006000
+#define GPIO_PORTD_BASE         0x40007000
+#define GPIO_PORTE_BASE         0x40024000
+#define GPIO_PORTF_BASE         0x40025000
+#define SSI2_BASE               0x4000A000
+
+#endif // __HW_MEMMAP_H__
@@ -0,0 +1,10 @@
+#ifndef __HW_SSI_H__
+#define __HW_SSI_H__
+
+//
+// Host stand-in: the data register, the address the uDMA channels of
+// SSI2 transfer to and from.
+//
+#define SSI_O_DR                0x00000008
+
+#endif // __HW_SSI_H__
@@ -0,0 +1,10 @@
+#ifndef __HW_TYPES_H__
+#define __HW_TYPES_H__
+
+//
+// Host stand-in for the StellarisWare header, with only what the
+// code built on the host uses. See test/README.
+//
+typedef unsigned char tBoolean;
+
+#endif // __HW_TYPES_H__
@@ -0,0 +1,10 @@
+#ifndef __UARTSTDIO_H__
+#define __UARTSTDIO_H__
+
+//
+// Host stand-in. UARTprintf() writes to stdout while
+// board_console is set, see board.h.
+//
+extern void UARTprintf(const char *pcString, ...);
+
+#endif // __UARTSTDIO_H__
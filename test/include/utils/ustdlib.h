@@ -0,0 +1,8 @@
+#ifndef __USTDLIB_H__
+#define __USTDLIB_H__
+
+//
+// Host stand-in: the C library of the host is used instead.
+//
+
+#endif // __USTDLIB_H__
@@ -0,0 +1,827 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <inc/hw_ints.h>
+#include <inc/hw_ssi.h>
+#include "enc28j60.h"
+#include "spi.h"
+#include "check.h"
+#include <driverlib/interrupt.h>
+#include <driverlib/udma.h>
+
+/* common.h maps printf to UARTprintf for the target, so stdio.h
+ * goes first */
+#undef printf
+
+/*
+ * spi.c against a model of SSI2: transmit and receive FIFOs of
+ * SPI_FIFO_DEPTH entries, and the shift register between them, which
+ * clocks bytes at a varying rate. One more byte than the FIFO depth
+ * can thus be in flight. The device on the bus answers each byte with
+ * the next of a known sequence. Bytes must go out and come back in
+ * order, the receive FIFO must never overrun, and nothing may be left
+ * in it after a transfer.
+ *
+ * The queued transfers also run on a model of the two uDMA channels of
+ * SSI2, which fill the transmit FIFO and drain the receive FIFO while
+ * the SSI requests them, of the SSI2 interrupt, raised when either
+ * channel completes and taken whenever interrupts are not masked, and
+ * of the chip selects. Each transfer must be a single transaction of
+ * its device, at the device's rate, with all of its bytes in place
+ * when 'done' is called.
+ */
+
+unsigned check_failures;
+
+/* Longest polled and queued transfers tested */
+#define MAX_BURST	600
+#define MAX_XFER	2055
+
+/* Bytes the device records, over all transactions of a test */
+#define OUT_MAX		4096
+
+#define SYSCLK		12500000
+
+static struct {
+  uint8_t tx[SPI_FIFO_DEPTH];
+  uint8_t rx[SPI_FIFO_DEPTH];
+  unsigned tx_head, tx_count;
+  unsigned rx_head, rx_count;
+  bool shifting;		/* A byte is in the shift register */
+} fifo;
+
+/* What the device saw and what it answered */
+static uint8_t out[OUT_MAX];
+static unsigned out_count;
+static uint8_t reply_seq;
+
+static unsigned overruns;	/* Bytes lost to a full receive FIFO */
+static unsigned hangs;		/* Reads of bytes that will never arrive */
+static unsigned idle_reads;	/* Reads in a row on an idle bus */
+static unsigned spins;		/* Bus lock attempts since a byte moved */
+
+static uint32_t rng = 1;
+
+/* Calls into the driverlib per byte time on average */
+static unsigned calls_per_byte;
+
+/* SSI2 set-up and its DMA requests */
+static struct {
+  bool enabled;
+  unsigned long rate;
+  unsigned long dmactl;		/* SSI_DMA_RX and SSI_DMA_TX */
+} ssi;
+
+/* uDMA channels of SSI2 */
+#define DMA_RX		12
+#define DMA_TX		13
+#define DMA_CHANNELS	32
+#define DMA_DR		((void *)(SSI2_BASE + SSI_O_DR))
+
+static struct {
+  unsigned long control;
+  uint8_t *src;
+  uint8_t *dst;
+  unsigned long count;		/* Items left */
+  unsigned long mode;
+  bool enabled;
+  bool assigned;
+} dma[DMA_CHANNELS];
+
+static bool dma_on;
+static unsigned dma_chunks;	/* Transfers programmed on DMA_RX */
+static unsigned long dma_sizes[4];
+
+/* PRIMASK and the SSI2 interrupt */
+static bool int_masked;
+static bool ssi_int_enabled;
+static bool ssi_int_pending;
+static bool in_handler;
+static unsigned ssi_ints;	/* Times SSI2IntHandler() was called */
+static unsigned early_ints;	/* Of those, before DMA_RX had completed */
+
+/* Chip selects, active low, and the transactions between them */
+#define MAX_TXNS	16
+
+struct txn {
+  uint8_t dev;
+  unsigned start;		/* Index of the first byte in out[] */
+  unsigned len;
+  unsigned long rate;
+};
+
+static bool selected[SPI_DEVICES];
+static struct txn txns[MAX_TXNS];
+static unsigned txn_count;
+static unsigned stray;		/* Bytes clocked with no device selected */
+
+/* Rate each device should be at, from spi_bringup() */
+static uint32_t dev_rate[SPI_DEVICES];
+
+static bool
+dma_active(void) {
+  return dma[DMA_RX].enabled || dma[DMA_TX].enabled;
+}
+
+/* A channel moved one byte; the last one stops it and raises the
+ * SSI2 interrupt */
+static void
+dma_moved(unsigned ch) {
+  if(--dma[ch].count == 0) {
+    dma[ch].enabled = false;
+    dma[ch].mode = UDMA_MODE_STOP;
+    ssi_int_pending = true;
+  }
+}
+
+/* The SSI requests a channel while its FIFO has room or data */
+static void
+dma_requests(void) {
+  while((ssi.dmactl & SSI_DMA_RX) && dma[DMA_RX].enabled &&
+	fifo.rx_count > 0) {
+    *dma[DMA_RX].dst = fifo.rx[fifo.rx_head];
+    fifo.rx_head = (fifo.rx_head + 1) % SPI_FIFO_DEPTH;
+    fifo.rx_count--;
+    if((dma[DMA_RX].control & UDMA_DST_INC_NONE) != UDMA_DST_INC_NONE) {
+      dma[DMA_RX].dst++;
+    }
+    dma_moved(DMA_RX);
+  }
+  while((ssi.dmactl & SSI_DMA_TX) && dma[DMA_TX].enabled &&
+	fifo.tx_count < SPI_FIFO_DEPTH) {
+    fifo.tx[(fifo.tx_head + fifo.tx_count) % SPI_FIFO_DEPTH] =
+      *dma[DMA_TX].src;
+    fifo.tx_count++;
+    if((dma[DMA_TX].control & UDMA_SRC_INC_NONE) != UDMA_SRC_INC_NONE) {
+      dma[DMA_TX].src++;
+    }
+    dma_moved(DMA_TX);
+  }
+}
+
+/* Take the SSI2 interrupt if it is pending and not masked. It does
+ * not nest. */
+static void
+interrupts(void) {
+  while(ssi_int_pending && ssi_int_enabled && !int_masked && !in_handler) {
+    ssi_int_pending = false;
+    in_handler = true;
+    ssi_ints++;
+    if(dma[DMA_RX].mode != UDMA_MODE_STOP) {
+      early_ints++;
+    }
+    SSI2IntHandler();
+    in_handler = false;
+  }
+}
+
+/* Bytes clocked per call into the driverlib: one now and then, or
+ * all that are queued, as if an interrupt had held up the CPU */
+static unsigned
+shift_rate(void) {
+  rng = rng * 1103515245 + 12345;
+  if(((rng >> 16) & 15) == 0) {
+    return 2 * SPI_FIFO_DEPTH;
+  }
+  return (rng >> 20) % calls_per_byte == 0;
+}
+
+/* 'n' byte times: the byte shifted so far goes to the receive FIFO,
+ * and the next is taken from the transmit FIFO */
+static void
+shift(unsigned n) {
+  dma_requests();
+  while(n-- > 0 && (fifo.shifting || fifo.tx_count > 0)) {
+    if(fifo.shifting) {
+      if(fifo.rx_count == SPI_FIFO_DEPTH) {
+	overruns++;
+      } else {
+	fifo.rx[(fifo.rx_head + fifo.rx_count) % SPI_FIFO_DEPTH] = reply_seq;
+	fifo.rx_count++;
+      }
+      reply_seq++;
+      fifo.shifting = false;
+    }
+    if(fifo.tx_count > 0) {
+      if(out_count < OUT_MAX) {
+	out[out_count] = fifo.tx[fifo.tx_head];
+      }
+      out_count++;
+      if(!selected[SPI_DEV_ENC] && !selected[SPI_DEV_MEM]) {
+	stray++;
+      }
+      fifo.tx_head = (fifo.tx_head + 1) % SPI_FIFO_DEPTH;
+      fifo.tx_count--;
+      fifo.shifting = true;
+      spins = 0;
+    }
+    dma_requests();
+  }
+  interrupts();
+}
+
+/* A call into the driverlib takes some byte times */
+static void
+tick(void) {
+  shift(shift_rate());
+}
+
+long
+SSIDataPutNonBlocking(unsigned long ulBase, unsigned long ulData) {
+  (void)ulBase;
+  tick();
+  /* The FIFOs belong to the uDMA controller during a transfer */
+  CHECK(ssi.enabled && !dma_active());
+  if(fifo.tx_count == SPI_FIFO_DEPTH) {
+    return 0;
+  }
+  fifo.tx[(fifo.tx_head + fifo.tx_count) % SPI_FIFO_DEPTH] = ulData;
+  fifo.tx_count++;
+  return 1;
+}
+
+void
+SSIDataPut(unsigned long ulBase, unsigned long ulData) {
+  while(!SSIDataPutNonBlocking(ulBase, ulData)) {
+    shift(1);
+  }
+}
+
+long
+SSIDataGetNonBlocking(unsigned long ulBase, unsigned long *pulData) {
+  (void)ulBase;
+  tick();
+  CHECK(ssi.enabled && !dma_active());
+  if(fifo.rx_count == 0) {
+    if(fifo.shifting || fifo.tx_count > 0) {
+      idle_reads = 0;
+    } else if(++idle_reads == 1000) {
+      /* The target would wait forever for a lost byte */
+      hangs++;
+      idle_reads = 0;
+      *pulData = 0;
+      return 1;
+    }
+    return 0;
+  }
+  idle_reads = 0;
+  *pulData = fifo.rx[fifo.rx_head];
+  fifo.rx_head = (fifo.rx_head + 1) % SPI_FIFO_DEPTH;
+  fifo.rx_count--;
+  return 1;
+}
+
+void
+SSIDataGet(unsigned long ulBase, unsigned long *pulData) {
+  while(!SSIDataGetNonBlocking(ulBase, pulData)) {
+    if(!fifo.shifting && fifo.tx_count == 0) {
+      /* The target would wait forever */
+      hangs++;
+      *pulData = 0;
+      return;
+    }
+    shift(1);
+  }
+}
+
+/* Reconfigured only while idle, with no transfer in flight */
+void
+SSIConfigSetExpClk(unsigned long ulBase, unsigned long ulSSIClk,
+		   unsigned long ulProtocol, unsigned long ulMode,
+		   unsigned long ulBitRate, unsigned long ulDataWidth) {
+  (void)ulBase;
+  CHECK(!ssi.enabled && !fifo.shifting && fifo.tx_count == 0 &&
+	!dma_active());
+  CHECK(ulSSIClk == SYSCLK && ulProtocol == SSI_FRF_MOTO_MODE_0 &&
+	ulMode == SSI_MODE_MASTER && ulDataWidth == 8);
+  CHECK(ulBitRate >= SPI_MIN_RATE && ulBitRate <= SPI_MAX_RATE);
+  ssi.rate = ulBitRate;
+}
+
+void
+SSIEnable(unsigned long ulBase) {
+  (void)ulBase;
+  ssi.enabled = true;
+}
+
+void
+SSIDisable(unsigned long ulBase) {
+  (void)ulBase;
+  ssi.enabled = false;
+}
+
+tBoolean
+SSIBusy(unsigned long ulBase) {
+  (void)ulBase;
+  tick();
+  return fifo.shifting || fifo.tx_count > 0;
+}
+
+void
+SSIDMAEnable(unsigned long ulBase, unsigned long ulDMAFlags) {
+  (void)ulBase;
+  ssi.dmactl |= ulDMAFlags;
+  tick();
+}
+
+void
+SSIDMADisable(unsigned long ulBase, unsigned long ulDMAFlags) {
+  (void)ulBase;
+  ssi.dmactl &= ~ulDMAFlags;
+}
+
+void
+uDMAEnable(void) {
+  dma_on = true;
+}
+
+void
+uDMAControlBaseSet(void *pControlTable) {
+  CHECK(((uintptr_t)pControlTable & 1023) == 0);
+}
+
+void
+uDMAChannelAssign(unsigned long ulMapping) {
+  unsigned ch = ulMapping & 0xff;
+
+  CHECK(ulMapping == UDMA_CH12_SSI2RX || ulMapping == UDMA_CH13_SSI2TX);
+  dma[ch].assigned = true;
+}
+
+void
+uDMAChannelAttributeDisable(unsigned long ulChannelNum,
+			    unsigned long ulAttr) {
+  CHECK(ulChannelNum < DMA_CHANNELS && ulAttr == UDMA_ATTR_ALL);
+}
+
+void
+uDMAChannelControlSet(unsigned long ulChannelStructIndex,
+		      unsigned long ulControl) {
+  unsigned ch = ulChannelStructIndex & (DMA_CHANNELS - 1);
+
+  CHECK((ulChannelStructIndex & UDMA_ALT_SELECT) == 0 && !dma[ch].enabled);
+  dma[ch].control = ulControl;
+}
+
+/* At most 1024 items per transfer, and the SSI data register on the
+ * side that does not increment */
+void
+uDMAChannelTransferSet(unsigned long ulChannelStructIndex,
+		       unsigned long ulMode, void *pvSrcAddr,
+		       void *pvDstAddr, unsigned long ulTransferSize) {
+  unsigned ch = ulChannelStructIndex & (DMA_CHANNELS - 1);
+
+  CHECK((ulChannelStructIndex & UDMA_ALT_SELECT) == 0 && !dma[ch].enabled);
+  CHECK(ulMode == UDMA_MODE_BASIC);
+  CHECK(ulTransferSize >= 1 && ulTransferSize <= 1024);
+  if(ch == DMA_RX) {
+    CHECK(pvSrcAddr == DMA_DR &&
+	  (dma[ch].control & UDMA_SRC_INC_NONE) == UDMA_SRC_INC_NONE);
+    if(dma_chunks < sizeof(dma_sizes) / sizeof(dma_sizes[0])) {
+      dma_sizes[dma_chunks] = ulTransferSize;
+    }
+    dma_chunks++;
+  } else {
+    CHECK(ch == DMA_TX && pvDstAddr == DMA_DR &&
+	  (dma[ch].control & UDMA_DST_INC_NONE) == UDMA_DST_INC_NONE);
+    CHECK(dma[DMA_RX].count == ulTransferSize);
+  }
+  dma[ch].src = pvSrcAddr;
+  dma[ch].dst = pvDstAddr;
+  dma[ch].count = ulTransferSize;
+  dma[ch].mode = ulMode;
+}
+
+/* A channel runs as soon as it is enabled, and the CPU may be held
+ * up before it enables the other one */
+void
+uDMAChannelEnable(unsigned long ulChannelNum) {
+  CHECK(ulChannelNum < DMA_CHANNELS && dma_on && dma[ulChannelNum].assigned &&
+	dma[ulChannelNum].count > 0);
+  dma[ulChannelNum].enabled = true;
+  shift(2 * SPI_FIFO_DEPTH);
+}
+
+unsigned long
+uDMAChannelModeGet(unsigned long ulChannelStructIndex) {
+  return dma[ulChannelStructIndex & (DMA_CHANNELS - 1)].mode;
+}
+
+tBoolean
+IntMasterDisable(void) {
+  bool was = int_masked;
+
+  tick();
+  int_masked = true;
+  /* spi_lock() waiting for a bus that is never freed */
+  if(++spins == 1000000) {
+    printf("spi_test: FAILED, the bus is never freed\n");
+    exit(1);
+  }
+  return was;
+}
+
+tBoolean
+IntMasterEnable(void) {
+  bool was = int_masked;
+
+  int_masked = false;
+  tick();
+  return was;
+}
+
+void
+IntEnable(unsigned long ulInterrupt) {
+  CHECK(ulInterrupt == INT_SSI2);
+  ssi_int_enabled = true;
+}
+
+unsigned long
+SysCtlClockGet(void) {
+  return SYSCLK;
+}
+
+void
+SysCtlPeripheralEnable(unsigned long ulPeripheral) {
+  (void)ulPeripheral;
+}
+
+void
+GPIOPinConfigure(unsigned long ulPinConfig) {
+  (void)ulPinConfig;
+}
+
+void
+GPIOPinTypeSSI(unsigned long ulPort, unsigned char ucPins) {
+  (void)ulPort;
+  (void)ucPins;
+}
+
+/* A chip select starts or ends a transaction, with nothing in flight
+ * and only one device selected at a time */
+void
+GPIOPinWrite(unsigned long ulPort, unsigned char ucPins,
+	     unsigned char ucVal) {
+  uint8_t dev;
+  bool low = (ucVal & ucPins) == 0;
+
+  if(ulPort == ENC_CS_PORT && ucPins == ENC_CS) {
+    dev = SPI_DEV_ENC;
+  } else if(ulPort == GPIO_PORTA_BASE && ucPins == SRAM_CS) {
+    dev = SPI_DEV_MEM;
+  } else {
+    CHECK(false);
+    return;
+  }
+  CHECK(!fifo.shifting && fifo.tx_count == 0 && fifo.rx_count == 0 &&
+	!dma_active());
+
+  if(low && !selected[dev]) {
+    CHECK(!selected[SPI_DEV_ENC] && !selected[SPI_DEV_MEM]);
+    if(txn_count < MAX_TXNS) {
+      txns[txn_count].dev = dev;
+      txns[txn_count].start = out_count;
+      txns[txn_count].rate = ssi.rate;
+    }
+  } else if(!low && selected[dev]) {
+    if(txn_count < MAX_TXNS) {
+      txns[txn_count].len = out_count - txns[txn_count].start;
+    }
+    txn_count++;
+  }
+  selected[dev] = low;
+}
+
+static void
+reset(void) {
+  memset(&fifo, 0, sizeof(fifo));
+  out_count = 0;
+  reply_seq = 0;
+  idle_reads = 0;
+}
+
+/* Nothing in flight and nothing lost */
+static bool
+idle(void) {
+  return fifo.tx_count == 0 && !fifo.shifting && fifo.rx_count == 0 &&
+    overruns == 0 && hangs == 0;
+}
+
+static void
+test_send(void) {
+  unsigned i;
+  bool ok = true;
+
+  reset();
+  for(i = 0; i < 100; i++) {
+    ok = ok && spi_send(0xA0 + i) == (uint8_t)i && out_count == i + 1 &&
+      out[i] == (uint8_t)(0xA0 + i);
+  }
+  CHECK(ok);
+  CHECK(idle());
+}
+
+static void
+test_write_burst(void) {
+  uint8_t buf[MAX_BURST];
+  unsigned len, i;
+  bool ok = true;
+
+  for(i = 0; i < MAX_BURST; i++) {
+    buf[i] = i * 13 + 1;
+  }
+  for(len = 0; len <= MAX_BURST; len += len < 40 ? 1 : 37) {
+    reset();
+    spi_write_burst(buf, len);
+    ok = ok && out_count == len && memcmp(out, buf, len) == 0 && idle();
+    /* Nothing stale comes back after the burst */
+    ok = ok && spi_send(0x55) == (uint8_t)len;
+  }
+  CHECK(ok);
+  CHECK(idle());
+}
+
+static void
+test_read_burst(void) {
+  uint8_t buf[MAX_BURST + 1];
+  unsigned len, i;
+  bool ok = true;
+
+  for(len = 0; len <= MAX_BURST; len += len < 40 ? 1 : 37) {
+    reset();
+    memset(buf, 0, sizeof(buf));
+    spi_read_burst(buf, len);
+    ok = ok && out_count == len && idle() && buf[len] == 0;
+    for(i = 0; i < len; i++) {
+      ok = ok && out[i] == 0xFF && buf[i] == (uint8_t)i;
+    }
+    ok = ok && spi_send(0x55) == (uint8_t)len;
+  }
+  CHECK(ok);
+  CHECK(idle());
+}
+
+/* A queued transfer, and the one its 'done' callback submits */
+struct job {
+  struct spi_xfer xfer;		/* Must be first */
+  struct job *then;
+  unsigned done;		/* Calls of 'done' */
+  bool ok;			/* All bytes were in place at the first */
+};
+
+static struct job *done_order[MAX_TXNS];
+static unsigned done_count;
+
+static uint8_t pattern[MAX_XFER];
+static uint8_t rx_bufs[8][MAX_XFER + 1];
+
+/* 'xfer' was transaction 't': of its device at its rate, with the
+ * command and data bytes out, and the device's answers in 'rx' */
+static bool
+xfer_ok(const struct spi_xfer *xfer, const struct txn *t) {
+  unsigned i, at = t->start + xfer->cmd_len;
+
+  if(t->dev != xfer->dev || t->rate != dev_rate[xfer->dev] ||
+     t->len != xfer->cmd_len + xfer->count || t->start + t->len > OUT_MAX ||
+     memcmp(out + t->start, xfer->cmd, xfer->cmd_len) != 0) {
+    return false;
+  }
+  for(i = 0; i < xfer->count; i++) {
+    if(out[at + i] != (xfer->tx ? xfer->tx[i] : 0xFF) ||
+       (xfer->rx && xfer->rx[i] != (uint8_t)(at + i))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void
+job_done(struct spi_xfer *xfer) {
+  struct job *job = (struct job *)xfer;
+
+  if(job->done++ == 0) {
+    /* Deselected before 'done', so the transaction is logged */
+    job->ok = txn_count > 0 && txn_count <= MAX_TXNS &&
+      xfer_ok(xfer, &txns[txn_count - 1]);
+  }
+  if(done_count < MAX_TXNS) {
+    done_order[done_count] = job;
+  }
+  done_count++;
+  if(job->then) {
+    spi_submit(&job->then->xfer);
+  }
+}
+
+/* An SRAM write or read of 'count' bytes, or with 'rx' and 'tx' both
+ * set, any full-duplex transfer. ENC28J60 commands are one byte. */
+static void
+job_init(struct job *job, uint8_t dev, const uint8_t *tx, uint8_t *rx,
+	 uint16_t count) {
+  memset(job, 0, sizeof(*job));
+  job->xfer.dev = dev;
+  job->xfer.cmd[0] = tx ? 0x02 : 0x03;
+  job->xfer.cmd[1] = count >> 8;
+  job->xfer.cmd[2] = count & 0xFF;
+  job->xfer.cmd_len = dev == SPI_DEV_MEM ? 3 : 1;
+  job->xfer.tx = tx;
+  job->xfer.rx = rx;
+  job->xfer.count = count;
+  job->xfer.done = job_done;
+  if(rx) {
+    memset(rx, 0, MAX_XFER + 1);
+  }
+}
+
+static void
+reset_bus(void) {
+  reset();
+  memset(txns, 0, sizeof(txns));
+  txn_count = 0;
+  stray = 0;
+  done_count = 0;
+  dma_chunks = 0;
+}
+
+/* Byte times until 'jobs' transfers have completed */
+static bool
+run(unsigned jobs) {
+  unsigned t;
+
+  for(t = 0; done_count < jobs && t < 100000; t++) {
+    shift(1);
+  }
+  return done_count == jobs;
+}
+
+/* Nothing selected, in flight, pending or requested, and no byte was
+ * clocked outside a transaction */
+static bool
+bus_idle(void) {
+  return idle() && !selected[SPI_DEV_ENC] && !selected[SPI_DEV_MEM] &&
+    ssi.dmactl == 0 && !dma_active() && !spi_dma_busy() &&
+    !ssi_int_pending && stray == 0;
+}
+
+/* A rate test that fails above 3 MHz */
+static uint16_t
+rate_test(void) {
+  uint16_t errors;
+
+  spi_lock(SPI_DEV_ENC);
+  errors = ssi.rate > 3000000;
+  spi_unlock(SPI_DEV_ENC);
+  return errors;
+}
+
+/* The divider halves from that of SPI_MIN_RATE, 6, to 3 and then 2,
+ * which fails */
+static void
+test_bringup(void) {
+  uint16_t errors;
+  uint32_t rate;
+
+  rate = spi_bringup(SPI_DEV_ENC, rate_test, &errors);
+  CHECK(rate == SYSCLK / 6 && errors > 0);
+  dev_rate[SPI_DEV_ENC] = rate;
+  dev_rate[SPI_DEV_MEM] = SPI_MIN_RATE;
+}
+
+/* Transfers of up to two whole uDMA transfers and a bit, written,
+ * read and both. Every chunk is programmed on both channels, and
+ * the transmit channel finishes first: the handler must wait for
+ * the receive channel before starting the next chunk or calling
+ * 'done'. */
+static void
+test_chunks(void) {
+  static const uint16_t counts[] = { 0, 1, 1023, 1024, 1025, 2048, 2055 };
+  struct job job;
+  uint8_t *rx = rx_bufs[0];
+  unsigned n, mode, i, chunks;
+  bool ok = true;
+
+  early_ints = 0;
+  for(n = 0; n < sizeof(counts) / sizeof(counts[0]); n++) {
+    for(mode = 0; mode < 3; mode++) {
+      reset_bus();
+      memset(rx, 0, MAX_XFER + 1);
+      job_init(&job, SPI_DEV_MEM, mode != 1 ? pattern : NULL,
+	       mode != 0 ? rx : NULL, counts[n]);
+      spi_submit(&job.xfer);
+      ok = run(1) && ok && job.done == 1 && job.ok && bus_idle() &&
+	rx[counts[n]] == 0;
+
+      chunks = (counts[n] + SPI_DMA_MAX_XFER - 1) / SPI_DMA_MAX_XFER;
+      ok = ok && dma_chunks == chunks;
+      for(i = 0; ok && i < chunks; i++) {
+	ok = dma_sizes[i] == (i + 1 < chunks ? SPI_DMA_MAX_XFER :
+			      counts[n] - i * SPI_DMA_MAX_XFER);
+      }
+    }
+  }
+  CHECK(ok);
+  CHECK(early_ints > 0);
+}
+
+/* Transfers submitted back to back, while one is in flight and from
+ * 'done', go out one at a time, the ENC28J60 first */
+static void
+test_queue(void) {
+  static struct job jobs[6];
+  struct job *a = &jobs[0], *b = &jobs[1], *c = &jobs[2];
+  struct job *d = &jobs[3], *e = &jobs[4], *f = &jobs[5];
+  struct job *order[] = { a, b, d, f, c, e };
+  unsigned i;
+  bool ok = true;
+
+  reset_bus();
+  job_init(a, SPI_DEV_MEM, pattern, NULL, 300);
+  job_init(b, SPI_DEV_ENC, NULL, rx_bufs[1], 200);
+  job_init(c, SPI_DEV_MEM, NULL, rx_bufs[2], 50);
+  job_init(d, SPI_DEV_ENC, NULL, rx_bufs[3], 10);
+  job_init(e, SPI_DEV_MEM, pattern + 7, NULL, 5);
+  job_init(f, SPI_DEV_ENC, pattern + 3, rx_bufs[5], 20);
+  b->then = f;
+  d->then = e;
+  spi_submit(&a->xfer);
+  spi_submit(&b->xfer);
+  spi_submit(&c->xfer);
+  spi_submit(&d->xfer);
+  CHECK(run(6));
+  for(i = 0; i < 6; i++) {
+    ok = ok && done_order[i] == order[i] && order[i]->done == 1 &&
+      order[i]->ok;
+  }
+  CHECK(ok);
+  CHECK(txn_count == 6 && bus_idle());
+
+  /* spi_lock() waits for the transfer in flight, and transfers queued
+   * while the bus is locked wait for spi_unlock() */
+  reset_bus();
+  job_init(a, SPI_DEV_MEM, pattern, rx_bufs[0], 500);
+  job_init(b, SPI_DEV_ENC, NULL, rx_bufs[1], 100);
+  spi_submit(&a->xfer);
+  spi_lock(SPI_DEV_ENC);
+  CHECK(a->done == 1 && a->ok && ssi.rate == dev_rate[SPI_DEV_ENC]);
+  spi_submit(&b->xfer);
+  for(i = 0; i < 100; i++) {
+    shift(1);
+  }
+  CHECK(txn_count == 1 && b->done == 0);
+  spi_unlock(SPI_DEV_ENC);
+  CHECK(run(2) && b->ok && bus_idle());
+}
+
+/* With interrupts masked, both channels complete before the handler
+ * runs: one call must then see the receive channel done and carry
+ * on with the next chunk */
+static void
+test_masked(void) {
+  struct job job;
+  unsigned t, ints;
+  bool masked;
+
+  reset_bus();
+  job_init(&job, SPI_DEV_MEM, pattern, rx_bufs[0], 1500);
+  masked = IntMasterDisable();
+  spi_submit(&job.xfer);
+  for(t = 0; dma[DMA_RX].mode != UDMA_MODE_STOP && t < 10000; t++) {
+    shift(1);
+  }
+  ints = ssi_ints;
+  CHECK(dma[DMA_TX].mode == UDMA_MODE_STOP && ssi_int_pending);
+  CHECK(dma_chunks == 1 && job.done == 0);
+  if(!masked) {
+    IntMasterEnable();
+  }
+  CHECK(ssi_ints > ints && dma_chunks == 2);
+  CHECK(run(1) && job.ok && bus_idle());
+}
+
+int
+main(void) {
+  unsigned i;
+
+  for(i = 0; i < MAX_XFER; i++) {
+    pattern[i] = i * 7 + 3;
+  }
+  calls_per_byte = 1;
+  spi_init();
+  spi_dma_init();
+  test_bringup();
+
+  /* From a bus as fast as the CPU to one much slower */
+  for(calls_per_byte = 1; calls_per_byte <= 16; calls_per_byte *= 2) {
+    test_send();
+    test_write_burst();
+    test_read_burst();
+    test_chunks();
+    test_queue();
+    test_masked();
+  }
+
+  printf("spi_test: %s\n", check_failures ? "FAILED" : "passed");
+  return check_failures != 0;
+}
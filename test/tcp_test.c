@@ -0,0 +1,198 @@
+#include "host.h"
+
+#include <string.h>
+
+/*
+ * TCP timing and the send window of uip.c, with segments from the
+ * peer fed to uip_input() and the clock moved by hand.
+ */
+
+#define TEST_PORT	80
+#define PEER_PORT	40000
+
+/* Bytes the application sends when next asked */
+static uint16_t app_send;
+
+void
+test_appcall(void) {
+  if(app_send > 0 && (uip_poll() || uip_acked() || uip_newdata())) {
+    memset(uip_appdata, 'x', app_send);
+    uip_send(uip_appdata, app_send);
+    app_send = 0;
+  }
+}
+
+static struct uip_conn *conn;
+static uint32_t peer_seq;	/* The peer's next sequence number */
+static uint32_t host_seq;	/* Ours, the next byte not yet sent */
+
+static void
+setup(void) {
+  host_clock = 0;
+  host_uip_init();
+  uip_listen(HTONS(TEST_PORT));
+  peer_seq = host_tcp_connect(0, PEER_PORT, TEST_PORT, &host_seq);
+  CHECK(host_seq != 0);
+  conn = uip_conn;
+  CHECK(conn != NULL && conn->tcpstateflags == UIP_ESTABLISHED);
+}
+
+/* Have the application send 'len' bytes. Returns the segment's
+ * length, 0 if none was sent. */
+static uint16_t
+send_data(uint16_t len) {
+  app_send = len;
+  uip_poll_conn(conn);
+  app_send = 0;
+  if(uip_len == 0) {
+    return 0;
+  }
+  CHECK(frame_get32(&uip_buf[FRAME_SEQ]) == host_seq);
+  host_seq += len;
+  len = uip_len - (FRAME_TCPDATA - FRAME_IP);
+  uip_len = 0;
+  return len;
+}
+
+/* The peer acknowledges up to 'ack'. Returns the length of uIP's
+ * answer. */
+static uint16_t
+ack(uint32_t ack) {
+  uip_len = frame_tcp(uip_buf, 0, PEER_PORT, TEST_PORT, peer_seq, ack,
+		      TCP_ACK, 0);
+  uip_input();
+  return uip_len;
+}
+
+/* Move the clock by one tick and run the timers. Returns the
+ * sequence number of a retransmission, or 0. */
+static uint32_t
+tick(void) {
+  uint32_t seq = 0;
+
+  host_clock++;
+  uip_periodic_conn(conn);
+  if(uip_len > 0) {
+    seq = frame_get32(&uip_buf[FRAME_SEQ]);
+  }
+  uip_len = 0;
+  return seq;
+}
+
+/* A LAN round trip of one tick must not bring the timeout below
+ * UIP_RTO_MIN, nor make an ACK delayed by 200 ms look lost. Timeouts
+ * back off from the estimate, up to UIP_RTO_MAX. */
+static void
+test_rto(void) {
+  clock_time_t t, last;
+  unsigned i, n;
+  bool ok = true;
+
+  setup();
+  for(i = 0; i < 30; i++) {
+    ok = ok && send_data(100) == 100;
+    host_clock++;
+    ack(host_seq);
+    ok = ok && conn->rto >= UIP_RTO_MIN && conn->len == 0;
+  }
+  CHECK(ok);
+  CHECK(conn->rto == UIP_RTO_MIN);
+
+  CHECK(send_data(100) == 100);
+  for(i = 0; i < CLOCK_SECOND / 5; i++) {
+    ok = ok && tick() == 0;
+  }
+  CHECK(ok);
+  ack(host_seq);
+  CHECK(conn->len == 0);
+
+  /* No ACK at all: the intervals double from the estimate */
+  CHECK(send_data(100) == 100);
+  t = last = host_clock;
+  n = 0;
+  while(n < 6 && host_clock - t < 100 * CLOCK_SECOND) {
+    if(tick() != 0) {
+      if(n > 0) {
+	ok = ok && host_clock - last ==
+	  (clock_time_t)UIP_RTO_MIN << (n - 1 > 4 ? 4 : n - 1);
+      }
+      last = host_clock;
+      n++;
+    }
+  }
+  CHECK(ok && n == 6);
+
+  /* From a long estimate, no interval exceeds UIP_RTO_MAX */
+  setup();
+  conn->rto = UIP_RTO_MAX / 2;
+  CHECK(send_data(100) == 100);
+  t = last = host_clock;
+  n = 0;
+  while(n < 4 && host_clock - t < 1000 * CLOCK_SECOND) {
+    if(tick() != 0) {
+      if(n > 1) {
+	ok = ok && host_clock - last == UIP_RTO_MAX;
+      }
+      last = host_clock;
+      n++;
+    }
+  }
+  CHECK(ok && n == 4);
+}
+
+/* An ACK in the middle of a segment releases the segments before it
+ * and the acknowledged start of that one. The rest is retransmitted
+ * from where the ACK left off. */
+static void
+test_partial_ack(void) {
+  uint32_t start, seq;
+  unsigned i;
+
+  setup();
+  start = host_seq;
+  for(i = 0; i < 3; i++) {
+    CHECK(send_data(100) == 100);
+  }
+  CHECK(conn->segs == 3 && conn->len == 300);
+
+  /* Within the first segment */
+  ack(start + 30);
+  CHECK(conn->segs == 3 && conn->len == 270);
+  CHECK(frame_get32(conn->snd_nxt) == start + 30);
+
+  /* Past the first, into the second */
+  ack(start + 150);
+  CHECK(conn->segs == 2 && conn->len == 150);
+  CHECK(frame_get32(conn->snd_nxt) == start + 150);
+
+  /* A duplicate changes nothing */
+  ack(start + 100);
+  CHECK(conn->segs == 2 && conn->len == 150);
+
+  /* The rest of the second segment goes out again first */
+  seq = 0;
+  for(i = 0; seq == 0 && i < 10 * UIP_RTO_MAX; i++) {
+    host_clock++;
+    uip_periodic_conn(conn);
+    if(uip_len > 0) {
+      seq = frame_get32(&uip_buf[FRAME_SEQ]);
+      CHECK(uip_len - (FRAME_TCPDATA - FRAME_IP) == 50);
+      CHECK(uip_buf[FRAME_TCPDATA] == 'x');
+    }
+    uip_len = 0;
+  }
+  CHECK(seq == start + 150);
+
+  /* Then all of it */
+  ack(start + 300);
+  CHECK(conn->segs == 0 && conn->len == 0);
+}
+
+int
+main(void) {
+  test_rto();
+  test_partial_ack();
+
+  printf("tcp_test: %s\n", check_failures ? "FAILED" : "passed");
+  return check_failures != 0;
+}
@@ -0,0 +1,42 @@
+#ifndef __TEST_UIP_CONF_H_
+#define __TEST_UIP_CONF_H_
+
+//
+// Host builds use the target configuration, with the options below
+// overridden from the command line to compare variants.
+//
+#include "../uip-conf.h"
+
+#ifdef TEST_BUFALIGN
+#undef UIP_CONF_BUFALIGN
+#define UIP_CONF_BUFALIGN           TEST_BUFALIGN
+#endif
+
+#ifdef TEST_CONNS
+#undef UIP_CONF_MAX_CONNECTIONS
+#define UIP_CONF_MAX_CONNECTIONS    TEST_CONNS
+#endif
+
+#ifdef TEST_CONN_HASH
+#undef UIP_CONF_CONN_HASH
+#define UIP_CONF_CONN_HASH          TEST_CONN_HASH
+#endif
+
+//
+// The application the test or benchmark provides
+//
+#ifdef TEST_APPCALL
+void TEST_APPCALL(void);
+#undef UIP_APPCALL
+#define UIP_APPCALL                 TEST_APPCALL
+#endif
+
+//
+// The generic checksums of uip.c, as the reference for uip-arch.c
+//
+#ifdef TEST_ARCH_CHKSUM
+#undef UIP_ARCH_CHKSUM
+#define UIP_ARCH_CHKSUM             TEST_ARCH_CHKSUM
+#endif
+
+#endif // __TEST_UIP_CONF_H_
@@ -0,0 +1,106 @@
+#include "host.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Time uip_input() per received packet, for the packets the web
+ * server mostly sees. Built once for each UIP_BUFALIGN setting.
+ */
+
+#define BENCH_PORT	80
+#define BENCH_MSS	512
+
+static struct uip_conn *bench_conn;
+
+void
+bench_appcall(void) {
+  if(uip_connected()) {
+    bench_conn = uip_conn;
+  }
+}
+
+/* Headers of the frame to feed uip_input(). The payload is copied
+ * once; uIP only writes headers when it answers. uip_len comes back
+ * without the Ethernet header, which uip_arp_out() adds. */
+static uint8_t frame[UIP_BUFSIZE];
+static uint16_t frame_len;
+static uint16_t frame_hdr;
+
+static void
+load(void) {
+  memcpy(uip_buf, frame, frame_hdr);
+  uip_len = frame_len;
+}
+
+static void
+report(const char *name, unsigned long n, uint64_t ns) {
+  printf("  %-24s %8.1f ns/packet\n", name, (double)ns / n);
+}
+
+int
+main(int argc, char **argv) {
+  unsigned long iterations = argc > 1 ? strtoul(argv[1], NULL, 0) : 1000000;
+  unsigned long i;
+  uint32_t seq, ack;
+  uint64_t t;
+
+  host_uip_init();
+  uip_listen(HTONS(BENCH_PORT));
+
+  printf("uip_input() with UIP_BUFALIGN=%d, %lu packets each\n",
+	 UIP_BUFALIGN, iterations);
+
+  /* Echo request, answered in place */
+  frame_len = frame_icmp_echo(frame, 1, 56);
+  frame_hdr = FRAME_TCP + 8;
+  memcpy(uip_buf, frame, frame_len);
+  uip_len = frame_len;
+  uip_input();
+  CHECK(uip_len == frame_len - FRAME_IP && uip_buf[FRAME_TCP] == 0);
+  t = host_cpu_ns();
+  for(i = 0; i < iterations; i++) {
+    load();
+    uip_input();
+  }
+  report("ICMP echo, 56 bytes", iterations, host_cpu_ns() - t);
+
+  /* In-order data on an established connection, answered by an
+   * ACK. The sequence number goes up by one segment each time */
+  seq = host_tcp_connect(0, 40000, BENCH_PORT, &ack);
+  CHECK(bench_conn != NULL && ack != 0);
+  frame_len = frame_tcp(frame, 0, 40000, BENCH_PORT, seq, ack,
+			TCP_ACK | TCP_PSH, BENCH_MSS);
+  frame_hdr = FRAME_TCPDATA;
+  memcpy(uip_buf, frame, frame_len);
+  uip_len = frame_len;
+  uip_input();
+  CHECK(uip_len == FRAME_TCPDATA - FRAME_IP &&
+	frame_get32(&uip_buf[FRAME_ACK]) == seq + BENCH_MSS);
+  t = host_cpu_ns();
+  for(i = 0; i < iterations; i++) {
+    seq += BENCH_MSS;
+    frame_put32(&frame[FRAME_SEQ], seq);
+    load();
+    uip_input();
+  }
+  report("TCP data, 512 bytes", iterations, host_cpu_ns() - t);
+  CHECK(uip_len == FRAME_TCPDATA - FRAME_IP &&
+	frame_get32(&uip_buf[FRAME_ACK]) == seq + BENCH_MSS);
+
+  /* Connection attempt to a closed port, answered by a RST */
+  frame_len = frame_tcp(frame, 0, 40001, BENCH_PORT + 1, 1000, 0,
+			TCP_SYN, 0);
+  frame_hdr = FRAME_TCPDATA;
+  load();
+  uip_input();
+  CHECK(uip_len == FRAME_TCPDATA - FRAME_IP && (uip_buf[FRAME_FLAGS] & TCP_RST));
+  t = host_cpu_ns();
+  for(i = 0; i < iterations; i++) {
+    load();
+    uip_input();
+  }
+  report("TCP SYN to closed port", iterations, host_cpu_ns() - t);
+
+  return check_failures != 0;
+}
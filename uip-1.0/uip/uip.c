@@ -137,8 +137,13 @@ struct uip_eth_addr uip_ethaddr = {{0,0,0,0,0,0}};
 #endif
 
 #ifndef UIP_CONF_EXTERNAL_BUFFER
+#if UIP_BUFALIGN
+union uip_aligned_buf uip_aligned_buf; /* Holds uip_buf, UIP_BUFALIGN_PAD
+					  bytes in. */
+#else /* UIP_BUFALIGN */
 u8_t uip_buf[UIP_BUFSIZE + 2];   /* The packet buffer that contains
 				    incoming packets. */
+#endif /* UIP_BUFALIGN */
 #endif /* UIP_CONF_EXTERNAL_BUFFER */
 
 void *uip_appdata;               /* The uip_appdata pointer points to
@@ -195,11 +200,31 @@ static u16_t lastport;       /* Keeps track of the last port used for
 				a new connection. */
 #endif /* UIP_ACTIVE_OPEN */
 
+/* Copy and compare the 4-byte sequence numbers, which are big endian
+   byte arrays. */
+#if UIP_BUFALIGN
+#define UIP_SEQ_COPY(dest, src) uip_store32(dest, uip_load32(src))
+#define UIP_SEQ_EQ(a, b) (uip_load32(a) == uip_load32(b))
+#else /* UIP_BUFALIGN */
+#define UIP_SEQ_COPY(dest, src) do { \
+    (dest)[0] = (src)[0]; \
+    (dest)[1] = (src)[1]; \
+    (dest)[2] = (src)[2]; \
+    (dest)[3] = (src)[3]; \
+  } while(0)
+#define UIP_SEQ_EQ(a, b) ((a)[0] == (b)[0] && (a)[1] == (b)[1] && \
+			  (a)[2] == (b)[2] && (a)[3] == (b)[3])
+#endif /* UIP_BUFALIGN */
+
 /* Temporary variables. */
 #if UIP_TCP
 u8_t uip_acc32[4];
 static u8_t c, opt;
 static u16_t tmp16;
+#if UIP_SEND_WINDOW
+static u16_t uip_seqoff;      /* Offset from snd_nxt of the segment
+				 being sent. */
+#endif /* UIP_SEND_WINDOW */
 #endif /* UIP_TCP */
 
 /* Structures and definitions. */
@@ -254,6 +279,25 @@ void uip_log(char *msg);
 #endif /* UIP_LOGGING == 1 */
 
 #if ! UIP_ARCH_ADD32 && UIP_TCP
+#if UIP_BUFALIGN
+void
+uip_add32(u8_t *op32, u16_t op16)
+{
+  u32_t v = uip_load32(op32);
+
+  /* Tested the same way as for HTONS(): uip-conf.h sets
+     UIP_CONF_BYTE_ORDER to LITTLE_ENDIAN, which is not
+     UIP_LITTLE_ENDIAN. */
+#if UIP_BYTE_ORDER == UIP_BIG_ENDIAN
+  v += op16;
+#else /* UIP_BYTE_ORDER == UIP_BIG_ENDIAN */
+  v = (v >> 24) | ((v >> 8) & 0xff00) | ((v << 8) & 0xff0000) | (v << 24);
+  v += op16;
+  v = (v >> 24) | ((v >> 8) & 0xff00) | ((v << 8) & 0xff0000) | (v << 24);
+#endif /* UIP_BYTE_ORDER == UIP_BIG_ENDIAN */
+  uip_store32(uip_acc32, v);
+}
+#else /* UIP_BUFALIGN */
 void
 uip_add32(u8_t *op32, u16_t op16)
 {
@@ -281,8 +325,22 @@ uip_add32(u8_t *op32, u16_t op16)
   }
 }
 
+#endif /* UIP_BUFALIGN */
 #endif /* ! UIP_ARCH_ADD32 && UIP_TCP */
 
+#if UIP_SEND_WINDOW
+/* The distance from sequence number 'b' to 'a', both in network byte
+   order. */
+static u32_t
+uip_seq_sub(const u8_t *a, const u8_t *b)
+{
+  return (((u32_t)a[0] << 24) | ((u32_t)a[1] << 16) |
+	  ((u32_t)a[2] << 8) | a[3]) -
+    (((u32_t)b[0] << 24) | ((u32_t)b[1] << 16) |
+     ((u32_t)b[2] << 8) | b[3]);
+}
+#endif /* UIP_SEND_WINDOW */
+
 #if ! UIP_ARCH_CHKSUM
 /*---------------------------------------------------------------------------*/
 static u16_t
@@ -388,6 +446,150 @@ uip_udpchksum(void)
 #endif /* UIP_UDP_CHECKSUMS */
 #endif /* UIP_ARCH_CHKSUM */
 /*---------------------------------------------------------------------------*/
+#if UIP_TCP && UIP_TIME_WAIT_CONNS
+/* What is left of a connection in TIME_WAIT. Unused entries have
+   lport set to zero. */
+struct uip_time_wait {
+  uip_ipaddr_t ripaddr;
+  u16_t lport, rport;
+  u8_t rcv_nxt[4], snd_nxt[4];
+  clock_time_t tstamp;
+};
+static struct uip_time_wait uip_time_waits[UIP_TIME_WAIT_CONNS];
+#endif /* UIP_TCP && UIP_TIME_WAIT_CONNS */
+/*---------------------------------------------------------------------------*/
+#if UIP_TCP && UIP_CONN_HASH
+/* Connections that are in use are kept in uip_conn_hash[], by a hash
+   of the remote address and the two ports, and unused ones on
+   uip_conn_free. uIP closes connections in many places, so closed
+   connections stay hashed until a lookup or an allocation comes
+   across them and moves them to the free list. */
+static struct uip_conn *uip_conn_hash[UIP_CONN_HASH];
+static struct uip_conn *uip_conn_free;
+
+/* One bit per group of listening ports, checked before the ports
+   themselves. */
+static u16_t uip_listenmap;
+#define UIP_LISTENBIT(port) (1 << (((port) ^ ((port) >> 8)) & 15))
+
+static u8_t
+uip_conn_bucket(u16_t *ripaddr, u16_t rport, u16_t lport)
+{
+  u16_t h = rport ^ lport;
+  u8_t i;
+
+  for(i = 0; i < sizeof(uip_ipaddr_t) / 2; ++i) {
+    h ^= ripaddr[i];
+  }
+  h ^= h >> 8;
+  return h & (UIP_CONN_HASH - 1);
+}
+/*---------------------------------------------------------------------------*/
+static void
+uip_conn_insert(struct uip_conn *conn)
+{
+  struct uip_conn **head;
+
+  head = &uip_conn_hash[uip_conn_bucket((u16_t *)conn->ripaddr,
+					conn->rport, conn->lport)];
+  conn->hnext = *head;
+  *head = conn;
+}
+/*---------------------------------------------------------------------------*/
+/* Take a connection for a new TCP connection: an unused one if there
+   is any, or else the one that has been in TIME_WAIT the longest. */
+static struct uip_conn *
+uip_conn_alloc(void)
+{
+  struct uip_conn **p, *conn, **oldest;
+  u8_t i;
+
+  oldest = 0;
+  if(uip_conn_free == 0) {
+    for(i = 0; i < UIP_CONN_HASH; ++i) {
+      p = &uip_conn_hash[i];
+      while((conn = *p) != 0) {
+	if(conn->tcpstateflags == UIP_CLOSED) {
+	  *p = conn->hnext;
+	  conn->hnext = uip_conn_free;
+	  uip_conn_free = conn;
+	  continue;
+	}
+	if(conn->tcpstateflags == UIP_TIME_WAIT &&
+	   (oldest == 0 || conn->timer > (*oldest)->timer)) {
+	  oldest = p;
+	}
+	p = &conn->hnext;
+      }
+    }
+  }
+
+  conn = uip_conn_free;
+  if(conn != 0) {
+    uip_conn_free = conn->hnext;
+  } else if(oldest != 0) {
+    conn = *oldest;
+    *oldest = conn->hnext;
+  }
+  return conn;
+}
+#endif /* UIP_TCP && UIP_CONN_HASH */
+/*---------------------------------------------------------------------------*/
+#if UIP_TCP
+struct uip_conn *
+uip_conn_lookup(u16_t *ripaddr, u16_t rport, u16_t lport)
+{
+#if UIP_CONN_HASH
+  struct uip_conn **p, *conn;
+
+  p = &uip_conn_hash[uip_conn_bucket(ripaddr, rport, lport)];
+  while((conn = *p) != 0) {
+    if(conn->tcpstateflags == UIP_CLOSED) {
+      *p = conn->hnext;
+      conn->hnext = uip_conn_free;
+      uip_conn_free = conn;
+      continue;
+    }
+    if(conn->lport == lport && conn->rport == rport &&
+       uip_ipaddr_cmp(ripaddr, conn->ripaddr)) {
+      return conn;
+    }
+    p = &conn->hnext;
+  }
+#else /* UIP_CONN_HASH */
+  struct uip_conn *conn;
+
+  for(conn = &uip_conns[0]; conn <= &uip_conns[UIP_CONNS - 1]; ++conn) {
+    if(conn->tcpstateflags != UIP_CLOSED &&
+       lport == conn->lport &&
+       rport == conn->rport &&
+       uip_ipaddr_cmp(ripaddr, conn->ripaddr)) {
+      return conn;
+    }
+  }
+#endif /* UIP_CONN_HASH */
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+u8_t
+uip_listening(u16_t port)
+{
+  u8_t i;
+
+#if UIP_CONN_HASH
+  if(!(uip_listenmap & UIP_LISTENBIT(port))) {
+    return 0;
+  }
+#endif /* UIP_CONN_HASH */
+  for(i = 0; i < UIP_LISTENPORTS; ++i) {
+    if(uip_listenports[i] == port) {
+      return 1;
+    }
+  }
+  return 0;
+}
+#endif /* UIP_TCP */
+/*---------------------------------------------------------------------------*/
 void
 uip_init(void)
 {
@@ -398,6 +600,22 @@ uip_init(void)
   for(c = 0; c < UIP_CONNS; ++c) {
     uip_conns[c].tcpstateflags = UIP_CLOSED;
   }
+#if UIP_CONN_HASH
+  for(c = 0; c < UIP_CONN_HASH; ++c) {
+    uip_conn_hash[c] = 0;
+  }
+  uip_conn_free = 0;
+  for(c = 0; c < UIP_CONNS; ++c) {
+    uip_conns[c].hnext = uip_conn_free;
+    uip_conn_free = &uip_conns[c];
+  }
+  uip_listenmap = 0;
+#endif /* UIP_CONN_HASH */
+#if UIP_TIME_WAIT_CONNS
+  for(c = 0; c < UIP_TIME_WAIT_CONNS; ++c) {
+    uip_time_waits[c].lport = 0;
+  }
+#endif /* UIP_TIME_WAIT_CONNS */
 #endif /* UIP_TCP */
 #if UIP_ACTIVE_OPEN
   lastport = 1024;
@@ -421,7 +639,11 @@ uip_init(void)
 struct uip_conn *
 uip_connect(uip_ipaddr_t *ripaddr, u16_t rport)
 {
+#if UIP_CONN_HASH
+  register struct uip_conn *conn;
+#else /* UIP_CONN_HASH */
   register struct uip_conn *conn, *cconn;
+#endif /* UIP_CONN_HASH */
   
   /* Find an unused local port. */
  again:
@@ -441,6 +663,9 @@ uip_connect(uip_ipaddr_t *ripaddr, u16_t rport)
     }
   }
 
+#if UIP_CONN_HASH
+  conn = uip_conn_alloc();
+#else /* UIP_CONN_HASH */
   conn = 0;
   for(c = 0; c < UIP_CONNS; ++c) {
     cconn = &uip_conns[c];
@@ -455,6 +680,7 @@ uip_connect(uip_ipaddr_t *ripaddr, u16_t rport)
       }
     }
   }
+#endif /* UIP_CONN_HASH */
 
   if(conn == 0) {
     return 0;
@@ -462,22 +688,30 @@ uip_connect(uip_ipaddr_t *ripaddr, u16_t rport)
   
   conn->tcpstateflags = UIP_SYN_SENT;
 
-  conn->snd_nxt[0] = iss[0];
-  conn->snd_nxt[1] = iss[1];
-  conn->snd_nxt[2] = iss[2];
-  conn->snd_nxt[3] = iss[3];
+  UIP_SEQ_COPY(conn->snd_nxt, iss);
 
   conn->initialmss = conn->mss = UIP_TCP_MSS;
   
   conn->len = 1;   /* TCP length of the SYN is one. */
+#if UIP_SEND_WINDOW
+  conn->segs = conn->seghead = 0;
+  conn->segoff = 0;
+  conn->snd_wnd = UIP_TCP_MSS;
+#endif /* UIP_SEND_WINDOW */
   conn->nrtx = 0;
   conn->timer = 1; /* Send the SYN next time around. */
+#if UIP_TCP_CLOCK
+  conn->tstamp = clock_time();
+#endif /* UIP_TCP_CLOCK */
   conn->rto = UIP_RTO;
   conn->sa = 0;
   conn->sv = 16;   /* Initial value of the RTT variance. */
   conn->lport = htons(lastport);
   conn->rport = rport;
   uip_ipaddr_copy(&conn->ripaddr, ripaddr);
+#if UIP_CONN_HASH
+  uip_conn_insert(conn);
+#endif /* UIP_CONN_HASH */
   
   return conn;
 }
@@ -536,9 +770,17 @@ uip_unlisten(u16_t port)
   for(c = 0; c < UIP_LISTENPORTS; ++c) {
     if(uip_listenports[c] == port) {
       uip_listenports[c] = 0;
-      return;
+      break;
     }
   }
+#if UIP_CONN_HASH
+  uip_listenmap = 0;
+  for(c = 0; c < UIP_LISTENPORTS; ++c) {
+    if(uip_listenports[c] != 0) {
+      uip_listenmap |= UIP_LISTENBIT(uip_listenports[c]);
+    }
+  }
+#endif /* UIP_CONN_HASH */
 }
 #endif /* UIP_TCP */
 /*---------------------------------------------------------------------------*/
@@ -549,6 +791,9 @@ uip_listen(u16_t port)
   for(c = 0; c < UIP_LISTENPORTS; ++c) {
     if(uip_listenports[c] == 0) {
       uip_listenports[c] = port;
+#if UIP_CONN_HASH
+      uip_listenmap |= UIP_LISTENBIT(port);
+#endif /* UIP_CONN_HASH */
       return;
     }
   }
@@ -692,19 +937,158 @@ static void
 uip_add_rcv_nxt(u16_t n)
 {
   uip_add32(uip_conn->rcv_nxt, n);
-  uip_conn->rcv_nxt[0] = uip_acc32[0];
-  uip_conn->rcv_nxt[1] = uip_acc32[1];
-  uip_conn->rcv_nxt[2] = uip_acc32[2];
-  uip_conn->rcv_nxt[3] = uip_acc32[3];
+  UIP_SEQ_COPY(uip_conn->rcv_nxt, uip_acc32);
 }
 #endif /* UIP_TCP */
 /*---------------------------------------------------------------------------*/
+#if UIP_TCP_CLOCK
+/* Charge the time since the connection was last touched to its
+   timer. The timer counts up in TIME_WAIT and FIN_WAIT_2, and down
+   while there is outstanding data. */
+static void
+uip_timer_sync(struct uip_conn *conn)
+{
+  clock_time_t now = clock_time();
+  clock_time_t elapsed = now - conn->tstamp;
+
+  conn->tstamp = now;
+  if((conn->tcpstateflags & UIP_TS_MASK) == UIP_TIME_WAIT ||
+     (conn->tcpstateflags & UIP_TS_MASK) == UIP_FIN_WAIT_2) {
+    if(elapsed >= (clock_time_t)(UIP_TIME_WAIT_TIMEOUT - conn->timer)) {
+      conn->timer = UIP_TIME_WAIT_TIMEOUT;
+    } else {
+      conn->timer += elapsed;
+    }
+  } else if(uip_outstanding(conn)) {
+    if(elapsed >= conn->timer) {
+      conn->timer = 0;
+    } else {
+      conn->timer -= elapsed;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+u8_t
+uip_tcp_deadline(struct uip_conn *conn, clock_time_t *t)
+{
+  switch(conn->tcpstateflags & UIP_TS_MASK) {
+  case UIP_CLOSED:
+    return 0;
+  case UIP_TIME_WAIT:
+  case UIP_FIN_WAIT_2:
+    *t = conn->tstamp + (UIP_TIME_WAIT_TIMEOUT - conn->timer);
+    return 1;
+  }
+  if(uip_outstanding(conn)) {
+    *t = conn->tstamp + conn->timer;
+    return 1;
+  }
+  if((conn->tcpstateflags & UIP_TS_MASK) == UIP_ESTABLISHED) {
+    *t = conn->tstamp + UIP_POLL_INTERVAL;
+    return 1;
+  }
+  return 0;
+}
+#endif /* UIP_TCP_CLOCK */
+/*---------------------------------------------------------------------------*/
+#if UIP_TCP && UIP_TIME_WAIT_CONNS
+#if !UIP_TCP_CLOCK
+#error "UIP_TIME_WAIT_CONNS requires UIP_TCP_CLOCK"
+#endif /* !UIP_TCP_CLOCK */
+/* Close a connection that is to enter TIME_WAIT, and remember it in
+   uip_time_waits[] instead. An expired entry is taken first, or else
+   the oldest one. */
+static void
+uip_time_wait(struct uip_conn *conn)
+{
+  struct uip_time_wait *tw, *oldest;
+  clock_time_t now = clock_time();
+
+  oldest = &uip_time_waits[0];
+  for(tw = &uip_time_waits[0];
+      tw < &uip_time_waits[UIP_TIME_WAIT_CONNS]; ++tw) {
+    if(tw->lport == 0 ||
+       now - tw->tstamp >= UIP_TIME_WAIT_TIMEOUT) {
+      oldest = tw;
+      break;
+    }
+    if(now - tw->tstamp > now - oldest->tstamp) {
+      oldest = tw;
+    }
+  }
+  if(tw == &uip_time_waits[UIP_TIME_WAIT_CONNS]) {
+    UIP_STAT(++uip_stat.tcp.twdrop);
+  }
+
+  uip_ipaddr_copy(oldest->ripaddr, conn->ripaddr);
+  oldest->lport = conn->lport;
+  oldest->rport = conn->rport;
+  UIP_SEQ_COPY(oldest->rcv_nxt, conn->rcv_nxt);
+  UIP_SEQ_COPY(oldest->snd_nxt, conn->snd_nxt);
+  oldest->tstamp = now;
+
+  conn->tcpstateflags = UIP_CLOSED;
+}
+/*---------------------------------------------------------------------------*/
+/* Find the TIME_WAIT entry for a connection. Expired entries are
+   freed on the way. */
+static struct uip_time_wait *
+uip_time_wait_lookup(u16_t *ripaddr, u16_t rport, u16_t lport)
+{
+  struct uip_time_wait *tw;
+  clock_time_t now = clock_time();
+
+  for(tw = &uip_time_waits[0];
+      tw < &uip_time_waits[UIP_TIME_WAIT_CONNS]; ++tw) {
+    if(tw->lport == 0) {
+      continue;
+    }
+    if(now - tw->tstamp >= UIP_TIME_WAIT_TIMEOUT) {
+      tw->lport = 0;
+      continue;
+    }
+    if(tw->lport == lport && tw->rport == rport &&
+       uip_ipaddr_cmp(tw->ripaddr, ripaddr)) {
+      return tw;
+    }
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+u8_t
+uip_time_waiting(u16_t *ripaddr, u16_t rport, u16_t lport)
+{
+  return uip_time_wait_lookup(ripaddr, rport, lport) != 0;
+}
+/*---------------------------------------------------------------------------*/
+/* Check if the sequence number a comes after b. */
+static u8_t
+uip_seq_after(u8_t *a, u8_t *b)
+{
+  u8_t d[4];
+  u8_t i;
+  u16_t t, borrow;
+
+  borrow = 0;
+  i = 4;
+  while(i-- > 0) {
+    t = a[i] - b[i] - borrow;
+    d[i] = t & 0xff;
+    borrow = (t >> 8) & 1;
+  }
+  return !(d[0] & 0x80) && (d[0] | d[1] | d[2] | d[3]) != 0;
+}
+#endif /* UIP_TCP && UIP_TIME_WAIT_CONNS */
+/*---------------------------------------------------------------------------*/
 void
 uip_process(u8_t flag)
 {
 #if UIP_TCP
   register struct uip_conn *uip_connr = uip_conn;
 #endif /* UIP_TCP */
+#if UIP_TCP && UIP_TIME_WAIT_CONNS
+  struct uip_time_wait *uip_tw;
+#endif /* UIP_TCP && UIP_TIME_WAIT_CONNS */
 
 #if UIP_UDP
   if(flag == UIP_UDP_SEND_CONN) {
@@ -718,8 +1102,18 @@ uip_process(u8_t flag)
      particular connection. */
 #if UIP_TCP
   if(flag == UIP_POLL_REQUEST) {
+#if UIP_TCP_CLOCK
+    uip_timer_sync(uip_connr);
+#endif /* UIP_TCP_CLOCK */
+    /* Left over from the last segment, which may have been for
+       this connection. */
+    uip_slen = 0;
     if((uip_connr->tcpstateflags & UIP_TS_MASK) == UIP_ESTABLISHED &&
+#if UIP_SEND_WINDOW
+       uip_window_open(uip_connr)) {
+#else /* UIP_SEND_WINDOW */
        !uip_outstanding(uip_connr)) {
+#endif /* UIP_SEND_WINDOW */
 	uip_flags = UIP_POLL;
 	UIP_APPCALL();
 	goto appsend;
@@ -750,10 +1144,19 @@ uip_process(u8_t flag)
        for the connection to time out. If so, we increase the
        connection's timer and remove the connection if it times
        out. */
+#if UIP_TCP_CLOCK
+    /* The timers have been running since the connection was last
+       touched rather than for a single pulse. */
+    uip_timer_sync(uip_connr);
+#endif /* UIP_TCP_CLOCK */
     if(uip_connr->tcpstateflags == UIP_TIME_WAIT ||
        uip_connr->tcpstateflags == UIP_FIN_WAIT_2) {
+#if UIP_TCP_CLOCK
+      if(uip_connr->timer == UIP_TIME_WAIT_TIMEOUT) {
+#else /* UIP_TCP_CLOCK */
       ++(uip_connr->timer);
       if(uip_connr->timer == UIP_TIME_WAIT_TIMEOUT) {
+#endif /* UIP_TCP_CLOCK */
 	uip_connr->tcpstateflags = UIP_CLOSED;
       }
     } else if(uip_connr->tcpstateflags != UIP_CLOSED) {
@@ -761,7 +1164,11 @@ uip_process(u8_t flag)
 	 connection's timer and see if it has reached the RTO value
 	 in which case we retransmit. */
       if(uip_outstanding(uip_connr)) {
+#if UIP_TCP_CLOCK
+	if(uip_connr->timer == 0) {
+#else /* UIP_TCP_CLOCK */
 	if(uip_connr->timer-- == 0) {
+#endif /* UIP_TCP_CLOCK */
 	  if(uip_connr->nrtx == UIP_MAXRTX ||
 	     ((uip_connr->tcpstateflags == UIP_SYN_SENT ||
 	       uip_connr->tcpstateflags == UIP_SYN_RCVD) &&
@@ -779,10 +1186,13 @@ uip_process(u8_t flag)
 	    goto tcp_send_nodata;
 	  }
 
-	  /* Exponential backoff. */
-	  uip_connr->timer = UIP_RTO << (uip_connr->nrtx > 4?
-					 4:
-					 uip_connr->nrtx);
+	  /* Exponential backoff from the estimated timeout. */
+	  {
+	    u32_t backoff = (u32_t)uip_connr->rto << (uip_connr->nrtx > 4?
+						      4:
+						      uip_connr->nrtx);
+	    uip_connr->timer = backoff > UIP_RTO_MAX? UIP_RTO_MAX: backoff;
+	  }
 	  ++(uip_connr->nrtx);
 	  
 	  /* Ok, so we need to retransmit. We do this differently
@@ -806,6 +1216,23 @@ uip_process(u8_t flag)
 #endif /* UIP_ACTIVE_OPEN */
 	    
 	  case UIP_ESTABLISHED:
+#if UIP_REXMIT_CACHE
+	    /* The device driver may still hold the segment, in which
+	       case it has already been sent again. */
+	    if(uip_rexmit_cache_resend(uip_connr)) {
+	      goto drop;
+	    }
+#endif /* UIP_REXMIT_CACHE */
+#if UIP_SEND_WINDOW
+	    /* Resend the oldest segment from the window. The peer
+	       acknowledges the ones after it if it has them. */
+	    if(uip_connr->segs > 0) {
+	      uip_slen = uip_connr->seglen[uip_connr->seghead];
+	      uip_window_read(uip_connr, uip_connr->seghead,
+			      uip_connr->segoff, uip_sappdata, uip_slen);
+	      goto apprexmit;
+	    }
+#endif /* UIP_SEND_WINDOW */
 	    /* In the ESTABLISHED state, we call upon the application
                to do the actual retransmit after which we jump into
                the code for sending out the packet (the apprexmit
@@ -822,6 +1249,15 @@ uip_process(u8_t flag)
 	    
 	  }
 	}
+#if UIP_SEND_WINDOW
+	/* Data is in flight, but there may be room for more. */
+	if((uip_connr->tcpstateflags & UIP_TS_MASK) == UIP_ESTABLISHED &&
+	   uip_window_open(uip_connr)) {
+	  uip_flags = UIP_POLL;
+	  UIP_APPCALL();
+	  goto appsend;
+	}
+#endif /* UIP_SEND_WINDOW */
       } else if((uip_connr->tcpstateflags & UIP_TS_MASK) == UIP_ESTABLISHED) {
 	/* If there was no need for a retransmission, we poll the
            application for new data. */
@@ -963,7 +1399,7 @@ uip_process(u8_t flag)
 #endif /* UIP_CONF_IPV6 */
   }
 
-#if !UIP_CONF_IPV6
+#if !UIP_CONF_IPV6 && !UIP_CHECKSUM_OFFLOAD
   if(uip_ipchksum() != 0xffff) { /* Compute and check the IP header
 				    checksum. */
     UIP_STAT(++uip_stat.ip.drop);
@@ -971,7 +1407,7 @@ uip_process(u8_t flag)
     UIP_LOG("ip: bad checksum.");
     goto drop;
   }
-#endif /* UIP_CONF_IPV6 */
+#endif /* !UIP_CONF_IPV6 && !UIP_CHECKSUM_OFFLOAD */
 
 #if UIP_TCP
   if(BUF->proto == UIP_PROTO_TCP) { /* Check for TCP packet. If so,
@@ -1210,6 +1646,7 @@ uip_process(u8_t flag)
 
   /* Start of TCP input header processing code. */
   
+#if !UIP_CHECKSUM_OFFLOAD
   if(uip_tcpchksum() != 0xffff) {   /* Compute and check the TCP
 				       checksum. */
     UIP_STAT(++uip_stat.tcp.drop);
@@ -1217,19 +1654,35 @@ uip_process(u8_t flag)
     UIP_LOG("tcp: bad checksum.");
     goto drop;
   }
+#endif /* !UIP_CHECKSUM_OFFLOAD */
   
   
   /* Demultiplex this segment. */
   /* First check any active connections. */
-  for(uip_connr = &uip_conns[0]; uip_connr <= &uip_conns[UIP_CONNS - 1];
-      ++uip_connr) {
-    if(uip_connr->tcpstateflags != UIP_CLOSED &&
-       BUF->destport == uip_connr->lport &&
-       BUF->srcport == uip_connr->rport &&
-       uip_ipaddr_cmp(BUF->srcipaddr, uip_connr->ripaddr)) {
-      goto found;
+  uip_connr = uip_conn_lookup(BUF->srcipaddr, BUF->srcport, BUF->destport);
+  if(uip_connr != 0) {
+    goto found;
+  }
+
+#if UIP_TIME_WAIT_CONNS
+  /* Then check connections in TIME_WAIT. Anything but a RST or a SYN
+     that starts a new connection for the same ports gets the ACK the
+     old connection would have sent. */
+  uip_tw = uip_time_wait_lookup(BUF->srcipaddr, BUF->srcport,
+				BUF->destport);
+  if(uip_tw != 0) {
+    if(BUF->flags & TCP_RST) {
+      uip_tw->lport = 0;
+      goto drop;
+    }
+    if((BUF->flags & TCP_CTL) != TCP_SYN ||
+       !uip_seq_after(BUF->seqno, uip_tw->rcv_nxt)) {
+      goto tcp_send_time_wait;
     }
+    uip_tw->lport = 0;
+    UIP_STAT(++uip_stat.tcp.twreuse);
   }
+#endif /* UIP_TIME_WAIT_CONNS */
 
   /* If we didn't find and active connection that expected the packet,
      either this packet is an old duplicate, or this is a SYN packet
@@ -1239,11 +1692,9 @@ uip_process(u8_t flag)
     goto reset;
   }
   
-  tmp16 = BUF->destport;
   /* Next, check listening connections. */
-  for(c = 0; c < UIP_LISTENPORTS; ++c) {
-    if(tmp16 == uip_listenports[c])
-      goto found_listen;
+  if(uip_listening(BUF->destport)) {
+    goto found_listen;
   }
   
   /* No matching connection found, so we send a RST packet. */
@@ -1301,6 +1752,28 @@ uip_process(u8_t flag)
   /* And send out the RST packet! */
   goto tcp_send_noconn;
 
+#if UIP_TIME_WAIT_CONNS
+  /* Acknowledge a segment for a connection in TIME_WAIT, with the
+     sequence numbers that were saved for it. */
+ tcp_send_time_wait:
+  BUF->flags = TCP_ACK;
+  uip_len = UIP_IPTCPH_LEN;
+  BUF->tcpoffset = 5 << 4;
+  UIP_SEQ_COPY(BUF->seqno, uip_tw->snd_nxt);
+  UIP_SEQ_COPY(BUF->ackno, uip_tw->rcv_nxt);
+
+  tmp16 = BUF->srcport;
+  BUF->srcport = BUF->destport;
+  BUF->destport = tmp16;
+
+  uip_ipaddr_copy(BUF->destipaddr, BUF->srcipaddr);
+  uip_ipaddr_copy(BUF->srcipaddr, uip_hostaddr);
+
+  BUF->wnd[0] = ((UIP_RECEIVE_WINDOW) >> 8);
+  BUF->wnd[1] = ((UIP_RECEIVE_WINDOW) & 0xff);
+  goto tcp_send_noconn;
+#endif /* UIP_TIME_WAIT_CONNS */
+
   /* This label will be jumped to if we matched the incoming packet
      with a connection in LISTEN. In that case, we should create a new
      connection and send a SYNACK in return. */
@@ -1311,6 +1784,9 @@ uip_process(u8_t flag)
      TIME_WAIT are kept track of and we'll use the oldest one if no
      CLOSED connections are found. Thanks to Eddie C. Dost for a very
      nice algorithm for the TIME_WAIT search. */
+#if UIP_CONN_HASH
+  uip_connr = uip_conn_alloc();
+#else /* UIP_CONN_HASH */
   uip_connr = 0;
   for(c = 0; c < UIP_CONNS; ++c) {
     if(uip_conns[c].tcpstateflags == UIP_CLOSED) {
@@ -1324,6 +1800,7 @@ uip_process(u8_t flag)
       }
     }
   }
+#endif /* UIP_CONN_HASH */
 
   if(uip_connr == 0) {
     /* All connections are used already, we drop packet and hope that
@@ -1337,6 +1814,9 @@ uip_process(u8_t flag)
   
   /* Fill in the necessary fields for the new connection. */
   uip_connr->rto = uip_connr->timer = UIP_RTO;
+#if UIP_TCP_CLOCK
+  uip_connr->tstamp = clock_time();
+#endif /* UIP_TCP_CLOCK */
   uip_connr->sa = 0;
   uip_connr->sv = 4;
   uip_connr->nrtx = 0;
@@ -1344,18 +1824,23 @@ uip_process(u8_t flag)
   uip_connr->rport = BUF->srcport;
   uip_ipaddr_copy(uip_connr->ripaddr, BUF->srcipaddr);
   uip_connr->tcpstateflags = UIP_SYN_RCVD;
+#if UIP_CONN_HASH
+  uip_conn_insert(uip_connr);
+#endif /* UIP_CONN_HASH */
 
-  uip_connr->snd_nxt[0] = iss[0];
-  uip_connr->snd_nxt[1] = iss[1];
-  uip_connr->snd_nxt[2] = iss[2];
-  uip_connr->snd_nxt[3] = iss[3];
+  UIP_SEQ_COPY(uip_connr->snd_nxt, iss);
   uip_connr->len = 1;
+#if UIP_SEND_WINDOW
+  uip_connr->segs = uip_connr->seghead = 0;
+  uip_connr->segoff = 0;
+  uip_connr->snd_wnd = UIP_TCP_MSS;
+#endif /* UIP_SEND_WINDOW */
+
+  /* Used as is unless the SYN carries an MSS option. */
+  uip_connr->initialmss = uip_connr->mss = UIP_TCP_MSS;
 
   /* rcv_nxt should be the seqno from the incoming packet + 1. */
-  uip_connr->rcv_nxt[3] = BUF->seqno[3];
-  uip_connr->rcv_nxt[2] = BUF->seqno[2];
-  uip_connr->rcv_nxt[1] = BUF->seqno[1];
-  uip_connr->rcv_nxt[0] = BUF->seqno[0];
+  UIP_SEQ_COPY(uip_connr->rcv_nxt, BUF->seqno);
   uip_add_rcv_nxt(1);
 
   /* Parse the TCP MSS option, if present. */
@@ -1417,6 +1902,9 @@ uip_process(u8_t flag)
  found:
   uip_conn = uip_connr;
   uip_flags = 0;
+#if UIP_TCP_CLOCK
+  uip_timer_sync(uip_connr);
+#endif /* UIP_TCP_CLOCK */
   /* We do a very naive form of TCP reset processing; we just accept
      any RST and kill our connection. We should in fact check if the
      sequence number of this reset is wihtin our advertised window
@@ -1442,10 +1930,7 @@ uip_process(u8_t flag)
   if(!(((uip_connr->tcpstateflags & UIP_TS_MASK) == UIP_SYN_SENT) &&
        ((BUF->flags & TCP_CTL) == (TCP_SYN | TCP_ACK)))) {
     if((uip_len > 0 || ((BUF->flags & (TCP_SYN | TCP_FIN)) != 0)) &&
-       (BUF->seqno[0] != uip_connr->rcv_nxt[0] ||
-	BUF->seqno[1] != uip_connr->rcv_nxt[1] ||
-	BUF->seqno[2] != uip_connr->rcv_nxt[2] ||
-	BUF->seqno[3] != uip_connr->rcv_nxt[3])) {
+       !UIP_SEQ_EQ(BUF->seqno, uip_connr->rcv_nxt)) {
       goto tcp_send_ack;
     }
   }
@@ -1455,22 +1940,48 @@ uip_process(u8_t flag)
      the outstanding data, calculate RTT estimations, and reset the
      retransmission timer. */
   if((BUF->flags & TCP_ACK) && uip_outstanding(uip_connr)) {
+#if UIP_SEND_WINDOW
+    /* The ACK may end anywhere in the data in flight, for instance
+       when the peer has coalesced segments. tmp16 is the number of
+       bytes it acknowledges, and c the number of segments it covers
+       whole. A connection without segments has a SYN or FIN
+       outstanding. */
+    if(uip_connr->segs > 0) {
+      if(uip_seq_sub(BUF->ackno, uip_connr->snd_nxt) - 1 <
+	 uip_connr->len) {
+	tmp16 = uip_seq_sub(BUF->ackno, uip_connr->snd_nxt);
+	uip_add32(uip_connr->snd_nxt, tmp16);
+	for(c = 0; c < uip_connr->segs; ++c) {
+	  if(uip_connr->seglen[(uip_connr->seghead + c) %
+			       UIP_SEND_WINDOW] > tmp16) {
+	    break;
+	  }
+	  tmp16 -= uip_connr->seglen[(uip_connr->seghead + c) %
+				     UIP_SEND_WINDOW];
+	}
+      } else {
+	/* A duplicate, or beyond what was sent: does not match */
+	uip_add32(uip_connr->snd_nxt, uip_connr->len);
+      }
+    } else {
+      uip_add32(uip_connr->snd_nxt, uip_connr->len);
+    }
+#else /* UIP_SEND_WINDOW */
     uip_add32(uip_connr->snd_nxt, uip_connr->len);
+#endif /* UIP_SEND_WINDOW */
 
-    if(BUF->ackno[0] == uip_acc32[0] &&
-       BUF->ackno[1] == uip_acc32[1] &&
-       BUF->ackno[2] == uip_acc32[2] &&
-       BUF->ackno[3] == uip_acc32[3]) {
+    if(UIP_SEQ_EQ(BUF->ackno, uip_acc32)) {
       /* Update sequence number. */
-      uip_connr->snd_nxt[0] = uip_acc32[0];
-      uip_connr->snd_nxt[1] = uip_acc32[1];
-      uip_connr->snd_nxt[2] = uip_acc32[2];
-      uip_connr->snd_nxt[3] = uip_acc32[3];
+      UIP_SEQ_COPY(uip_connr->snd_nxt, uip_acc32);
 	
 
       /* Do RTT estimation, unless we have done retransmissions. */
       if(uip_connr->nrtx == 0) {
+#if UIP_TCP_CLOCK
+	short m;
+#else /* UIP_TCP_CLOCK */
 	signed char m;
+#endif /* UIP_TCP_CLOCK */
 	m = uip_connr->rto - uip_connr->timer;
 	/* This is taken directly from VJs original code in his paper */
 	m = m - (uip_connr->sa >> 3);
@@ -1481,6 +1992,11 @@ uip_process(u8_t flag)
 	m = m - (uip_connr->sv >> 2);
 	uip_connr->sv += m;
 	uip_connr->rto = (uip_connr->sa >> 3) + uip_connr->sv;
+	if(uip_connr->rto < UIP_RTO_MIN) {
+	  uip_connr->rto = UIP_RTO_MIN;
+	} else if(uip_connr->rto > UIP_RTO_MAX) {
+	  uip_connr->rto = UIP_RTO_MAX;
+	}
 
       }
       /* Set the acknowledged flag. */
@@ -1489,11 +2005,41 @@ uip_process(u8_t flag)
       uip_connr->timer = uip_connr->rto;
 
       /* Reset length of outstanding data. */
+#if UIP_SEND_WINDOW
+      if(uip_connr->segs > 0) {
+	/* Drop the acknowledged segments from the window, and the
+	   acknowledged start of the next one. */
+	for(; c > 0; --c) {
+	  uip_connr->len -= uip_connr->seglen[uip_connr->seghead];
+	  uip_connr->seghead = (uip_connr->seghead + 1) % UIP_SEND_WINDOW;
+	  --(uip_connr->segs);
+	  uip_connr->segoff = 0;
+	}
+	uip_connr->len -= tmp16;
+	uip_connr->seglen[uip_connr->seghead] -= tmp16;
+	uip_connr->segoff += tmp16;
+	uip_connr->nrtx = 0;
+      } else {
+	uip_connr->len = 0;
+      }
+#else /* UIP_SEND_WINDOW */
       uip_connr->len = 0;
+#endif /* UIP_SEND_WINDOW */
     }
     
   }
 
+#if UIP_SEND_WINDOW
+  /* Track the window of the remote host. A zero window still lets
+     one segment through, as a window probe. */
+  if(BUF->flags & TCP_ACK) {
+    uip_connr->snd_wnd = ((u16_t)BUF->wnd[0] << 8) + (u16_t)BUF->wnd[1];
+    if(uip_connr->snd_wnd == 0) {
+      uip_connr->snd_wnd = uip_connr->initialmss;
+    }
+  }
+#endif /* UIP_SEND_WINDOW */
+
   /* Do different things depending on in what state the connection is. */
   switch(uip_connr->tcpstateflags & UIP_TS_MASK) {
     /* CLOSED and LISTEN are not handled here. CLOSE_WAIT is not
@@ -1560,10 +2106,7 @@ uip_process(u8_t flag)
 	}
       }
       uip_connr->tcpstateflags = UIP_ESTABLISHED;
-      uip_connr->rcv_nxt[0] = BUF->seqno[0];
-      uip_connr->rcv_nxt[1] = BUF->seqno[1];
-      uip_connr->rcv_nxt[2] = BUF->seqno[2];
-      uip_connr->rcv_nxt[3] = BUF->seqno[3];
+      UIP_SEQ_COPY(uip_connr->rcv_nxt, BUF->seqno);
       uip_add_rcv_nxt(1);
       uip_flags = UIP_CONNECTED | UIP_NEWDATA;
       uip_connr->len = 0;
@@ -1689,6 +2232,21 @@ uip_process(u8_t flag)
 	goto tcp_send_nodata;
       }
 
+#if UIP_SEND_WINDOW
+      /* The FIN has to follow the data in flight, so it is held back
+	 until all of it has been acknowledged. */
+      if((uip_flags & UIP_CLOSE) && uip_connr->segs > 0) {
+	uip_connr->tcpstateflags |= UIP_CLOSE_PENDING;
+	uip_flags &= ~UIP_CLOSE;
+      }
+      if(uip_connr->tcpstateflags & UIP_CLOSE_PENDING) {
+	uip_slen = 0;
+	if(uip_connr->segs == 0) {
+	  uip_flags |= UIP_CLOSE;
+	}
+      }
+#endif /* UIP_SEND_WINDOW */
+
       if(uip_flags & UIP_CLOSE) {
 	uip_slen = 0;
 	uip_connr->len = 1;
@@ -1700,6 +2258,30 @@ uip_process(u8_t flag)
 
       /* If uip_slen > 0, the application has data to be sent. */
       if(uip_slen > 0) {
+#if UIP_SEND_WINDOW
+	/* The segment goes into the next free window slot, and is
+	   sent after the data already in flight. */
+	if(uip_window_open(uip_connr)) {
+	  if(uip_slen > uip_connr->mss) {
+	    uip_slen = uip_connr->mss;
+	  }
+	  if(uip_slen > uip_connr->snd_wnd - uip_connr->len) {
+	    uip_slen = uip_connr->snd_wnd - uip_connr->len;
+	  }
+	  c = (uip_connr->seghead + uip_connr->segs) % UIP_SEND_WINDOW;
+	  uip_window_write(uip_connr, c, uip_sappdata, uip_slen);
+	  uip_connr->seglen[c] = uip_slen;
+	  ++(uip_connr->segs);
+	  uip_seqoff = uip_connr->len;
+	  uip_connr->len += uip_slen;
+	} else {
+	  /* No room, the data is discarded. */
+	  uip_slen = 0;
+	}
+      }
+      /* The retransmission counter is only reset by ACKs, since
+	 sending more data says nothing about the remote host. */
+#else /* UIP_SEND_WINDOW */
 
 	/* If the connection has acknowledged data, the contents of
 	   the ->len variable should be discarded. */
@@ -1731,6 +2313,7 @@ uip_process(u8_t flag)
 	}
       }
       uip_connr->nrtx = 0;
+#endif /* UIP_SEND_WINDOW */
     apprexmit:
       uip_appdata = uip_sappdata;
       
@@ -1738,7 +2321,11 @@ uip_process(u8_t flag)
          packet had new data in it, we must send out a packet. */
       if(uip_slen > 0 && uip_connr->len > 0) {
 	/* Add the length of the IP and TCP headers. */
+#if UIP_SEND_WINDOW
+	uip_len = uip_slen + UIP_TCPIP_HLEN;
+#else /* UIP_SEND_WINDOW */
 	uip_len = uip_connr->len + UIP_TCPIP_HLEN;
+#endif /* UIP_SEND_WINDOW */
 	/* We always set the ACK flag in response packets. */
 	BUF->flags = TCP_ACK | TCP_PSH;
 	/* Send the packet. */
@@ -1771,14 +2358,18 @@ uip_process(u8_t flag)
       uip_add_rcv_nxt(uip_len);
     }
     if(BUF->flags & TCP_FIN) {
+      uip_add_rcv_nxt(1);
       if(uip_flags & UIP_ACKDATA) {
+	uip_connr->len = 0;
+#if UIP_TIME_WAIT_CONNS
+	uip_time_wait(uip_connr);
+#else /* UIP_TIME_WAIT_CONNS */
 	uip_connr->tcpstateflags = UIP_TIME_WAIT;
 	uip_connr->timer = 0;
-	uip_connr->len = 0;
+#endif /* UIP_TIME_WAIT_CONNS */
       } else {
 	uip_connr->tcpstateflags = UIP_CLOSING;
       }
-      uip_add_rcv_nxt(1);
       uip_flags = UIP_CLOSE;
       UIP_APPCALL();
       goto tcp_send_ack;
@@ -1797,9 +2388,13 @@ uip_process(u8_t flag)
       uip_add_rcv_nxt(uip_len);
     }
     if(BUF->flags & TCP_FIN) {
+      uip_add_rcv_nxt(1);
+#if UIP_TIME_WAIT_CONNS
+      uip_time_wait(uip_connr);
+#else /* UIP_TIME_WAIT_CONNS */
       uip_connr->tcpstateflags = UIP_TIME_WAIT;
       uip_connr->timer = 0;
-      uip_add_rcv_nxt(1);
+#endif /* UIP_TIME_WAIT_CONNS */
       uip_flags = UIP_CLOSE;
       UIP_APPCALL();
       goto tcp_send_ack;
@@ -1814,8 +2409,12 @@ uip_process(u8_t flag)
     
   case UIP_CLOSING:
     if(uip_flags & UIP_ACKDATA) {
+#if UIP_TIME_WAIT_CONNS
+      uip_time_wait(uip_connr);
+#else /* UIP_TIME_WAIT_CONNS */
       uip_connr->tcpstateflags = UIP_TIME_WAIT;
       uip_connr->timer = 0;
+#endif /* UIP_TIME_WAIT_CONNS */
     }
   }
   goto drop;
@@ -1834,15 +2433,21 @@ uip_process(u8_t flag)
      reply. Our job is to fill in all the fields of the TCP and IP
      headers before calculating the checksum and finally send the
      packet. */
-  BUF->ackno[0] = uip_connr->rcv_nxt[0];
-  BUF->ackno[1] = uip_connr->rcv_nxt[1];
-  BUF->ackno[2] = uip_connr->rcv_nxt[2];
-  BUF->ackno[3] = uip_connr->rcv_nxt[3];
+  UIP_SEQ_COPY(BUF->ackno, uip_connr->rcv_nxt);
   
-  BUF->seqno[0] = uip_connr->snd_nxt[0];
-  BUF->seqno[1] = uip_connr->snd_nxt[1];
-  BUF->seqno[2] = uip_connr->snd_nxt[2];
-  BUF->seqno[3] = uip_connr->snd_nxt[3];
+#if UIP_SEND_WINDOW
+  /* Segments without data carry the sequence number following the
+     data in flight, or the remote host may find them out of window. */
+  if(uip_len == UIP_IPTCPH_LEN && BUF->flags == TCP_ACK &&
+     (uip_connr->tcpstateflags & UIP_TS_MASK) == UIP_ESTABLISHED) {
+    uip_seqoff = uip_connr->segs > 0 ? uip_connr->len : 0;
+  }
+  uip_add32(uip_connr->snd_nxt, uip_seqoff);
+  uip_seqoff = 0;
+  UIP_SEQ_COPY(BUF->seqno, uip_acc32);
+#else /* UIP_SEND_WINDOW */
+  UIP_SEQ_COPY(BUF->seqno, uip_connr->snd_nxt);
+#endif /* UIP_SEND_WINDOW */
 
   BUF->proto = UIP_PROTO_TCP;
   
@@ -1877,7 +2482,9 @@ uip_process(u8_t flag)
   
   /* Calculate TCP checksum. */
   BUF->tcpchksum = 0;
+#if !UIP_CHECKSUM_OFFLOAD
   BUF->tcpchksum = ~(uip_tcpchksum());
+#endif /* !UIP_CHECKSUM_OFFLOAD */
 #endif /* UIP_TCP */
   
  ip_send_nolen:
@@ -1895,7 +2502,9 @@ uip_process(u8_t flag)
   BUF->ipid[1] = ipid & 0xff;
   /* Calculate IP checksum. */
   BUF->ipchksum = 0;
+#if !UIP_CHECKSUM_OFFLOAD
   BUF->ipchksum = ~(uip_ipchksum());
+#endif /* !UIP_CHECKSUM_OFFLOAD */
   DEBUG_PRINTF("uip ip_send_nolen: chkecum 0x%04x\n", uip_ipchksum());
 #endif /* UIP_CONF_IPV6 */
    
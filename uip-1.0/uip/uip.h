@@ -419,12 +419,47 @@ void uip_setipid(u16_t id);
  }
  \endcode
  */
+#if UIP_BUFALIGN
+/* The padding in front of the link level header that makes the IP
+   header word aligned. An external buffer must start this many bytes
+   into a word aligned buffer as well. */
+#define UIP_BUFALIGN_PAD ((4 - UIP_LLH_LEN % 4) % 4)
+#endif /* UIP_BUFALIGN */
+
 #ifdef UIP_CONF_EXTERNAL_BUFFER
 extern u8_t *uip_buf;
+#elif UIP_BUFALIGN
+extern union uip_aligned_buf {
+  u32_t u32[(UIP_BUFALIGN_PAD + UIP_BUFSIZE + 2 + 3) / 4];
+  u8_t u8[UIP_BUFALIGN_PAD + UIP_BUFSIZE + 2];
+} uip_aligned_buf;
+#define uip_buf (uip_aligned_buf.u8 + UIP_BUFALIGN_PAD)
 #else
 extern u8_t uip_buf[UIP_BUFSIZE+2];
 #endif
 
+#if UIP_BUFALIGN
+#include <string.h>
+
+/* 32-bit access to the fields that UIP_BUFALIGN aligns. Going through
+   memcpy() keeps this correct for operands that are not aligned,
+   while compiling to a single load or store on targets that allow
+   unaligned access. */
+static inline u32_t
+uip_load32(const void *p)
+{
+  u32_t v;
+  memcpy(&v, p, 4);
+  return v;
+}
+
+static inline void
+uip_store32(void *p, u32_t v)
+{
+  memcpy(p, &v, 4);
+}
+#endif /* UIP_BUFALIGN */
+
 /** @} */
 
 /*---------------------------------------------------------------------------*/
@@ -467,6 +502,47 @@ void uip_listen(u16_t port);
  */
 void uip_unlisten(u16_t port);
 
+/**
+ * Check if uIP listens on a TCP port.
+ *
+ * \param port A 16-bit port number in network byte order.
+ *
+ * \return Non-zero if uip_listen() has been called for the port.
+ */
+u8_t uip_listening(u16_t port);
+
+/**
+ * Find the TCP connection that a segment belongs to.
+ *
+ * \param ripaddr The IP address of the remote host.
+ *
+ * \param rport The remote port, in network byte order.
+ *
+ * \param lport The local port, in network byte order.
+ *
+ * \return The connection, or NULL if there is no such open
+ * connection.
+ */
+struct uip_conn *uip_conn_lookup(u16_t *ripaddr, u16_t rport, u16_t lport);
+
+#if UIP_TIME_WAIT_CONNS
+/**
+ * Check if a TCP connection is in TIME_WAIT.
+ *
+ * Connections in TIME_WAIT are no longer found by uip_conn_lookup(),
+ * but uIP still answers their segments.
+ *
+ * \param ripaddr The IP address of the remote host.
+ *
+ * \param rport The remote port, in network byte order.
+ *
+ * \param lport The local port, in network byte order.
+ *
+ * \return Non-zero if the connection is remembered in TIME_WAIT.
+ */
+u8_t uip_time_waiting(u16_t *ripaddr, u16_t rport, u16_t lport);
+#endif /* UIP_TIME_WAIT_CONNS */
+
 /**
  * Connect to a remote host using TCP.
  *
@@ -514,6 +590,33 @@ struct uip_conn *uip_connect(uip_ipaddr_t *ripaddr, u16_t port);
  */
 #define uip_outstanding(conn) ((conn)->len)
 
+#if UIP_SEND_WINDOW
+/**
+ * \internal
+ *
+ * Check if a connection may send another segment: there is a free
+ * window slot, the peer has room for more data and the application
+ * has not closed the connection.
+ *
+ * \param conn A pointer to the uip_conn structure for the connection.
+ *
+ * \hideinitializer
+ */
+#define uip_window_open(conn) ((conn)->segs < UIP_SEND_WINDOW && \
+                               (conn)->len < (conn)->snd_wnd && \
+                               !((conn)->tcpstateflags & UIP_CLOSE_PENDING))
+
+/**
+ * Check if the current connection can send another segment.
+ *
+ * Only available with UIP_SEND_WINDOW. Data sent while this is
+ * false is discarded.
+ *
+ * \hideinitializer
+ */
+#define uip_cansend() uip_window_open(uip_conn)
+#endif /* UIP_SEND_WINDOW */
+
 /**
  * Send data on the current connection.
  *
@@ -883,10 +986,14 @@ struct uip_udp_conn *uip_udp_new(uip_ipaddr_t *ripaddr, u16_t rport);
  * \hideinitializer
  */
 #if !UIP_CONF_IPV6
+#if UIP_BUFALIGN
+#define uip_ipaddr_copy(dest, src) uip_store32(dest, uip_load32(src))
+#else /* UIP_BUFALIGN */
 #define uip_ipaddr_copy(dest, src) do { \
                      ((u16_t *)dest)[0] = ((u16_t *)src)[0]; \
                      ((u16_t *)dest)[1] = ((u16_t *)src)[1]; \
                   } while(0)
+#endif /* UIP_BUFALIGN */
 #else /* !UIP_CONF_IPV6 */
 #define uip_ipaddr_copy(dest, src) memcpy(dest, src, sizeof(uip_ip6addr_t))
 #endif /* !UIP_CONF_IPV6 */
@@ -912,8 +1019,12 @@ struct uip_udp_conn *uip_udp_new(uip_ipaddr_t *ripaddr, u16_t rport);
  * \hideinitializer
  */
 #if !UIP_CONF_IPV6
+#if UIP_BUFALIGN
+#define uip_ipaddr_cmp(addr1, addr2) (uip_load32(addr1) == uip_load32(addr2))
+#else /* UIP_BUFALIGN */
 #define uip_ipaddr_cmp(addr1, addr2) (((u16_t *)addr1)[0] == ((u16_t *)addr2)[0] && \
 				      ((u16_t *)addr1)[1] == ((u16_t *)addr2)[1])
+#endif /* UIP_BUFALIGN */
 #else /* !UIP_CONF_IPV6 */
 #define uip_ipaddr_cmp(addr1, addr2) (memcmp(addr1, addr2, sizeof(uip_ip6addr_t)) == 0)
 #endif /* !UIP_CONF_IPV6 */
@@ -1171,15 +1282,39 @@ struct uip_conn {
 			 connection. */
   u16_t initialmss;   /**< Initial maximum segment size for the
 			 connection. */
+#if UIP_TCP_CLOCK
+  u16_t sa;           /**< Retransmission time-out calculation state
+			 variable. */
+  u16_t sv;           /**< Retransmission time-out calculation state
+			 variable. */
+  u16_t rto;          /**< Retransmission time-out. */
+  u16_t timer;        /**< The retransmission timer. */
+  clock_time_t tstamp; /**< When the timer was last brought up to
+			  date. */
+#else /* UIP_TCP_CLOCK */
   u8_t sa;            /**< Retransmission time-out calculation state
 			 variable. */
   u8_t sv;            /**< Retransmission time-out calculation state
 			 variable. */
   u8_t rto;           /**< Retransmission time-out. */
-  u8_t tcpstateflags; /**< TCP state and flags. */
   u8_t timer;         /**< The retransmission timer. */
+#endif /* UIP_TCP_CLOCK */
+  u8_t tcpstateflags; /**< TCP state and flags. */
   u8_t nrtx;          /**< The number of retransmissions for the last
 			 segment sent. */
+#if UIP_CONN_HASH
+  struct uip_conn *hnext; /**< The next connection in the same hash
+			     bucket or on the free list. */
+#endif /* UIP_CONN_HASH */
+#if UIP_SEND_WINDOW
+  u16_t snd_wnd;      /**< The window advertised by the remote host. */
+  u16_t seglen[UIP_SEND_WINDOW]; /**< Lengths of the unacknowledged
+				    segments, by window slot. */
+  u16_t segoff;       /**< Offset of the unacknowledged data in the
+			 slot of the oldest segment. */
+  u8_t seghead;       /**< Window slot of the oldest segment. */
+  u8_t segs;          /**< Number of unacknowledged segments. */
+#endif /* UIP_SEND_WINDOW */
 
   /** The application state. */
   uip_tcp_appstate_t appstate;
@@ -1195,6 +1330,57 @@ struct uip_conn {
 extern struct uip_conn *uip_conn;
 /* The array containing all uIP connections. */
 extern struct uip_conn uip_conns[UIP_CONNS];
+/* The TCP ports uIP is listening on, in network byte order. */
+extern u16_t uip_listenports[UIP_LISTENPORTS];
+
+#if UIP_REXMIT_CACHE
+/**
+ * Retransmit the unacknowledged segment of a connection.
+ *
+ * This function must be implemented by the device driver when
+ * UIP_REXMIT_CACHE is set. It should send its copy of the last
+ * segment sent on the connection, provided that segment starts at
+ * conn->snd_nxt and carries conn->len bytes.
+ *
+ * \return Non-zero if the segment was retransmitted, zero if the
+ * application has to regenerate it.
+ */
+int uip_rexmit_cache_resend(struct uip_conn *conn);
+#endif /* UIP_REXMIT_CACHE */
+
+#if UIP_TCP_CLOCK
+/**
+ * Find out when a connection next needs periodic processing.
+ *
+ * Only available with UIP_TCP_CLOCK. The connection needs a call to
+ * uip_periodic() or uip_periodic_conn() once clock_time() has
+ * reached the returned time, to retransmit, to time out or to poll
+ * the application.
+ *
+ * \param conn A pointer to the uip_conn struct for the connection.
+ *
+ * \param t Set to the deadline as a clock_time() value.
+ *
+ * \return Zero if the connection has no deadline, i.e., it is closed.
+ */
+u8_t uip_tcp_deadline(struct uip_conn *conn, clock_time_t *t);
+#endif /* UIP_TCP_CLOCK */
+
+#if UIP_SEND_WINDOW
+/**
+ * Store and fetch the copy of a segment in the send window.
+ *
+ * These functions must be provided by the system when
+ * UIP_SEND_WINDOW is set. Each connection needs room for
+ * UIP_SEND_WINDOW segments of up to UIP_TCP_MSS bytes, and 'slot'
+ * is in the range 0 to UIP_SEND_WINDOW - 1. A segment the peer has
+ * acknowledged in part is read from 'offset' into its slot.
+ */
+void uip_window_write(struct uip_conn *conn, u8_t slot,
+                      const void *data, u16_t len);
+void uip_window_read(struct uip_conn *conn, u8_t slot, u16_t offset,
+                     void *data, u16_t len);
+#endif /* UIP_SEND_WINDOW */
 #endif /* UIP_TCP */
 /**
  * \addtogroup uiparch
@@ -1280,6 +1466,12 @@ struct uip_stats {
 			     connections was avaliable. */
     uip_stats_t synrst;   /**< Number of SYNs for closed ports,
 			     triggering a RST. */
+#if UIP_TIME_WAIT_CONNS
+    uip_stats_t twreuse;  /**< Number of SYNs that ended a TIME_WAIT
+			     for the same ports. */
+    uip_stats_t twdrop;   /**< Number of TIME_WAIT entries forgotten
+			     early because the table was full. */
+#endif /* UIP_TIME_WAIT_CONNS */
   } tcp;                  /**< TCP statistics. */
 #endif /* UIP_TCP */
 #if UIP_UDP
@@ -1291,6 +1483,23 @@ struct uip_stats {
 			     checksum. */
   } udp;                  /**< UDP statistics. */
 #endif /* UIP_UDP */
+  struct {
+    uip_stats_t hit;      /**< Number of outgoing IP packets whose
+			     destination was in the ARP table. */
+    uip_stats_t miss;     /**< Number of outgoing IP packets that
+			     needed an ARP request. */
+    uip_stats_t evict;    /**< Number of ARP table entries thrown
+			     away for new ones. */
+#if UIP_ARP_QUEUE
+    uip_stats_t queued;   /**< Number of IP packets queued waiting for
+			     ARP resolution. */
+    uip_stats_t sent;     /**< Number of queued packets sent. */
+    uip_stats_t full;     /**< Number of packets dropped because the
+			     queue was full. */
+    uip_stats_t timeout;  /**< Number of queued packets dropped
+			     because no ARP reply came in time. */
+#endif /* UIP_ARP_QUEUE */
+  } arp;                  /**< ARP statistics. */
 };
 
 /**
@@ -1391,6 +1600,7 @@ void uip_process(u8_t flag);
 #define UIP_TS_MASK     15
   
 #define UIP_STOPPED      16
+#define UIP_CLOSE_PENDING 32
 
 /* The TCP and IP headers. */
 struct uip_tcpip_hdr {
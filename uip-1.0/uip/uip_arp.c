@@ -96,10 +96,25 @@ struct ethip_hdr {
 
 #define ARP_HWTYPE_ETH 1
 
+/* Index into arp_table[], with ARP_NONE for no entry. */
+#if UIP_ARPTAB_SIZE >= 255
+typedef u16_t arp_index_t;
+#else /* UIP_ARPTAB_SIZE >= 255 */
+typedef u8_t arp_index_t;
+#endif /* UIP_ARPTAB_SIZE >= 255 */
+#define ARP_NONE ((arp_index_t)~0)
+
 struct arp_entry {
   u16_t ipaddr[2];
   struct uip_eth_addr ethaddr;
-  u8_t time;
+  u8_t time;                    /* When the entry was last updated. */
+  u8_t used;                    /* When a packet was last sent to the
+				   host, for replacing the least
+				   recently used entry. */
+#if UIP_ARP_HASH
+  arp_index_t next;             /* Next entry in the same bucket or on
+				   the free list. */
+#endif /* UIP_ARP_HASH */
 };
 
 static const struct uip_eth_addr broadcast_ethaddr =
@@ -108,14 +123,141 @@ static const u16_t broadcast_ipaddr[2] = {0xffff,0xffff};
 
 static struct arp_entry arp_table[UIP_ARPTAB_SIZE];
 static u16_t ipaddr[2];
-static u8_t i, c;
+static arp_index_t i;
+static u8_t c;
+
+#if UIP_ARP_HASH
+/* Entries in use are chained from arp_hash[], unused ones from
+   arp_free. */
+static arp_index_t arp_hash[UIP_ARP_HASH];
+static arp_index_t arp_free;
+#endif /* UIP_ARP_HASH */
+
+/* The entry used for the last outgoing packet, checked first. */
+static arp_index_t arp_last;
 
 static u8_t arptime;
 static u8_t tmpage;
 
+#if UIP_ARP_QUEUE
+/* An IP packet waiting for the hardware address of ipaddr, which is
+   all zeroes for unused entries. The packet itself, without the
+   Ethernet header, is in slot i of the architecture's storage. */
+struct arp_pending {
+  u16_t ipaddr[2];
+  u16_t len;
+  u8_t time;
+};
+
+static struct arp_pending arp_pending[UIP_ARP_QUEUE];
+
+/* Queued packets are dropped after this many uip_arp_timer() calls. */
+#define UIP_ARP_QUEUE_MAXAGE 2
+#endif /* UIP_ARP_QUEUE */
+
+#if UIP_STATISTICS == 1
+#define UIP_STAT(s) s
+#else
+#define UIP_STAT(s)
+#endif /* UIP_STATISTICS == 1 */
+
 #define BUF   ((struct arp_hdr *)&uip_buf[0])
 #define IPBUF ((struct ethip_hdr *)&uip_buf[0])
 /*-----------------------------------------------------------------------------------*/
+#if UIP_ARP_HASH
+static u16_t
+arp_bucket(u16_t *ipaddr)
+{
+  u16_t h;
+
+  h = ipaddr[0] ^ ipaddr[1];
+  h ^= h >> 8;
+  return h & (UIP_ARP_HASH - 1);
+}
+#endif /* UIP_ARP_HASH */
+/*-----------------------------------------------------------------------------------*/
+/* Find the ARP table entry for an IP address. */
+static arp_index_t
+arp_lookup(u16_t *ipaddr)
+{
+  arp_index_t n;
+
+#if UIP_ARP_HASH
+  for(n = arp_hash[arp_bucket(ipaddr)]; n != ARP_NONE;
+      n = arp_table[n].next) {
+    if(uip_ipaddr_cmp(ipaddr, arp_table[n].ipaddr)) {
+      return n;
+    }
+  }
+#else /* UIP_ARP_HASH */
+  for(n = 0; n < UIP_ARPTAB_SIZE; ++n) {
+    if(uip_ipaddr_cmp(ipaddr, arp_table[n].ipaddr)) {
+      return n;
+    }
+  }
+#endif /* UIP_ARP_HASH */
+  return ARP_NONE;
+}
+/*-----------------------------------------------------------------------------------*/
+/* Throw away an ARP table entry. */
+static void
+arp_remove(arp_index_t n)
+{
+#if UIP_ARP_HASH
+  arp_index_t *p;
+
+  p = &arp_hash[arp_bucket(arp_table[n].ipaddr)];
+  while(*p != n) {
+    p = &arp_table[*p].next;
+  }
+  *p = arp_table[n].next;
+  arp_table[n].next = arp_free;
+  arp_free = n;
+#endif /* UIP_ARP_HASH */
+  memset(arp_table[n].ipaddr, 0, 4);
+  if(arp_last == n) {
+    arp_last = ARP_NONE;
+  }
+}
+/*-----------------------------------------------------------------------------------*/
+/* Take an unused ARP table entry, or else the least recently used
+   one. */
+static arp_index_t
+arp_alloc(void)
+{
+  arp_index_t n, lru;
+  
+#if UIP_ARP_HASH
+  n = arp_free;
+  if(n != ARP_NONE) {
+    arp_free = arp_table[n].next;
+    return n;
+  }
+#else /* UIP_ARP_HASH */
+  for(n = 0; n < UIP_ARPTAB_SIZE; ++n) {
+    if(arp_table[n].ipaddr[0] == 0 &&
+       arp_table[n].ipaddr[1] == 0) {
+      return n;
+    }
+  }
+#endif /* UIP_ARP_HASH */
+
+  tmpage = 0;
+  lru = 0;
+  for(n = 0; n < UIP_ARPTAB_SIZE; ++n) {
+    if((u8_t)(arptime - arp_table[n].used) > tmpage) {
+      tmpage = arptime - arp_table[n].used;
+      lru = n;
+    }
+  }
+  arp_remove(lru);
+  UIP_STAT(++uip_stat.arp.evict);
+#if UIP_ARP_HASH
+  arp_free = arp_table[lru].next;
+#endif /* UIP_ARP_HASH */
+  return lru;
+}
+/*-----------------------------------------------------------------------------------*/
 /**
  * Initialize the ARP module.
  *
@@ -127,6 +269,22 @@ uip_arp_init(void)
   for(i = 0; i < UIP_ARPTAB_SIZE; ++i) {
     memset(arp_table[i].ipaddr, 0, 4);
   }
+#if UIP_ARP_HASH
+  for(i = 0; i < UIP_ARP_HASH; ++i) {
+    arp_hash[i] = ARP_NONE;
+  }
+  arp_free = ARP_NONE;
+  for(i = 0; i < UIP_ARPTAB_SIZE; ++i) {
+    arp_table[i].next = arp_free;
+    arp_free = i;
+  }
+#endif /* UIP_ARP_HASH */
+  arp_last = ARP_NONE;
+#if UIP_ARP_QUEUE
+  for(i = 0; i < UIP_ARP_QUEUE; ++i) {
+    memset(arp_pending[i].ipaddr, 0, 4);
+  }
+#endif /* UIP_ARP_QUEUE */
 }
 /*-----------------------------------------------------------------------------------*/
 /**
@@ -147,10 +305,19 @@ uip_arp_timer(void)
   for(i = 0; i < UIP_ARPTAB_SIZE; ++i) {
     tabptr = &arp_table[i];
     if((tabptr->ipaddr[0] | tabptr->ipaddr[1]) != 0 &&
-       arptime - tabptr->time >= UIP_ARP_MAXAGE) {
-      memset(tabptr->ipaddr, 0, 4);
+       (u8_t)(arptime - tabptr->time) >= UIP_ARP_MAXAGE) {
+      arp_remove(i);
     }
   }
+#if UIP_ARP_QUEUE
+  for(i = 0; i < UIP_ARP_QUEUE; ++i) {
+    if((arp_pending[i].ipaddr[0] | arp_pending[i].ipaddr[1]) != 0 &&
+       (u8_t)(arptime - arp_pending[i].time) >= UIP_ARP_QUEUE_MAXAGE) {
+      memset(arp_pending[i].ipaddr, 0, 4);
+      UIP_STAT(++uip_stat.arp.timeout);
+    }
+  }
+#endif /* UIP_ARP_QUEUE */
 
 }
 /*-----------------------------------------------------------------------------------*/
@@ -158,61 +325,29 @@ static void
 uip_arp_update(u16_t *ipaddr, struct uip_eth_addr *ethaddr)
 {
   register struct arp_entry *tabptr;
-  /* Walk through the ARP mapping table and try to find an entry to
-     update. If none is found, the IP -> MAC address mapping is
-     inserted in the ARP table. */
-  for(i = 0; i < UIP_ARPTAB_SIZE; ++i) {
 
-    tabptr = &arp_table[i];
-    /* Only check those entries that are actually in use. */
-    if(tabptr->ipaddr[0] != 0 &&
-       tabptr->ipaddr[1] != 0) {
-
-      /* Check if the source IP address of the incoming packet matches
-         the IP address in this ARP table entry. */
-      if(ipaddr[0] == tabptr->ipaddr[0] &&
-	 ipaddr[1] == tabptr->ipaddr[1]) {
-	 
-	/* An old entry found, update this and return. */
-	memcpy(tabptr->ethaddr.addr, ethaddr->addr, 6);
-	tabptr->time = arptime;
-
-	return;
-      }
-    }
-  }
-
-  /* If we get here, no existing ARP table entry was found, so we
-     create one. */
-
-  /* First, we try to find an unused entry in the ARP table. */
-  for(i = 0; i < UIP_ARPTAB_SIZE; ++i) {
-    tabptr = &arp_table[i];
-    if(tabptr->ipaddr[0] == 0 &&
-       tabptr->ipaddr[1] == 0) {
-      break;
-    }
+  /* Unused entries are all zeroes, so there can be no entry for the
+     unspecified address. */
+  if((ipaddr[0] | ipaddr[1]) == 0) {
+    return;
   }
 
-  /* If no unused entry is found, we try to find the oldest entry and
-     throw it away. */
-  if(i == UIP_ARPTAB_SIZE) {
-    tmpage = 0;
-    c = 0;
-    for(i = 0; i < UIP_ARPTAB_SIZE; ++i) {
-      tabptr = &arp_table[i];
-      if(arptime - tabptr->time > tmpage) {
-	tmpage = arptime - tabptr->time;
-	c = i;
-      }
-    }
-    i = c;
+  /* Try to find an entry to update. If none is found, the IP -> MAC
+     address mapping is inserted in the ARP table, in an unused entry
+     or else in the least recently used one. */
+  i = arp_lookup(ipaddr);
+  if(i == ARP_NONE) {
+    i = arp_alloc();
     tabptr = &arp_table[i];
+    memcpy(tabptr->ipaddr, ipaddr, 4);
+    tabptr->used = arptime;
+#if UIP_ARP_HASH
+    tabptr->next = arp_hash[arp_bucket(ipaddr)];
+    arp_hash[arp_bucket(ipaddr)] = i;
+#endif /* UIP_ARP_HASH */
   }
 
-  /* Now, i is the ARP table entry which we will fill with the new
-     information. */
-  memcpy(tabptr->ipaddr, ipaddr, 4);
+  tabptr = &arp_table[i];
   memcpy(tabptr->ethaddr.addr, ethaddr->addr, 6);
   tabptr->time = arptime;
 }
@@ -230,12 +365,15 @@ uip_arp_update(u16_t *ipaddr, struct uip_eth_addr *ethaddr)
  * variable uip_len.
  */
 /*-----------------------------------------------------------------------------------*/
-#if 0
+#if UIP_ARP_LEARN
 void
 uip_arp_ipin(void)
 {
-  uip_len -= sizeof(struct uip_eth_hdr);
-	
+  /* Until the interface has been configured, every host would pass
+     the check below. */
+  if((uip_netmask[0] | uip_netmask[1]) == 0) {
+    return;
+  }
   /* Only insert/update an entry if the source IP address of the
      incoming IP packet comes from a host on the local network. */
   if((IPBUF->srcipaddr[0] & uip_netmask[0]) !=
@@ -250,7 +388,7 @@ uip_arp_ipin(void)
   
   return;
 }
-#endif /* 0 */
+#endif /* UIP_ARP_LEARN */
 /*-----------------------------------------------------------------------------------*/
 /**
  * ARP processing for incoming ARP packets.
@@ -376,15 +514,37 @@ uip_arp_out(void)
       /* Else, we use the destination IP address. */
       uip_ipaddr_copy(ipaddr, IPBUF->destipaddr);
     }
-      
-    for(i = 0; i < UIP_ARPTAB_SIZE; ++i) {
-      tabptr = &arp_table[i];
-      if(uip_ipaddr_cmp(ipaddr, tabptr->ipaddr)) {
-	break;
-      }
+
+    /* Most packets go to the same host as the one before. */
+    if(arp_last != ARP_NONE &&
+       uip_ipaddr_cmp(ipaddr, arp_table[arp_last].ipaddr)) {
+      i = arp_last;
+    } else {
+      i = arp_lookup(ipaddr);
     }
 
-    if(i == UIP_ARPTAB_SIZE) {
+    if(i == ARP_NONE) {
+      UIP_STAT(++uip_stat.arp.miss);
+#if UIP_ARP_QUEUE
+      /* Save the IP packet until the ARP reply comes in. */
+      if((ipaddr[0] | ipaddr[1]) != 0) {
+	for(i = 0; i < UIP_ARP_QUEUE; ++i) {
+	  if((arp_pending[i].ipaddr[0] | arp_pending[i].ipaddr[1]) == 0) {
+	    break;
+	  }
+	}
+	if(i < UIP_ARP_QUEUE) {
+	  uip_arp_queue_write(i, &uip_buf[UIP_LLH_LEN], uip_len);
+	  uip_ipaddr_copy(arp_pending[i].ipaddr, ipaddr);
+	  arp_pending[i].len = uip_len;
+	  arp_pending[i].time = arptime;
+	  UIP_STAT(++uip_stat.arp.queued);
+	} else {
+	  UIP_STAT(++uip_stat.arp.full);
+	}
+      }
+#endif /* UIP_ARP_QUEUE */
+
       /* The destination address was not in our ARP table, so we
 	 overwrite the IP packet with an ARP request. */
 
@@ -408,6 +568,11 @@ uip_arp_out(void)
       return;
     }
 
+    UIP_STAT(++uip_stat.arp.hit);
+    arp_last = i;
+    tabptr = &arp_table[i];
+    tabptr->used = arptime;
+
     /* Build an ethernet header. */
     memcpy(IPBUF->ethhdr.dest.addr, tabptr->ethaddr.addr, 6);
   }
@@ -418,6 +583,49 @@ uip_arp_out(void)
   uip_len += sizeof(struct uip_eth_hdr);
 }
 /*-----------------------------------------------------------------------------------*/
+#if UIP_ARP_QUEUE
+/**
+ * Take a queued IP packet whose destination has been resolved.
+ *
+ * This function should be called by the device driver after
+ * uip_arp_arpin(), and after the ARP reply that it may have created
+ * has been sent. If a packet that uip_arp_out() queued can now be
+ * sent, it is put in the uip_buf[] buffer with an Ethernet header,
+ * and uip_len is set to its length. Otherwise uip_len is set to
+ * zero. The function should be called until uip_len is zero.
+ */
+/*-----------------------------------------------------------------------------------*/
+void
+uip_arp_dequeue(void)
+{
+  struct arp_pending *p;
+  struct arp_entry *tabptr;
+  
+  uip_len = 0;
+  for(c = 0; c < UIP_ARP_QUEUE; ++c) {
+    p = &arp_pending[c];
+    if((p->ipaddr[0] | p->ipaddr[1]) == 0) {
+      continue;
+    }
+    i = arp_lookup(p->ipaddr);
+    if(i == ARP_NONE) {
+      continue;
+    }
+    tabptr = &arp_table[i];
+
+    uip_arp_queue_read(c, &uip_buf[UIP_LLH_LEN], p->len);
+    memcpy(IPBUF->ethhdr.dest.addr, tabptr->ethaddr.addr, 6);
+    memcpy(IPBUF->ethhdr.src.addr, uip_ethaddr.addr, 6);
+    IPBUF->ethhdr.type = HTONS(UIP_ETHTYPE_IP);
+    uip_len = p->len + sizeof(struct uip_eth_hdr);
+
+    memset(p->ipaddr, 0, 4);
+    UIP_STAT(++uip_stat.arp.sent);
+    return;
+  }
+}
+#endif /* UIP_ARP_QUEUE */
+/*-----------------------------------------------------------------------------------*/
 
 /** @} */
 /** @} */
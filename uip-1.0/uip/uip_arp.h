@@ -79,9 +79,13 @@ void uip_arp_init(void);
    arrives from the Ethernet. This function refreshes the ARP table or
    inserts a new mapping if none exists. The function assumes that an
    IP packet with an Ethernet header is present in the uip_buf buffer
-   and that the length of the packet is in the uip_len variable. */
-/*void uip_arp_ipin(void);*/
+   and that the length of the packet is in the uip_len variable. It
+   only does anything with UIP_ARP_LEARN set. */
+#if UIP_ARP_LEARN
+void uip_arp_ipin(void);
+#else /* UIP_ARP_LEARN */
 #define uip_arp_ipin()
+#endif /* UIP_ARP_LEARN */
 
 /* The uip_arp_arpin() should be called when an ARP packet is received
    by the Ethernet driver. This function also assumes that the
@@ -99,10 +103,27 @@ void uip_arp_arpin(void);
    address (or the IP address of the default router) is present. If no
    such table entry is found, the IP packet is overwritten with an ARP
    request and we rely on TCP to retransmit the packet that was
-   overwritten. In any case, the uip_len variable holds the length of
-   the Ethernet frame that should be transmitted. */
+   overwritten, unless UIP_ARP_QUEUE is set and the packet could be
+   queued. In any case, the uip_len variable holds the length of the
+   Ethernet frame that should be transmitted. */
 void uip_arp_out(void);
 
+#if UIP_ARP_QUEUE
+/* The uip_arp_dequeue() function should be called after
+   uip_arp_arpin(), once its reply, if any, has been sent. It puts a
+   queued packet whose destination has been resolved in the uip_buf
+   buffer, with its Ethernet header, and sets uip_len to its length,
+   or uip_len to zero if there is none. It should be called until
+   uip_len is zero. */
+void uip_arp_dequeue(void);
+
+/* Storage for the queued packets, provided by the architecture.
+   There is room for UIP_ARP_QUEUE packets of up to UIP_BUFSIZE -
+   UIP_LLH_LEN bytes, and slot is in the range 0 to UIP_ARP_QUEUE - 1. */
+void uip_arp_queue_write(u8_t slot, const void *data, u16_t len);
+void uip_arp_queue_read(u8_t slot, void *data, u16_t len);
+#endif /* UIP_ARP_QUEUE */
+
 /* The uip_arp_timer() function should be called every ten seconds. It
    is responsible for flushing old entries in the ARP table. */
 void uip_arp_timer(void);
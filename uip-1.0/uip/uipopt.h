@@ -258,6 +258,23 @@
 #define UIP_CONNS UIP_CONF_MAX_CONNECTIONS
 #endif /* UIP_CONF_MAX_CONNECTIONS */
 
+/**
+ * The number of buckets in the TCP connection hash table.
+ *
+ * When non-zero, incoming segments are matched to their connection
+ * through a hash of the remote address and the two ports, and unused
+ * connections are kept on a free list, instead of searching all of
+ * uip_conns[] for either. Must be a power of two. Each bucket
+ * requires a pointer, and each connection another.
+ *
+ * \hideinitializer
+ */
+#ifdef UIP_CONF_CONN_HASH
+#define UIP_CONN_HASH UIP_CONF_CONN_HASH
+#else /* UIP_CONF_CONN_HASH */
+#define UIP_CONN_HASH 0
+#endif /* UIP_CONF_CONN_HASH */
+
 
 /**
  * The maximum number of simultaneously listening TCP ports.
@@ -284,11 +301,63 @@
 #define UIP_URGDATA      0
 
 /**
- * The initial retransmission timeout counted in timer pulses.
+ * Run the TCP timers on clock_time() instead of on calls to
+ * uip_periodic().
+ *
+ * Normally every call to uip_periodic() is one timer pulse, so it has
+ * to be called at a fixed rate for every connection. When set, the
+ * timers count clock ticks and are brought up to date whenever uIP
+ * touches a connection. uip_periodic() then only needs to be called
+ * for a connection once the time given by uip_tcp_deadline() has
+ * passed.
+ *
+ * \hideinitializer
+ */
+#ifdef UIP_CONF_TCP_CLOCK
+#define UIP_TCP_CLOCK UIP_CONF_TCP_CLOCK
+#else /* UIP_CONF_TCP_CLOCK */
+#define UIP_TCP_CLOCK 0
+#endif /* UIP_CONF_TCP_CLOCK */
+
+#if UIP_TCP_CLOCK
+#include "clock.h"
+
+/**
+ * How often an idle connection is polled, in clock ticks.
+ */
+#define UIP_POLL_INTERVAL (CLOCK_SECOND / 2)
+#endif /* UIP_TCP_CLOCK */
+
+/**
+ * The initial retransmission timeout counted in timer pulses, or in
+ * clock ticks with UIP_TCP_CLOCK.
  *
  * This should not be changed.
  */
+#if UIP_TCP_CLOCK
+#define UIP_RTO         (3 * CLOCK_SECOND / 2)
+#else /* UIP_TCP_CLOCK */
 #define UIP_RTO         3
+#endif /* UIP_TCP_CLOCK */
+
+/**
+ * Bounds of the retransmission timeout estimated from the round-trip
+ * time, and of the timeout after backing off, in the same units as
+ * UIP_RTO.
+ *
+ * On a LAN the estimate converges on a few clock ticks, which a peer
+ * that delays its ACKs by up to 200 ms would exceed. RFC 6298 asks
+ * for at least one second; half a second still leaves room for
+ * delayed ACKs. The timer pulses without UIP_TCP_CLOCK are half a
+ * second long.
+ */
+#if UIP_TCP_CLOCK
+#define UIP_RTO_MIN     (CLOCK_SECOND / 2)
+#define UIP_RTO_MAX     (60 * CLOCK_SECOND)
+#else /* UIP_TCP_CLOCK */
+#define UIP_RTO_MIN     1
+#define UIP_RTO_MAX     120
+#endif /* UIP_TCP_CLOCK */
 
 /**
  * The maximum number of times a segment should be retransmitted
@@ -312,8 +381,14 @@
  *
  * This is should not be to set to more than
  * UIP_BUFSIZE - UIP_LLH_LEN - UIP_TCPIP_HLEN.
+ *
+ * \hideinitializer
  */
+#ifdef UIP_CONF_TCP_MSS
+#define UIP_TCP_MSS     UIP_CONF_TCP_MSS
+#else /* UIP_CONF_TCP_MSS */
 #define UIP_TCP_MSS     (UIP_BUFSIZE - UIP_LLH_LEN - UIP_TCPIP_HLEN)
+#endif /* UIP_CONF_TCP_MSS */
 
 /**
  * The size of the advertised receiver's window.
@@ -336,7 +411,33 @@
  * This configiration option has no real implication, and it should be
  * left untouched.
  */
+#if UIP_TCP_CLOCK
+#define UIP_TIME_WAIT_TIMEOUT (60 * CLOCK_SECOND)
+#else /* UIP_TCP_CLOCK */
 #define UIP_TIME_WAIT_TIMEOUT 120
+#endif /* UIP_TCP_CLOCK */
+
+/**
+ * The number of connections in TIME_WAIT that are remembered outside
+ * of uip_conns[].
+ *
+ * When non-zero, a connection that enters TIME_WAIT is closed right
+ * away, and only its addresses, ports and sequence numbers are kept
+ * in a separate table for UIP_TIME_WAIT_TIMEOUT. Segments for the old
+ * connection are still acknowledged from there. A SYN for the same
+ * ports with a sequence number beyond the old connection's starts a
+ * new connection (RFC 6191). When the table is full, the oldest entry
+ * is forgotten. Each entry requires about 20 bytes of memory.
+ *
+ * Requires UIP_TCP_CLOCK.
+ *
+ * \hideinitializer
+ */
+#ifdef UIP_CONF_TIME_WAIT_CONNS
+#define UIP_TIME_WAIT_CONNS UIP_CONF_TIME_WAIT_CONNS
+#else /* UIP_CONF_TIME_WAIT_CONNS */
+#define UIP_TIME_WAIT_CONNS 0
+#endif /* UIP_CONF_TIME_WAIT_CONNS */
 
 
 /** @} */
@@ -368,6 +469,55 @@
  */
 #define UIP_ARP_MAXAGE 120
 
+/**
+ * The number of buckets in the ARP table hash.
+ *
+ * When non-zero, the ARP table is searched through a hash of the IP
+ * address instead of entry by entry, so that it can hold hundreds of
+ * hosts. Must be a power of two. Each bucket and each entry requires
+ * another table index.
+ *
+ * \hideinitializer
+ */
+#ifdef UIP_CONF_ARP_HASH
+#define UIP_ARP_HASH UIP_CONF_ARP_HASH
+#else /* UIP_CONF_ARP_HASH */
+#define UIP_ARP_HASH 0
+#endif /* UIP_CONF_ARP_HASH */
+
+/**
+ * Learn hardware addresses from incoming IP packets.
+ *
+ * When set, uip_arp_ipin() adds or refreshes the ARP table entry of
+ * the sender of every IP packet from the local network, so that hosts
+ * that talk to uIP need not be asked with ARP requests.
+ *
+ * \hideinitializer
+ */
+#ifdef UIP_CONF_ARP_LEARN
+#define UIP_ARP_LEARN UIP_CONF_ARP_LEARN
+#else /* UIP_CONF_ARP_LEARN */
+#define UIP_ARP_LEARN 0
+#endif /* UIP_CONF_ARP_LEARN */
+
+/**
+ * The number of IP packets that can wait for ARP resolution.
+ *
+ * When non-zero, uip_arp_out() saves a packet for a host that is not
+ * in the ARP table before it replaces it with an ARP request, and
+ * uip_arp_dequeue() hands it back once the reply has come in. The
+ * packets are stored with uip_arp_queue_write(), which the
+ * architecture must provide. A packet that gets no reply within two
+ * calls to uip_arp_timer() is dropped.
+ *
+ * \hideinitializer
+ */
+#ifdef UIP_CONF_ARP_QUEUE
+#define UIP_ARP_QUEUE UIP_CONF_ARP_QUEUE
+#else /* UIP_CONF_ARP_QUEUE */
+#define UIP_ARP_QUEUE 0
+#endif /* UIP_CONF_ARP_QUEUE */
+
 /** @} */
 
 /*------------------------------------------------------------------------------*/
@@ -459,6 +609,78 @@ void uip_log(char *msg);
 #define UIP_LLH_LEN     14
 #endif /* UIP_CONF_LLH_LEN */
 
+/**
+ * Lay out uip_buf so that the IP header is 32-bit aligned.
+ *
+ * When set, uip_buf starts UIP_BUFALIGN_PAD bytes into a word aligned
+ * buffer, which makes the IP addresses and TCP sequence numbers word
+ * aligned as well. uIP then moves and compares them with 32-bit loads
+ * and stores, so the configuration must define a 32-bit u32_t type.
+ * Device drivers keep reading and writing frames at uip_buf.
+ *
+ * \hideinitializer
+ */
+#ifdef UIP_CONF_BUFALIGN
+#define UIP_BUFALIGN UIP_CONF_BUFALIGN
+#else /* UIP_CONF_BUFALIGN */
+#define UIP_BUFALIGN 0
+#endif /* UIP_CONF_BUFALIGN */
+
+/**
+ * Let the network device compute and verify IP and TCP checksums.
+ *
+ * When set, uIP leaves the IP header and TCP checksum fields of
+ * outgoing packets zero, and does not verify the checksums of
+ * incoming packets. The device driver must fill in the zeroed
+ * fields before transmission and only pass on packets with valid
+ * checksums.
+ *
+ * \hideinitializer
+ */
+#ifdef UIP_CONF_CHECKSUM_OFFLOAD
+#define UIP_CHECKSUM_OFFLOAD UIP_CONF_CHECKSUM_OFFLOAD
+#else /* UIP_CONF_CHECKSUM_OFFLOAD */
+#define UIP_CHECKSUM_OFFLOAD 0
+#endif /* UIP_CONF_CHECKSUM_OFFLOAD */
+
+/**
+ * Let the device driver retransmit unacknowledged segments.
+ *
+ * When set, uIP first calls uip_rexmit_cache_resend() when a
+ * segment in the ESTABLISHED state needs to be retransmitted. Only
+ * if the driver does not hold a copy of the segment is the
+ * application called with the UIP_REXMIT flag.
+ *
+ * \hideinitializer
+ */
+#ifdef UIP_CONF_REXMIT_CACHE
+#define UIP_REXMIT_CACHE UIP_CONF_REXMIT_CACHE
+#else /* UIP_CONF_REXMIT_CACHE */
+#define UIP_REXMIT_CACHE 0
+#endif /* UIP_CONF_REXMIT_CACHE */
+
+/**
+ * The number of unacknowledged segments a TCP connection may have
+ * in flight.
+ *
+ * When non-zero, uIP keeps a copy of every segment sent through the
+ * uip_window_write() and uip_window_read() functions, which must be
+ * provided by the system, and retransmits from that copy. The
+ * application then never sees the UIP_REXMIT flag, and data passed
+ * to uip_send() may be discarded once it has been sent. uip_cansend()
+ * tells whether the window has room for another segment.
+ *
+ * When zero, the standard uIP behaviour of a single unacknowledged
+ * segment applies.
+ *
+ * \hideinitializer
+ */
+#ifdef UIP_CONF_SEND_WINDOW
+#define UIP_SEND_WINDOW UIP_CONF_SEND_WINDOW
+#else /* UIP_CONF_SEND_WINDOW */
+#define UIP_SEND_WINDOW 0
+#endif /* UIP_CONF_SEND_WINDOW */
+
 /** @} */
 /*------------------------------------------------------------------------------*/
 /**
@@ -0,0 +1,160 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <uip/uip.h>
+#include <uip/uip_arch.h>
+
+/*
+ * Internet checksums for the Cortex-M4, used by uIP with
+ * UIP_ARCH_CHKSUM.
+ *
+ * The data is summed a 32-bit word at a time in native (little
+ * endian) order. The one's complement sum is independent of byte
+ * order (RFC 1071), so the result only needs swapping at the end.
+ * A buffer starting on an odd address is summed from the byte after,
+ * which swaps the bytes of every 16-bit word; the final swap is then
+ * skipped instead.
+ */
+
+#define BUF ((struct uip_tcpip_hdr *)&uip_buf[UIP_LLH_LEN])
+
+#define SWAP16(x) ((u16_t)(((x) << 8) | ((x) >> 8)))
+
+/**
+ * Add n blocks of 16 bytes from the word aligned p to acc, with the
+ * carries folded back in. n must not be zero.
+ */
+static uint32_t
+sum_blocks(const uint32_t *p, uint32_t n, uint32_t acc) {
+#if defined(__thumb2__)
+  uint32_t a, b, c, d;
+
+  __asm__ volatile(
+    "1:	ldr	%[a], [%[p]], #4\n"
+    "	ldr	%[b], [%[p]], #4\n"
+    "	ldr	%[c], [%[p]], #4\n"
+    "	ldr	%[d], [%[p]], #4\n"
+    "	adds	%[acc], %[acc], %[a]\n"
+    "	adcs	%[acc], %[acc], %[b]\n"
+    "	adcs	%[acc], %[acc], %[c]\n"
+    "	adcs	%[acc], %[acc], %[d]\n"
+    "	adc	%[acc], %[acc], #0\n"
+    "	subs	%[n], %[n], #1\n"
+    "	bne	1b\n"
+    : [p] "+r" (p), [n] "+r" (n), [acc] "+r" (acc),
+      [a] "=&r" (a), [b] "=&r" (b), [c] "=&r" (c), [d] "=&r" (d)
+    :
+    : "cc", "memory");
+  return acc;
+#else
+  uint64_t sum = acc;
+
+  while(n--) {
+    sum += p[0];
+    sum += p[1];
+    sum += p[2];
+    sum += p[3];
+    p += 4;
+  }
+  sum = (sum & 0xffffffff) + (sum >> 32);
+  return (uint32_t)sum + (uint32_t)(sum >> 32);
+#endif
+}
+
+/**
+ * Same as the generic chksum() in uip.c: add the 16-bit big endian
+ * words of data to sum, which is in host byte order.
+ */
+static u16_t
+chksum(u16_t sum, const u8_t *data, u16_t len) {
+  bool odd = (uintptr_t)data & 1;
+  uint32_t acc = odd ? sum : SWAP16(sum);
+  uint32_t t;
+
+  if(odd && len > 0) {
+    acc += (uint32_t)*data++ << 8;
+    len--;
+  }
+  if(((uintptr_t)data & 2) && len >= 2) {
+    acc += *(const uint16_t *)data;
+    data += 2;
+    len -= 2;
+  }
+
+  if(len >= 16) {
+    acc = sum_blocks((const uint32_t *)data, len / 16, acc);
+    data += len & ~15;
+    len &= 15;
+  }
+
+  while(len >= 4) {
+    t = *(const uint32_t *)data;
+    acc += t;
+    if(acc < t) {
+      acc++;
+    }
+    data += 4;
+    len -= 4;
+  }
+  if(len >= 2) {
+    t = *(const uint16_t *)data;
+    acc += t;
+    if(acc < t) {
+      acc++;
+    }
+    data += 2;
+    len -= 2;
+  }
+  if(len > 0) {
+    t = *data;
+    acc += t;
+    if(acc < t) {
+      acc++;
+    }
+  }
+
+  acc = (acc & 0xffff) + (acc >> 16);
+  acc = (acc & 0xffff) + (acc >> 16);
+
+  return odd ? (u16_t)acc : SWAP16((u16_t)acc);
+}
+
+u16_t
+uip_chksum(u16_t *data, u16_t len) {
+  return htons(chksum(0, (u8_t *)data, len));
+}
+
+u16_t
+uip_ipchksum(void) {
+  u16_t sum;
+
+  sum = chksum(0, &uip_buf[UIP_LLH_LEN], UIP_IPH_LEN);
+  return (sum == 0) ? 0xffff : htons(sum);
+}
+
+static u16_t
+upper_layer_chksum(u8_t proto) {
+  u16_t upper_layer_len;
+  u16_t sum;
+
+  upper_layer_len = (((u16_t)(BUF->len[0]) << 8) + BUF->len[1]) - UIP_IPH_LEN;
+
+  /* Pseudo header: protocol, length and both addresses */
+  sum = upper_layer_len + proto;
+  sum = chksum(sum, (u8_t *)&BUF->srcipaddr[0], 2 * sizeof(uip_ipaddr_t));
+
+  sum = chksum(sum, &uip_buf[UIP_IPH_LEN + UIP_LLH_LEN], upper_layer_len);
+
+  return (sum == 0) ? 0xffff : htons(sum);
+}
+
+u16_t
+uip_tcpchksum(void) {
+  return upper_layer_chksum(UIP_PROTO_TCP);
+}
+
+#if UIP_UDP_CHECKSUMS
+u16_t
+uip_udpchksum(void) {
+  return upper_layer_chksum(UIP_PROTO_UDP);
+}
+#endif
@@ -37,6 +37,13 @@ typedef unsigned char u8_t;
 //
 typedef unsigned short u16_t;
 
+//
+// 32 bit datatype
+// This typedef defines the 32-bit type used by the aligned buffer layout.
+// unsigned long would be 64 bits wide in a host build.
+//
+typedef unsigned int u32_t;
+
 //
 // Statistics datatype
 // This typedef defines the dataype used for keeping statistics in
@@ -67,10 +74,26 @@ typedef unsigned short uip_stats_t;
 #define UIP_CONF_UDP_CONNS          4
 
 //
-// Maximum number of TCP connections.
+// Maximum number of TCP connections. Besides about 100 bytes of RAM
+// for struct uip_conn, each connection takes:
+//  - a 1 KB retransmission slot in ENC28J60 buffer memory, with
+//    UIP_CONF_REXMIT_CACHE. A third connection would leave the RX
+//    ring less than ENC_RX_MIN, which enc28j60.c refuses to build.
+//  - UIP_CONF_SEND_WINDOW * UIP_CONF_TCP_MSS bytes of SPI SRAM for
+//    the copies of unacknowledged segments, 3848 bytes here, of which
+//    the SRAM has room for three connections (see main.c).
+// For more connections, turn off UIP_CONF_REXMIT_CACHE, then lower
+// UIP_CONF_SEND_WINDOW or UIP_CONF_TCP_MSS. With UIP_CONF_SEND_WINDOW
+// 0, segments are regenerated by the application and need no SRAM.
 //
 #define UIP_CONF_MAX_CONNECTIONS    2
 
+//
+// TCP connections are looked up through a hash table with this many
+// buckets, and new ones taken from a free list
+//
+#define UIP_CONF_CONN_HASH          8
+
 //
 // Maximum number of listening TCP ports.
 //
@@ -82,9 +105,70 @@ typedef unsigned short uip_stats_t;
 //#define UIP_CONF_RECEIVE_WINDOW     400
 
 //
-// Size of ARP table
+// Size of ARP table, and the number of buckets it is hashed into
+//
+#define UIP_CONF_ARPTAB_SIZE        128
+#define UIP_CONF_ARP_HASH           32
+
+//
+// Learn the hardware addresses of hosts on the local network from the
+// IP packets they send. Off, as any host sending to us can then push
+// useful entries out of the table
+//
+#define UIP_CONF_ARP_LEARN          0
+
+//
+// Up to this many IP packets wait in the SPI SRAM for an ARP reply,
+// instead of being replaced by the ARP request
+//
+#define UIP_CONF_ARP_QUEUE          4
+
+//
+// IP and TCP checksums are computed and verified by the
+// ENC28J60 DMA checksum engine
+//
+#define UIP_CONF_CHECKSUM_OFFLOAD   1
+
+//
+// The remaining software checksums use the word-at-a-time versions
+// in uip-arch.c
+//
+#define UIP_ARCH_CHKSUM             1
+
+//
+// Pad uip_buf so that the IP header is word aligned
+//
+#define UIP_CONF_BUFALIGN           1
+
+//
+// uip_buf points into one of the frame buffers of pktbuf.c, so the
+// ENC28J60 driver can receive and queue frames without copying
+//
+#define UIP_CONF_EXTERNAL_BUFFER
+
+//
+// Unacknowledged TCP segments are kept in ENC28J60 buffer memory
+// and retransmitted from there
+//
+#define UIP_CONF_REXMIT_CACHE       1
+
+//
+// Up to this many TCP segments per connection are kept in flight,
+// with copies in the SPI SRAM for retransmission
+//
+#define UIP_CONF_SEND_WINDOW        4
+
+//
+// The TCP timers run on clock_time(), so uip_periodic() is only called
+// for connections that have a timer due
+//
+#define UIP_CONF_TCP_CLOCK          1
+
+//
+// Connections in TIME_WAIT are closed right away, and up to this many
+// are remembered in a smaller table until they time out
 //
-#define UIP_CONF_ARPTAB_SIZE        8
+#define UIP_CONF_TIME_WAIT_CONNS    8
 
 //
 // uIP buffer size.
@@ -92,9 +176,12 @@ typedef unsigned short uip_stats_t;
 #define UIP_CONF_BUFFER_SIZE        1600
 
 //
-// uIP buffer is defined in the application.
+// TCP maximum segment size. A frame with a full segment is kept for
+// each connection in a 1 KB slot of ENC28J60 buffer memory, so that
+// the RX ring keeps 3 KB of the 8 KB (see enc28j60.c): 1024 less the
+// control byte, status vector and 54 bytes of headers.
 //
-#undef UIP_CONF_EXTERNAL_BUFFER
+#define UIP_CONF_TCP_MSS            962
 
 //
 // uIP statistics on or off